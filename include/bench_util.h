@@ -0,0 +1,116 @@
+#pragma once
+
+#include <time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+#include "playout.h"
+#include "timing.h"
+
+namespace onoro {
+namespace bench {
+
+// The minimum amount of time to repeat each benchmark for.
+static constexpr double min_bench_time = 0.25;
+
+// Results of benchmark passes are written here so they aren't optimized away.
+static volatile uint64_t bench_sink;
+
+/*
+ * Positions of games with NPawns pawns, sampled along random playouts. The
+ * playouts are generated from a fixed seed with an engine whose output is
+ * defined by the standard, so the corpus is the same on every machine and at
+ * every commit, as long as the rules of the game don't change.
+ */
+template <uint32_t NPawns>
+struct Corpus {
+  // Unfinished games in the first phase, where pawns are being placed.
+  std::vector<Game<NPawns>> phase1;
+  // Unfinished games in the second phase, where pawns are being moved.
+  std::vector<Game<NPawns>> phase2;
+  // Games which were just moved to, with the tile of one of the pawns of the
+  // player who moved.
+  std::vector<std::pair<Game<NPawns>, idx_t>> last_moves;
+};
+
+/*
+ * Plays random games until `n_positions` positions have been found in each
+ * phase of the game. Playouts which run longer than `max_playout_len` moves
+ * are restarted from the beginning.
+ */
+template <uint32_t NPawns>
+Corpus<NPawns> genCorpus(uint32_t n_positions, uint32_t seed = 0,
+                         uint32_t max_playout_len = 64) {
+  Corpus<NPawns> corpus;
+  if (n_positions == 0) {
+    return corpus;
+  }
+
+  forEachPlayoutPosition<NPawns>(
+      seed, UINT32_MAX, max_playout_len + 1,
+      [n_positions, &corpus](const Game<NPawns>& g, uint32_t ply) {
+        if (ply == 0) {
+          return true;
+        }
+
+        if (corpus.last_moves.size() < n_positions) {
+          corpus.last_moves.emplace_back(
+              g, *g.color_pawns_begin(!g.blackTurn()));
+        }
+        if (!g.isFinished()) {
+          std::vector<Game<NPawns>>& games =
+              g.inPhase2() ? corpus.phase2 : corpus.phase1;
+          if (games.size() < n_positions) {
+            games.push_back(g);
+          }
+        }
+
+        return corpus.phase1.size() < n_positions ||
+               corpus.phase2.size() < n_positions;
+      });
+
+  return corpus;
+}
+
+/*
+ * Runs `pass`, which does `ops_per_pass` operations and returns a checksum of
+ * their results, until at least min_bench_time seconds have passed. Prints the
+ * results as one line of JSON, so the output of a benchmark binary is JSON
+ * lines which can be compared between commits.
+ *
+ * The checksum of a pass is printed along with the timings, so changes to the
+ * results of the benchmarked functions stand out.
+ */
+template <class PassFn>
+void run(const std::string& name, uint32_t n_pawns, uint64_t ops_per_pass,
+         PassFn pass) {
+  // Warm up caches and the branch predictor before timing anything.
+  const uint64_t checksum = pass();
+
+  struct timespec start, end;
+  uint64_t n_passes = 0;
+  double elapsed;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    bench_sink = pass();
+    n_passes++;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = elapsedSeconds(start, end);
+  } while (elapsed < min_bench_time);
+
+  uint64_t n_ops = n_passes * ops_per_pass;
+  printf(
+      "{\"bench\": \"%s\", \"n_pawns\": %u, \"n_ops\": %llu, "
+      "\"seconds\": %.6f, \"ns_per_op\": %.3f, \"checksum\": %llu}\n",
+      name.c_str(), n_pawns, static_cast<unsigned long long>(n_ops), elapsed,
+      elapsed * 1000000000. / n_ops, static_cast<unsigned long long>(checksum));
+  fflush(stdout);
+}
+
+}  // namespace bench
+}  // namespace onoro
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace onoro {
+
+/*
+ * A fixed-size set of NBits bits, used to track which tiles of a board are
+ * occupied. Bits above NBits are always kept zero.
+ */
+template <uint32_t NBits>
+class Bitboard {
+  static constexpr uint32_t bits_per_word = 64;
+
+ public:
+  static constexpr uint32_t n_words =
+      (NBits + bits_per_word - 1) / bits_per_word;
+
+  constexpr Bitboard() : words_{} {}
+
+  // Returns a bitboard with all NBits bits set.
+  static constexpr Bitboard full() {
+    Bitboard b;
+    for (uint32_t i = 0; i < n_words; i++) {
+      b.words_[i] = ~uint64_t(0);
+    }
+    b.maskTop();
+    return b;
+  }
+
+  constexpr bool test(uint32_t i) const {
+    return (words_[i / bits_per_word] >> (i % bits_per_word)) & 1;
+  }
+
+  constexpr void set(uint32_t i) {
+    words_[i / bits_per_word] |= uint64_t(1) << (i % bits_per_word);
+  }
+
+  constexpr void clear(uint32_t i) {
+    words_[i / bits_per_word] &= ~(uint64_t(1) << (i % bits_per_word));
+  }
+
+  constexpr void clearAll() {
+    for (uint32_t i = 0; i < n_words; i++) {
+      words_[i] = 0;
+    }
+  }
+
+  constexpr bool empty() const {
+    uint64_t any = 0;
+    for (uint32_t i = 0; i < n_words; i++) {
+      any |= words_[i];
+    }
+    return any == 0;
+  }
+
+  constexpr uint32_t count() const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < n_words; i++) {
+      n += __builtin_popcountll(words_[i]);
+    }
+    return n;
+  }
+
+  /*
+   * Returns this bitboard with every bit moved `n` positions higher (or -n
+   * positions lower if n is negative). Bits shifted past either end are
+   * dropped.
+   */
+  constexpr Bitboard shifted(int32_t n) const {
+    Bitboard b;
+    if (n >= 0) {
+      uint32_t word_shift = static_cast<uint32_t>(n) / bits_per_word;
+      uint32_t bit_shift = static_cast<uint32_t>(n) % bits_per_word;
+
+      for (uint32_t i = n_words; i-- > word_shift;) {
+        uint64_t w = words_[i - word_shift] << bit_shift;
+        if (bit_shift != 0 && i > word_shift) {
+          w |= words_[i - word_shift - 1] >> (bits_per_word - bit_shift);
+        }
+        b.words_[i] = w;
+      }
+      b.maskTop();
+    } else {
+      uint32_t word_shift = static_cast<uint32_t>(-n) / bits_per_word;
+      uint32_t bit_shift = static_cast<uint32_t>(-n) % bits_per_word;
+
+      for (uint32_t i = 0; i + word_shift < n_words; i++) {
+        uint64_t w = words_[i + word_shift] >> bit_shift;
+        if (bit_shift != 0 && i + word_shift + 1 < n_words) {
+          w |= words_[i + word_shift + 1] << (bits_per_word - bit_shift);
+        }
+        b.words_[i] = w;
+      }
+    }
+    return b;
+  }
+
+  constexpr Bitboard operator|(const Bitboard& other) const {
+    Bitboard b;
+    for (uint32_t i = 0; i < n_words; i++) {
+      b.words_[i] = words_[i] | other.words_[i];
+    }
+    return b;
+  }
+
+  constexpr Bitboard operator&(const Bitboard& other) const {
+    Bitboard b;
+    for (uint32_t i = 0; i < n_words; i++) {
+      b.words_[i] = words_[i] & other.words_[i];
+    }
+    return b;
+  }
+
+  constexpr Bitboard operator~() const {
+    Bitboard b;
+    for (uint32_t i = 0; i < n_words; i++) {
+      b.words_[i] = ~words_[i];
+    }
+    b.maskTop();
+    return b;
+  }
+
+  constexpr Bitboard& operator|=(const Bitboard& other) {
+    return *this = *this | other;
+  }
+
+  constexpr Bitboard& operator&=(const Bitboard& other) {
+    return *this = *this & other;
+  }
+
+  // Compares every word without exiting early, so the comparison compiles to a
+  // few vector compares.
+  constexpr bool operator==(const Bitboard& other) const {
+    uint64_t diff = 0;
+    for (uint32_t i = 0; i < n_words; i++) {
+      diff |= words_[i] ^ other.words_[i];
+    }
+    return diff == 0;
+  }
+
+  constexpr bool operator!=(const Bitboard& other) const {
+    return !(*this == other);
+  }
+
+  /*
+   * Calls cb with the index of every set bit, in increasing order. If cb
+   * returns false, iteration halts and this method returns false.
+   */
+  template <class CallbackFnT>
+  constexpr bool forEachSetBit(CallbackFnT cb) const {
+    for (uint32_t i = 0; i < n_words; i++) {
+      uint64_t w = words_[i];
+      while (w != 0) {
+        if (!cb(i * bits_per_word + __builtin_ctzll(w))) {
+          return false;
+        }
+        w &= w - 1;
+      }
+    }
+    return true;
+  }
+
+ private:
+  constexpr void maskTop() {
+    if (NBits % bits_per_word != 0) {
+      words_[n_words - 1] &=
+          (uint64_t(1) << (NBits % bits_per_word)) - 1;
+    }
+  }
+
+  std::array<uint64_t, n_words> words_;
+};
+
+}  // namespace onoro
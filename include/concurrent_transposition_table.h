@@ -0,0 +1,129 @@
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/hash/hash.h>
+#include <absl/types/optional.h>
+
+#include <array>
+#include <mutex>
+
+#include "game.h"
+#include "game_key.h"
+
+namespace onoro {
+
+/*
+ * A transposition table which is safe to share between search threads.
+ *
+ * The table is split into independently locked shards, and every lookup only
+ * locks the shard selected by the hash of the game's GameKey. Since games which
+ * are equivalent under symmetries share the same key, a lookup always lands in
+ * the shard the matching entry was inserted into. Like TranspositionTable, only
+ * the keys of games are stored.
+ */
+template <uint32_t NPawns>
+class ConcurrentTranspositionTable {
+  using KeyHash = absl::Hash<GameKey<NPawns>>;
+  using TableT = absl::flat_hash_map<GameKey<NPawns>, TableEntry, KeyHash>;
+
+  // Number of independently locked shards.
+  static constexpr uint32_t shard_bits = 7;
+  static constexpr uint32_t n_shards = 1u << shard_bits;
+  static constexpr uint32_t cache_line_size = 64;
+
+ public:
+  ConcurrentTranspositionTable() {}
+
+  ConcurrentTranspositionTable(const ConcurrentTranspositionTable&) = delete;
+  ConcurrentTranspositionTable& operator=(const ConcurrentTranspositionTable&) =
+      delete;
+
+  absl::optional<onoro::Score> find(const onoro::Game<NPawns>& game) const {
+    absl::optional<onoro::TableEntry> entry = findEntry(game);
+    if (entry.has_value()) {
+      return entry->score;
+    }
+    return {};
+  }
+
+  absl::optional<onoro::TableEntry> findEntry(
+      const onoro::Game<NPawns>& game) const {
+    GameKey<NPawns> key(game);
+    const Shard& shard = shards_[shardIdx(KeyHash()(key))];
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.table.find(key);
+    if (it != shard.table.end()) {
+      return it->second;
+    }
+    return {};
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.lock);
+      shard.table.clear();
+    }
+  }
+
+  void insert_or_assign(const onoro::Game<NPawns>& game) {
+    GameKey<NPawns> key(game);
+    Shard& shard = shards_[shardIdx(KeyHash()(key))];
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+    shard.table.insert_or_assign(key, game.getTableEntry());
+  }
+
+  /*
+   * Returns the total number of entries in the table. This is only a snapshot
+   * if other threads are concurrently inserting into the table.
+   */
+  std::size_t size() const {
+    std::size_t size = 0;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.lock);
+      size += shard.table.size();
+    }
+    return size;
+  }
+
+  /*
+   * Calls `cb` with a game equivalent to each game in the table, with its
+   * table entry set, until `cb` returns false. Returns false if any call to
+   * `cb` returned false. Like TranspositionTable::forEachGame, the best move of
+   * the entry refers to the same move from the game `cb` is called with as from
+   * the inserted game. Each shard is locked while its games are visited, so
+   * `cb` must not access the table.
+   */
+  template <class CallbackFn>
+  bool forEachGame(CallbackFn cb) const {
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.lock);
+      for (const auto& [key, entry] : shard.table) {
+        Game<NPawns> game = key.toGame();
+        game.setTableEntry(entry);
+        if (!cb(game)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  struct alignas(cache_line_size) Shard {
+    mutable std::mutex lock;
+    TableT table;
+  };
+
+  static constexpr uint32_t shardIdx(std::size_t hash) {
+    // The tables of shards place keys by the lower bits of their hashes, so
+    // select the shard with the upper bits.
+    return static_cast<uint32_t>(hash >> (64 - shard_bits));
+  }
+
+ private:
+  std::array<Shard, n_shards> shards_;
+};
+
+}  // namespace onoro
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <absl/types/optional.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "game_hash.h"
+#include "game_key.h"
+#include "game_view.h"
+#include "page_buffer.h"
+
+namespace onoro {
+
+/*
+ * A transposition table with a fixed memory budget, which is safe to share
+ * between search threads.
+ *
+ * Unlike TranspositionTable, this table never stores whole games. Each entry
+ * holds only its packed score, bound and best move, and the 64-bit hash of the
+ * GameKey of the game it was inserted under, so two games with colliding
+ * hashes will share an entry. Entries are grouped into cache line
+ * sized buckets, and a game may only be placed in one of the entries of the
+ * bucket selected by its key. When all entries of a bucket are taken, the least
+ * valuable entry is replaced, preferring to evict entries from older searches
+ * and entries with shallower scores.
+ *
+ * Entries are updated without locks: each entry stores its key xor'ed with its
+ * data alongside the data, so an entry read while another thread was halfway
+ * through writing it will fail verification and be treated as a miss.
+ *
+ * The buckets are mapped straight from the kernel, so large tables can be
+ * backed by huge pages and spread across NUMA nodes, see PageBuffer.
+ */
+template <uint32_t NPawns>
+class FixedTranspositionTable {
+  static constexpr uint32_t cache_line_size = 64;
+
+  struct Entry {
+    // The key of the entry xor'ed with data.
+    std::atomic<uint64_t> key_xor_data;
+    std::atomic<uint64_t> data;
+  };
+
+  static constexpr uint32_t entries_per_bucket =
+      cache_line_size / sizeof(Entry);
+
+  struct alignas(cache_line_size) Bucket {
+    Entry entries[entries_per_bucket];
+  };
+
+  static_assert(sizeof(Bucket) == cache_line_size);
+
+  /*
+   * Layout of the data word of an entry:
+   *  [0, 24): the packed score.
+   *  [24, 32): the depth of the score, used for replacement decisions.
+   *  [32, 40): the generation of the search that last wrote the entry.
+   *  [40, 42): the bound of the score.
+   *  [42, 63): the packed best move.
+   *  63: set for all entries which have been written to.
+   */
+  static constexpr uint32_t depth_shift = Score::packed_bits;
+  static constexpr uint32_t generation_shift = depth_shift + 8;
+  static constexpr uint32_t bound_shift = generation_shift + 8;
+  static constexpr uint32_t move_shift = bound_shift + 2;
+  static constexpr uint64_t valid_bit = UINT64_C(1) << 63;
+
+  static_assert(move_shift + TableMove::packed_bits <= 63);
+
+  static constexpr uint32_t max_depth = 0xff;
+
+ public:
+  /*
+   * Constructs a table using at most `size_mb` megabytes of memory. The number
+   * of buckets is rounded down to a power of two.
+   *
+   * The buckets are first touched from `n_touch_threads` threads, each taking
+   * an equal slice of the table. Without an interleave policy, each page is
+   * placed on the NUMA node of the thread which first touches it, so on
+   * machines with several nodes the touch threads are pinned to the nodes in
+   * turn, with at least one thread per node, which spreads the table evenly
+   * across them.
+   */
+  explicit FixedTranspositionTable(std::size_t size_mb,
+                                   const PageBufferOptions& page_opts = {},
+                                   uint32_t n_touch_threads = 1)
+      : n_buckets_(calcNBuckets(size_mb)),
+        bucket_shift_(64 - log2(n_buckets_)),
+        pages_(PageBuffer::allocate(n_buckets_ * sizeof(Bucket), page_opts)),
+        buckets_(static_cast<Bucket*>(pages_.data())),
+        generation_(0) {
+    initBuckets(n_touch_threads);
+  }
+
+  FixedTranspositionTable(const FixedTranspositionTable&) = delete;
+  FixedTranspositionTable& operator=(const FixedTranspositionTable&) = delete;
+
+  absl::optional<onoro::Score> find(const onoro::Game<NPawns>& game) const {
+    absl::optional<onoro::TableEntry> entry =
+        probe(GameKey<NPawns>(game).hash64());
+    if (entry.has_value()) {
+      return entry->score;
+    }
+    return {};
+  }
+
+  absl::optional<onoro::TableEntry> findEntry(
+      const onoro::Game<NPawns>& game) const {
+    return probe(GameKey<NPawns>(game).hash64());
+  }
+
+  /*
+   * Clears the table. This is not safe to call while other threads are
+   * accessing the table.
+   */
+  void clear() {
+    for (std::size_t i = 0; i < n_buckets_; i++) {
+      for (Entry& entry : buckets_[i].entries) {
+        entry.key_xor_data.store(0, std::memory_order_relaxed);
+        entry.data.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*
+   * Marks the start of a new search. Entries written by previous searches are
+   * preferred for replacement over entries written by this search.
+   */
+  void newSearch() {
+    generation_.store(
+        static_cast<uint8_t>(generation_.load(std::memory_order_relaxed) + 1),
+        std::memory_order_relaxed);
+  }
+
+  void insert(const onoro::Game<NPawns>& game) {
+    insert_or_assign(game);
+  }
+
+  void insert_or_assign(const onoro::Game<NPawns>& game) {
+    uint64_t key = GameKey<NPawns>(game).hash64();
+    TableEntry table_entry = game.getTableEntry();
+    Score score = table_entry.score;
+    uint8_t generation = generation_.load(std::memory_order_relaxed);
+    uint64_t data =
+        valid_bit | score.packed() |
+        (static_cast<uint64_t>(scoreDepth(score)) << depth_shift) |
+        (static_cast<uint64_t>(generation) << generation_shift) |
+        (static_cast<uint64_t>(table_entry.bound) << bound_shift) |
+        (static_cast<uint64_t>(table_entry.best_move.packed()) << move_shift);
+
+    Bucket& bucket = buckets_[bucketIdx(key)];
+    Entry* victim = nullptr;
+    int32_t victim_value = INT32_MAX;
+
+    for (Entry& entry : bucket.entries) {
+      uint64_t entry_data = entry.data.load(std::memory_order_relaxed);
+      uint64_t entry_key =
+          entry.key_xor_data.load(std::memory_order_relaxed) ^ entry_data;
+
+      if ((entry_data & valid_bit) == 0 || entry_key == key) {
+        victim = &entry;
+        break;
+      }
+
+      // Entries from older searches lose value with each new search.
+      uint8_t age =
+          generation - static_cast<uint8_t>(entry_data >> generation_shift);
+      int32_t value = static_cast<int32_t>((entry_data >> depth_shift) & 0xff) -
+                      8 * static_cast<int32_t>(age);
+      if (value < victim_value) {
+        victim = &entry;
+        victim_value = value;
+      }
+    }
+
+    victim->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+  }
+
+  /*
+   * Returns the number of occupied entries in the table. This scans the whole
+   * table, and is only a snapshot if other threads are concurrently inserting
+   * into the table.
+   */
+  std::size_t size() const {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < n_buckets_; i++) {
+      for (const Entry& entry : buckets_[i].entries) {
+        if ((entry.data.load(std::memory_order_relaxed) & valid_bit) != 0) {
+          size++;
+        }
+      }
+    }
+    return size;
+  }
+
+  /*
+   * The total number of entries the table can hold.
+   */
+  std::size_t capacity() const {
+    return n_buckets_ * entries_per_bucket;
+  }
+
+  // The number of bytes of the table backed by huge pages.
+  std::size_t hugePageBytes() const {
+    return pages_.hugePageBytes();
+  }
+
+  // The number of bytes of memory used by the table.
+  std::size_t bytes() const {
+    return pages_.size();
+  }
+
+  // True if the table is interleaved across NUMA nodes.
+  bool interleaved() const {
+    return pages_.interleaved();
+  }
+
+ private:
+  static constexpr uint32_t log2(std::size_t n) {
+    uint32_t l = 0;
+    while (n > 1) {
+      n >>= 1;
+      l++;
+    }
+    return l;
+  }
+
+  // Constructs the buckets of the table, from `n_threads` threads. Unless the
+  // table is interleaved, touch thread t is pinned to the CPUs of NUMA node
+  // t % n_nodes, so the pages of its slice are placed on that node.
+  void initBuckets(uint32_t n_threads) {
+    auto init_range = [this](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; i++) {
+        new (&buckets_[i]) Bucket();
+        for (Entry& entry : buckets_[i].entries) {
+          entry.key_xor_data.store(0, std::memory_order_relaxed);
+          entry.data.store(0, std::memory_order_relaxed);
+        }
+      }
+    };
+
+    std::vector<cpu_set_t> node_cpus;
+    if (!pages_.interleaved()) {
+      node_cpus = numaNodeCpus();
+    }
+    // With a single node, every page lands on it wherever it is touched from.
+    if (node_cpus.size() < 2) {
+      node_cpus.clear();
+    }
+    n_threads = std::max<uint32_t>({ n_threads, 1u,
+                                     static_cast<uint32_t>(node_cpus.size()) });
+
+    auto init_slice = [this, n_threads, &node_cpus, &init_range](uint32_t t) {
+      if (!node_cpus.empty()) {
+        // Placement is best effort, so the slice is touched from wherever the
+        // thread runs if it can't be pinned.
+        const cpu_set_t& cpus = node_cpus[t % node_cpus.size()];
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+      }
+      init_range(n_buckets_ * t / n_threads, n_buckets_ * (t + 1) / n_threads);
+    };
+
+    // The calling thread touches the first slice itself, unless the slices are
+    // pinned, which would change the affinity of the caller.
+    bool pin = !node_cpus.empty();
+    std::vector<std::thread> threads;
+    for (uint32_t t = pin ? 0 : 1; t < n_threads; t++) {
+      threads.emplace_back(init_slice, t);
+    }
+    if (!pin) {
+      init_slice(0);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  static constexpr std::size_t calcNBuckets(std::size_t size_mb) {
+    std::size_t n_buckets = (size_mb << 20) / sizeof(Bucket);
+    // Always allocate at least two buckets, so bucket_shift_ is less than 64.
+    return std::size_t(1) << std::max(log2(n_buckets), 1u);
+  }
+
+  /*
+   * How valuable a score is to keep in the table. Scores which have found a
+   * win are valid for all deeper searches, so they are the most valuable.
+   */
+  static constexpr uint32_t scoreDepth(Score score) {
+    if (score.turn_count_win() != 0) {
+      return max_depth;
+    }
+    return std::min(score.turn_count_tie(), max_depth - 1);
+  }
+
+  std::size_t bucketIdx(uint64_t key) const {
+    // Keys are already mixed, so their top bits are as good as any.
+    return key >> bucket_shift_;
+  }
+
+  absl::optional<onoro::TableEntry> probe(uint64_t key) const {
+    const Bucket& bucket = buckets_[bucketIdx(key)];
+
+    for (const Entry& entry : bucket.entries) {
+      uint64_t entry_data = entry.data.load(std::memory_order_relaxed);
+      uint64_t entry_key =
+          entry.key_xor_data.load(std::memory_order_relaxed) ^ entry_data;
+
+      if ((entry_data & valid_bit) != 0 && entry_key == key) {
+        return TableEntry{
+          Score::fromPacked(static_cast<uint32_t>(
+              entry_data & ((UINT64_C(1) << Score::packed_bits) - 1))),
+          static_cast<ScoreBound>((entry_data >> bound_shift) & 0x3),
+          TableMove::fromPacked(
+              static_cast<uint32_t>(entry_data >> move_shift)),
+        };
+      }
+    }
+
+    return {};
+  }
+
+ private:
+  const std::size_t n_buckets_;
+  // Shift applied to a key to select its bucket.
+  const uint32_t bucket_shift_;
+  PageBuffer pages_;
+  Bucket* buckets_;
+  std::atomic<uint8_t> generation_;
+};
+
+}  // namespace onoro
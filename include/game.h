@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -9,12 +10,19 @@
 
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
+#include "absl/types/optional.h"
+#include "bitboard.h"
 #include "game_state.pb.h"
 #include "hash_group.h"
 #include "hex_pos.h"
+#include "move_list.h"
 #include "union_find.h"
 #include "utils/fun/print_colors.h"
 
+#ifdef AVX_SUPPORTED
+#include <immintrin.h>
+#endif
+
 namespace onoro {
 
 using namespace hash_group;
@@ -55,6 +63,11 @@ class idx_t {
     return *this;
   }
 
+  // Returns the offset which undoes adding this offset to an idx_t.
+  constexpr idx_t operator-() const {
+    return idx_t(static_cast<uint8_t>(-_bytes));
+  }
+
   constexpr bool operator==(idx_t other) const {
     return _bytes == other._bytes;
   }
@@ -169,6 +182,23 @@ class [[gnu::packed]] Score {
     }
   }
 
+  /*
+   * Packs the score into the lower `packed_bits` bits of an integer, which can
+   * be unpacked with fromPacked().
+   */
+  constexpr uint32_t packed() const {
+    return static_cast<uint32_t>(turn_count_win_) |
+           (static_cast<uint32_t>(turn_count_tie_) << 12) |
+           (static_cast<uint32_t>(score_) << 23);
+  }
+
+  static constexpr Score fromPacked(uint32_t packed) {
+    return Score((packed >> 23) & 0x1u, (packed >> 12) & 0x7ffu,
+                 packed & 0xfffu);
+  }
+
+  static constexpr uint32_t packed_bits = 24;
+
   constexpr uint32_t turn_count_win() const {
     return static_cast<uint32_t>(turn_count_win_);
   }
@@ -177,6 +207,14 @@ class [[gnu::packed]] Score {
     return static_cast<uint32_t>(turn_count_tie_);
   }
 
+  /*
+   * True if the current player can force a win within turn_count_win()
+   * moves.
+   */
+  constexpr bool curPlayerWins() const {
+    return turn_count_win_ != 0 && score_ == 1;
+  }
+
   /*
    * Transforms a score at a given state of the game to how that score would
    * appear from the perspective of a game state one step before it.
@@ -306,10 +344,117 @@ class [[gnu::packed]] Score {
   uint32_t score_ : 1;
 };
 
+/*
+ * Whether a score stored in a transposition table is the true score of the
+ * game, or only a bound on it found by a search which was cut off early.
+ */
+enum class ScoreBound : uint8_t {
+  BOUND_EXACT = 0,
+  // The true score is at least as good as the stored score.
+  BOUND_LOWER = 1,
+  // The true score is at most as good as the stored score.
+  BOUND_UPPER = 2,
+};
+
+/*
+ * A move stored in a transposition table. The tiles of the move are stored
+ * relative to the origin tile of the game the move was made from, in the frame
+ * of the game's key (see GameKey::canonicalFrame). Every game equivalent under
+ * symmetries shares that frame, so the move can be found again from any of
+ * them, which is how tables keyed by GameKey share one entry between them.
+ *
+ * Only the offsets of tiles from the origin are stored, so this doesn't depend
+ * on NPawns. Offsets are in the range [-16, 15].
+ */
+class [[gnu::packed]] TableMove {
+  static constexpr uint32_t coord_bits = 5;
+  static constexpr uint32_t coord_mask = (1u << coord_bits) - 1;
+  static constexpr uint32_t coord_bias = 1u << (coord_bits - 1);
+  static constexpr uint32_t valid_bit = 1u << (4 * coord_bits);
+
+ public:
+  /*
+   * Constructs an empty move.
+   */
+  constexpr TableMove() : data_(0) {}
+
+  /*
+   * Constructs a move to the tile `to` from the tile `from`, both relative to
+   * the origin tile. Phase 1 moves have no `from` tile, and should pass the
+   * origin.
+   */
+  constexpr TableMove(HexPos to, HexPos from)
+      : data_(valid_bit | packCoord(to.x, 0) | packCoord(to.y, 1) |
+              packCoord(from.x, 2) | packCoord(from.y, 3)) {}
+
+  constexpr bool operator==(const TableMove& other) const {
+    return data_ == other.data_;
+  }
+
+  static constexpr TableMove none() {
+    return TableMove();
+  }
+
+  constexpr bool has_value() const {
+    return (data_ & valid_bit) != 0;
+  }
+
+  constexpr HexPos to() const {
+    return { unpackCoord(0), unpackCoord(1) };
+  }
+
+  constexpr HexPos from() const {
+    return { unpackCoord(2), unpackCoord(3) };
+  }
+
+  /*
+   * Packs the move into the lower `packed_bits` bits of an integer, which can
+   * be unpacked with fromPacked().
+   */
+  constexpr uint32_t packed() const {
+    return data_;
+  }
+
+  static constexpr TableMove fromPacked(uint32_t packed) {
+    TableMove move;
+    move.data_ = packed & ((1u << packed_bits) - 1);
+    return move;
+  }
+
+  static constexpr uint32_t packed_bits = 4 * coord_bits + 1;
+
+ private:
+  static constexpr uint32_t packCoord(int32_t c, uint32_t i) {
+    return ((static_cast<uint32_t>(c) + coord_bias) & coord_mask)
+           << (i * coord_bits);
+  }
+
+  constexpr int32_t unpackCoord(uint32_t i) const {
+    return static_cast<int32_t>((data_ >> (i * coord_bits)) & coord_mask) -
+           static_cast<int32_t>(coord_bias);
+  }
+
+  uint32_t data_ : packed_bits;
+};
+
+/*
+ * Everything a transposition table knows about a game: its score, whether that
+ * score is exact or a bound, and the best move found from the game.
+ */
+struct TableEntry {
+  Score score;
+  ScoreBound bound;
+  TableMove best_move;
+};
+
 // Forward declare GameHash
 template <uint32_t NPawns>
 class GameHash;
 
+// Forward declare GameKey, which defines the frame of table moves.
+template <uint32_t NPawns>
+class GameKey;
+
 // Forward declare GameEq
 template <uint32_t NPawns>
 class GameEq;
@@ -324,6 +469,29 @@ struct P1Move {
     return g.forEachMove(cb);
   }
 
+  template <uint32_t NPawns, typename Hash>
+  static absl::optional<P1Move> findWinningMoveFn(
+      const Game<NPawns, Hash>& g) {
+    return g.findWinningMove();
+  }
+
+  template <uint32_t NPawns, typename Hash>
+  static absl::optional<P1Move> findTableMoveFn(const Game<NPawns, Hash>& g,
+                                                TableMove move) {
+    return g.findTableMove(move);
+  }
+
+  // An upper bound on the number of moves from any position, since each empty
+  // tile can be played on at most once.
+  template <uint32_t NPawns>
+  static constexpr uint32_t maxMoves() {
+    return NPawns * NPawns;
+  }
+
+  constexpr bool operator==(const P1Move& other) const {
+    return loc == other.loc;
+  }
+
   // Position to play pawn at.
   idx_t loc;
 };
@@ -335,6 +503,29 @@ struct P2Move {
     return g.forEachMoveP2(cb);
   }
 
+  template <uint32_t NPawns, typename Hash>
+  static absl::optional<P2Move> findWinningMoveFn(
+      const Game<NPawns, Hash>& g) {
+    return g.findWinningMoveP2();
+  }
+
+  template <uint32_t NPawns, typename Hash>
+  static absl::optional<P2Move> findTableMoveFn(const Game<NPawns, Hash>& g,
+                                                TableMove move) {
+    return g.findTableMoveP2(move);
+  }
+
+  // An upper bound on the number of moves from any position, since each of
+  // the current player's pawns can move to at most every empty tile.
+  template <uint32_t NPawns>
+  static constexpr uint32_t maxMoves() {
+    return (NPawns + 1) / 2 * (NPawns * NPawns - NPawns);
+  }
+
+  constexpr bool operator==(const P2Move& other) const {
+    return to == other.to && from_idx == other.from_idx;
+  }
+
   // Position to move pawn to.
   idx_t to;
   // Position in pawn_poses array to move pawn from.
@@ -378,6 +569,34 @@ class Game {
     HexPos center_offset;
   };
 
+  /*
+   * The key of the canonical view of a game, which is the view with the
+   * smallest hash over all group operations of the game's symmetry class and
+   * color inversions. All games which are equivalent under symmetries share
+   * the same canonical key hash, so they can be found with a single lookup.
+   * The hash doesn't identify the game: inequivalent games may share it, and
+   * several views of a game may tie on it, so games are told apart by their
+   * GameKey.
+   */
+  struct CanonicalKey {
+    // The hash of the game with the canonical view applied.
+    hash_group::game_hash_t hash;
+
+    // Ordinal of the group operation of the canonical view, in the group of
+    // the game's symmetry class.
+    uint8_t op_ordinal;
+
+    bool color_invert;
+  };
+
+  /*
+   * A list large enough to hold every move of type MoveClass from any
+   * position.
+   */
+  template <class MoveClass>
+  using move_list_t =
+      MoveList<MoveClass, MoveClass::template maxMoves<NPawns>()>;
+
   class pawn_iterator {
     friend class Game<NPawns, Hash>;
 
@@ -465,14 +684,20 @@ class Game {
  private:
   struct GameState {
     // You can play this game with a max of 8 pawns, and turn count stops
-    // incrementing after the end of phase 1
-    uint8_t turn       : 4;
-    uint8_t blackTurn  : 1;
-    uint8_t finished   : 1;
-    uint8_t hashed     : 1;
-    uint8_t __reserved : 1;
+    // incrementing after the end of phase 1. symm_cached is set when
+    // symm_state_ holds the symmetry state of the board.
+    uint8_t turn        : 4;
+    uint8_t blackTurn   : 1;
+    uint8_t finished    : 1;
+    uint8_t hashed      : 1;
+    uint8_t symm_cached : 1;
   };
 
+ public:
+  // A set of tiles on the board, indexed by idxOrd().
+  typedef Bitboard<NPawns * NPawns> board_t;
+
+ private:
   // bits per entry in the board
   static constexpr uint32_t bits_per_uint64 = 64;
   static constexpr uint32_t bits_per_tile = 2;
@@ -579,6 +804,28 @@ class Game {
     uint8_t data_;
   };
 
+ public:
+  /*
+   * The information needed to undo a move made in place with makeMove().
+   */
+  struct UndoRecord {
+    // The offset all pawns were shifted by after making the move.
+    idx_t offset;
+
+    // For phase 2 moves, the tile the moved pawn was taken from.
+    idx_t from;
+
+    GameState state;
+    HexPos16 sum_of_mass;
+    std::size_t hash;
+    BoardSymmStateData symm_state;
+
+    // Searches store the entry of each child on the game they make moves on,
+    // so the entry of the parent is restored along with the rest of its state.
+    TableEntry table_entry;
+  };
+
+ private:
   // Returns the width of the game board. This is also the upper bound on the
   // x/y values in idx_t.
   static constexpr uint32_t getBoardWidth();
@@ -629,6 +876,17 @@ class Game {
   // Phase 2: move a pawn from somewhere to somewhere else
   Game(const Game&, P2Move move);
 
+  /*
+   * Makes a move on this game in place, returning the record needed to undo
+   * it. Moves must be undone in the reverse order they were made, with the
+   * same move that was passed to makeMove().
+   */
+  UndoRecord makeMove(P1Move move);
+  UndoRecord makeMove(P2Move move);
+
+  void unmakeMove(P1Move move, const UndoRecord& undo);
+  void unmakeMove(P2Move move, const UndoRecord& undo);
+
   std::string Print() const;
   std::string PrintDiff(const Game<NPawns, Hash>& other) const;
   std::string Print2() const;
@@ -636,6 +894,30 @@ class Game {
 
   static absl::StatusOr<Game> LoadState(const onoro::proto::GameState& state);
 
+  /*
+   * The number of bytes of a packed game: the byte of the idx_t of each pawn,
+   * in the order of pawn_poses_, followed by a byte holding the turn number in
+   * bits [0, 4), whether it's black's turn in bit 4 and whether the game is
+   * finished in bit 5. Pawns which haven't been placed have the null idx.
+   */
+  static constexpr std::size_t packed_size = NPawns + 1;
+
+  /*
+   * Writes the packed game to `buf`, which must hold packed_size bytes. Unlike
+   * SerializeState, this is a copy of the internal state of the game, so it is
+   * cheap enough to pack games in bulk, but packed games can only be unpacked
+   * by games with the same number of pawns.
+   */
+  void PackState(uint8_t* buf) const;
+
+  /*
+   * Loads a game packed with PackState from the packed_size bytes at `buf`,
+   * returning an error if the pawns aren't on distinct tiles of the board or
+   * the turn is inconsistent with the number of pawns. Like LoadState, this
+   * doesn't check that the pawns are connected.
+   */
+  static absl::StatusOr<Game> UnpackState(const uint8_t* buf);
+
   bool validate() const;
 
   static void printSymmStateTableOps(uint32_t n_reps = 1);
@@ -652,9 +934,36 @@ class Game {
    */
   bool checkWin(idx_t last_move) const;
 
+  // Portable implementation of checkWin, checking one pawn at a time.
+  bool checkWinScalar(idx_t last_move) const;
+
+#ifdef AVX_SUPPORTED
+  /*
+   * Vectorized implementation of checkWin, checking all pawns at once. Only
+   * pawns within n_in_row_to_win - 1 tiles of last_move are considered, since
+   * those are the only pawns which can be in a line completed by last_move.
+   */
+  bool checkWinAVX(idx_t last_move) const;
+#endif
+
   // Shifts all pawns of game by the given offset
   constexpr void shiftTiles(idx_t offset);
 
+  /*
+   * Derives the hash of this game from the hash of the parent game described
+   * by `undo`, which this game was made from by placing a pawn of color
+   * `black` at `to`, possibly removing it from `from`, and then shifting all
+   * pawns by `hex_offset`. Both `to` and `from` are given in the coordinates
+   * of this game.
+   *
+   * This is only possible if the parent's hash is already known and the move
+   * didn't change the board symmetry state or the origin tile, since then
+   * every other pawn hashes to the same value as it did in the parent. If not,
+   * the hash is left to be calculated lazily.
+   */
+  void deriveHash(const UndoRecord& undo, HexPos hex_offset, bool black,
+                  HexPos to, bool has_from, HexPos from);
+
   /*
    * The purpose of the symmetry table is to provide a quick way to canonicalize
    * boards when computing and checking for symmetries. Since the center of mass
@@ -785,6 +1094,56 @@ class Game {
   static constexpr std::array<BoardSymmStateData, getSymmStateTableSize()>
       symm_state_table = genSymmStateTable();
 
+  /*
+   * Offsets of tiles from the origin tile lie in [-max_origin_offset,
+   * max_origin_offset] in both coordinates. Tiles lie on the board, or one tile
+   * off of it for the tile a pawn moved from when the board is shifted after a
+   * move, and origin tiles lie on the board or one tile past its top right
+   * edge.
+   */
+  static constexpr int32_t max_origin_offset = NPawns + 1;
+
+  // An offset from the origin tile, as stored in the offset table.
+  struct PackedOffset {
+    int8_t x;
+    int8_t y;
+  };
+
+  static constexpr uint32_t getOffsetTableWidth();
+
+  // Returns the number of entries of the offset table for each D6 op.
+  static constexpr uint32_t getOffsetTableSize();
+
+  static constexpr uint32_t offsetTableIdx(HexPos offset, D6 op);
+
+  static constexpr std::array<PackedOffset, D6::order() * getOffsetTableSize()>
+  genOffsetTable() {
+    constexpr int32_t R = max_origin_offset;
+
+    std::array<PackedOffset, D6::order() * getOffsetTableSize()> table{};
+    for (uint32_t op_ord = 0; op_ord < D6::order(); op_ord++) {
+      for (int32_t y = -R; y <= R; y++) {
+        for (int32_t x = -R; x <= R; x++) {
+          HexPos p = HexPos{ x, y }.apply_d6_c(D6(op_ord));
+          table[offsetTableIdx({ x, y }, D6(op_ord))] = {
+            static_cast<int8_t>(p.x), static_cast<int8_t>(p.y)
+          };
+        }
+      }
+    }
+    return table;
+  }
+
+  /*
+   * The offset table maps each offset of a tile from the origin tile to the
+   * offset with each D6 op applied, so that symmetry ops in hashing and
+   * comparisons are a single lookup instead of branching on the op for every
+   * pawn. Transformed offsets are at most twice as large as offsets, so they
+   * fit in a byte.
+   */
+  static constexpr std::array<PackedOffset, D6::order() * getOffsetTableSize()>
+      offset_table = genOffsetTable();
+
   /*
    * Array of indexes of pawn positions. Odd entries (even index) are black
    * pawns, the others are white. Filled from lowest to highest index as the
@@ -799,11 +1158,26 @@ class Game {
    */
   Score score_;
 
+  // Optional: the bound and best move stored alongside score_ in tables.
+  ScoreBound bound_;
+  TableMove best_move_;
+
   // Sum of all HexPos's of pieces on the board
   HexPos16 sum_of_mass_;
 
+  /*
+   * The symmetry state of the board, valid when state_.symm_cached is set.
+   * This only depends on sum_of_mass_ modulo the number of pawns in play, so
+   * shifting the board after a move keeps it valid.
+   */
+  BoardSymmStateData symm_state_;
+
   std::size_t hash_;
 
+  // The tiles occupied by black and white pawns.
+  board_t black_board_;
+  board_t white_board_;
+
  public:
   // Returns an ordinal for the given index. Ordinals are a unique mapping from
   // idx_t to non-negative integers exactly covering the range [0,
@@ -816,6 +1190,15 @@ class Game {
 
   static constexpr idx_t posToIdx(HexPos pos);
 
+  /*
+   * Returns offset.apply_d6_c(op) for the offset of a tile on the board from
+   * an origin tile, looked up in the offset table.
+   */
+  static constexpr HexPos transformOffset(HexPos offset, D6 op);
+
+  // Returns t.apply(offset) for the offset of a tile from an origin tile.
+  static constexpr HexPos transformOffset(HexPos offset, const HexTransform& t);
+
   uint32_t nPawnsInPlay() const;
 
   bool blackTurn() const;
@@ -824,6 +1207,8 @@ class Game {
 
   std::size_t hash() const;
 
+  CanonicalKey canonicalKey() const;
+
   TileState getTile(idx_t idx) const;
 
   // Returns the idx_t for the pawn at position i in pawn_poses_
@@ -848,6 +1233,29 @@ class Game {
   template <class CallbackFnT>
   bool forEachMoveP2(CallbackFnT cb) const;
 
+  /*
+   * Fills `moves` with every move from this position, in the same order the
+   * moves are visited by forEachMove/forEachMoveP2.
+   */
+  void generateMoves(move_list_t<P1Move>& moves) const;
+  void generateMoves(move_list_t<P2Move>& moves) const;
+
+  /*
+   * Returns a move which immediately wins the game for the current player, if
+   * there is one, without constructing the games following each move.
+   */
+  absl::optional<P1Move> findWinningMove() const;
+
+  absl::optional<P2Move> findWinningMoveP2() const;
+
+  /*
+   * Returns the empty tiles which would give the current player a line of
+   * n_in_row_to_win - 1 pawns, with an empty tile left to complete it, if
+   * they placed a pawn there. Phase 2 moves to these tiles may not create a
+   * threat if the moved pawn was part of the line.
+   */
+  board_t calcThreatTiles() const;
+
   Score getScore() const;
 
   /*
@@ -856,8 +1264,35 @@ class Game {
    */
   void setScore(Score score) const;
 
+  TableEntry getTableEntry() const;
+
+  // Like setScore, this only sets auxiliary fields.
+  void setTableEntry(const TableEntry& entry) const;
+
+  /*
+   * Converts a move from this position to a TableMove, which can be found
+   * again with findTableMove/findTableMoveP2 from any game equivalent to this
+   * one under symmetries and color inversions.
+   */
+  TableMove tableMove(P1Move move) const;
+  TableMove tableMove(P2Move move) const;
+
+  /*
+   * Returns the move from this position that `move` refers to, if its tiles
+   * are on the board and, in phase 2, the current player has a pawn on the
+   * tile it moves from. The returned move is not guaranteed to be legal.
+   */
+  absl::optional<P1Move> findTableMove(TableMove move) const;
+
+  absl::optional<P2Move> findTableMoveP2(TableMove move) const;
+
   BoardSymmetryState calcSymmetryState() const;
 
+  // Returns the symmetry state of a board with the given sum of mass and
+  // number of pawns in play.
+  static BoardSymmetryState calcSymmetryState(HexPos16 sum_of_mass,
+                                              uint32_t n_pawns);
+
   /*
    * Gives the chosen origin tile for the board given the BoardSymmetryState.
    * The origin is guaranteed to be the same tile for equivalent boards under
@@ -865,6 +1300,9 @@ class Game {
    */
   constexpr HexPos originTile(const BoardSymmetryState& state) const;
 
+  static constexpr HexPos originTile(HexPos16 sum_of_mass, uint32_t n_pawns,
+                                     const BoardSymmetryState& state);
+
   /*
    * Iterators over the pawns.
    */
@@ -890,6 +1328,94 @@ class Game {
    */
   template <class CallbackFnT>
   bool forEachPlayerPawn(bool black, CallbackFnT cb) const;
+
+ private:
+  template <class SymmetryClassOp>
+  CanonicalKey calcCanonicalKey() const;
+
+  /*
+   * Returns the empty tiles which are adjacent to at least
+   * min_neighbors_per_pawn pawns, which are the tiles a pawn may be placed on
+   * in phase 1.
+   */
+  board_t calcP1MoveTiles() const;
+
+  /*
+   * Returns the empty tiles which would complete n_in_row_to_win pawns in a
+   * row of the pawns in `board` if a pawn were placed there.
+   */
+  board_t calcLineCompletions(const board_t& board) const;
+
+  /*
+   * Returns the tiles whose x coordinate is still on the board after adding
+   * `dx` to it, for -3 <= dx <= 3.
+   */
+  static constexpr board_t genColumnMask(int32_t dx);
+
+  static constexpr std::array<board_t, 7> column_masks = {
+    genColumnMask(-3), genColumnMask(-2), genColumnMask(-1), genColumnMask(0),
+    genColumnMask(1),  genColumnMask(2),  genColumnMask(3),
+  };
+
+  /*
+   * The connected components the pawns on the board split into when any one
+   * pawn is removed, found with a single articulation point pass over the
+   * graph of adjacent pawns.
+   *
+   * The groups the remaining pawns split into after removing a pawn are
+   * identified by bits of a bitmask: a connected component of the board not
+   * containing the removed pawn, a subtree of the depth first search tree
+   * below the removed pawn which the removal cuts off, or everything else left
+   * in the removed pawn's component.
+   */
+  class PawnGraphCuts {
+   public:
+    explicit PawnGraphCuts(const Game& game);
+
+    // Returns the pawn index of the pawn at idx, or no_pawn if the tile is
+    // empty.
+    uint32_t pawnAt(idx_t idx) const;
+
+    // Returns the bitmask of all groups the pawns split into after removing
+    // pawn `removed`.
+    uint32_t groupsWithout(uint32_t removed) const;
+
+    // Returns the bit of the group pawn `pawn` is in after removing pawn
+    // `removed`.
+    uint32_t groupWithout(uint32_t pawn, uint32_t removed) const;
+
+    static constexpr uint8_t no_pawn = 0xff;
+
+   private:
+    static constexpr uint32_t max_neighbors = 6;
+
+    void dfs(uint32_t pawn, uint32_t parent);
+
+    // Indexed by idx_t bytes, the pawn index of the pawn on each tile.
+    uint8_t pawn_at_[256];
+
+    uint8_t n_neighbors_[NPawns];
+    uint8_t neighbors_[NPawns][max_neighbors];
+
+    // The connected component of the board each pawn is in.
+    uint8_t component_[NPawns];
+    uint32_t n_components_;
+
+    // Depth first search discovery times, lowest discovery time reachable
+    // from each subtree, and the end of each subtree's discovery times.
+    uint8_t disc_[NPawns];
+    uint8_t low_[NPawns];
+    uint8_t end_[NPawns];
+    uint32_t time_;
+
+    // The children of each pawn in the search tree whose subtrees are cut off
+    // from the rest of the component when the pawn is removed.
+    uint8_t n_cut_children_[NPawns];
+    uint8_t cut_children_[NPawns][max_neighbors];
+
+    // True for the pawns each depth first search started from.
+    bool is_root_[NPawns];
+  };
 };
 
 template <uint32_t NPawns, typename Hash>
@@ -912,6 +1438,24 @@ constexpr uint32_t Game<NPawns, Hash>::getSymmStateTableSize() {
   return getSymmStateTableWidth() * getSymmStateTableWidth();
 }
 
+template <uint32_t NPawns, typename Hash>
+constexpr uint32_t Game<NPawns, Hash>::getOffsetTableWidth() {
+  return 2 * max_origin_offset + 1;
+}
+
+template <uint32_t NPawns, typename Hash>
+constexpr uint32_t Game<NPawns, Hash>::getOffsetTableSize() {
+  return getOffsetTableWidth() * getOffsetTableWidth();
+}
+
+template <uint32_t NPawns, typename Hash>
+constexpr uint32_t Game<NPawns, Hash>::offsetTableIdx(HexPos offset, D6 op) {
+  return op.ordinal() * getOffsetTableSize() +
+         static_cast<uint32_t>(offset.y + max_origin_offset) *
+             getOffsetTableWidth() +
+         static_cast<uint32_t>(offset.x + max_origin_offset);
+}
+
 template <uint32_t NPawns, typename Hash>
 constexpr D6 Game<NPawns, Hash>::symmStateOp(uint32_t x, uint32_t y,
                                              uint32_t n_pawns) {
@@ -1026,7 +1570,9 @@ constexpr std::pair<idx_t, HexPos> Game<NPawns, Hash>::calcMoveShift(
 // white is effectively first to make a choice.
 template <uint32_t NPawns, typename Hash>
 Game<NPawns, Hash>::Game()
-    : state_({ 0xfu, 1, 0, 0, 0 }), sum_of_mass_{ 0, 0 } {
+    : state_({ 0xfu, 1, 0, 0, 0 }),
+      bound_(ScoreBound::BOUND_EXACT),
+      sum_of_mass_{ 0, 0 } {
   static_assert(NPawns <= 2 * max_pawns_per_player);
 
   for (uint32_t i = 0; i < NPawns; i++) {
@@ -1062,30 +1608,115 @@ Game<NPawns, Hash>::Game()
 
 template <uint32_t NPawns, typename Hash>
 Game<NPawns, Hash>::Game(const Game<NPawns, Hash>& g, P1Move move)
-    : pawn_poses_(g.pawn_poses_),
-      state_(g.state_),
-      sum_of_mass_(g.sum_of_mass_) {
+    : Game(g) {
+  makeMove(move);
+}
+
+template <uint32_t NPawns, typename Hash>
+Game<NPawns, Hash>::Game(const Game& g, P2Move move) : Game(g) {
+  makeMove(move);
+}
+
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::UndoRecord Game<NPawns, Hash>::makeMove(
+    P1Move move) {
+  UndoRecord undo = { idx_t(0, 0), idx_t::null_idx(), state_, sum_of_mass_,
+                      hash_, symm_state_, getTableEntry() };
+
   appendTile(move.loc);
 
   auto [offset, hex_offset] = calcMoveShift(move.loc);
   shiftTiles(offset);
   sum_of_mass_ += static_cast<HexPos16>(nPawnsInPlay() * hex_offset);
+  undo.offset = offset;
 
   state_.finished = checkWin(move.loc + offset);
+
+  deriveHash(undo, hex_offset, !(state_.turn & 1), idxToPos(move.loc + offset),
+             false, HexPos{ 0, 0 });
+  return undo;
 }
 
 template <uint32_t NPawns, typename Hash>
-Game<NPawns, Hash>::Game(const Game& g, P2Move move)
-    : pawn_poses_(g.pawn_poses_),
-      state_(g.state_),
-      sum_of_mass_(g.sum_of_mass_) {
+typename Game<NPawns, Hash>::UndoRecord Game<NPawns, Hash>::makeMove(
+    P2Move move) {
+  UndoRecord undo = { idx_t(0, 0), pawn_poses_[move.from_idx], state_,
+                      sum_of_mass_, hash_, symm_state_, getTableEntry() };
+
   moveTile(move.to, move.from_idx);
 
   auto [offset, hex_offset] = calcMoveShift(move.to);
   shiftTiles(offset);
   sum_of_mass_ += static_cast<HexPos16>(NPawns * hex_offset);
+  undo.offset = offset;
 
   state_.finished = checkWin(move.to + offset);
+
+  deriveHash(undo, hex_offset, !(move.from_idx & 1),
+             idxToPos(move.to + offset), true,
+             idxToPos(undo.from) + hex_offset);
+  return undo;
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::unmakeMove(P1Move move, const UndoRecord& undo) {
+  shiftTiles(-undo.offset);
+
+  board_t& board = (state_.turn & 1) ? white_board_ : black_board_;
+  board.clear(idxOrd(move.loc));
+  pawn_poses_[state_.turn] = idx_t::null_idx();
+
+  state_ = undo.state;
+  sum_of_mass_ = undo.sum_of_mass;
+  hash_ = undo.hash;
+  symm_state_ = undo.symm_state;
+  setTableEntry(undo.table_entry);
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::unmakeMove(P2Move move, const UndoRecord& undo) {
+  shiftTiles(-undo.offset);
+  moveTile(undo.from, move.from_idx);
+
+  state_ = undo.state;
+  sum_of_mass_ = undo.sum_of_mass;
+  hash_ = undo.hash;
+  symm_state_ = undo.symm_state;
+  setTableEntry(undo.table_entry);
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::deriveHash(const UndoRecord& undo, HexPos hex_offset,
+                                    bool black, HexPos to, bool has_from,
+                                    HexPos from) {
+  if (!undo.state.hashed) {
+    return;
+  }
+
+  uint32_t parent_n_pawns = undo.state.turn + 1;
+  BoardSymmetryState parent_state =
+      undo.state.symm_cached
+          ? undo.symm_state.parseSymmetryState()
+          : calcSymmetryState(undo.sum_of_mass, parent_n_pawns);
+  HexPos parent_origin =
+      originTile(undo.sum_of_mass, parent_n_pawns, parent_state);
+  BoardSymmetryState symm_state = calcSymmetryState();
+  HexPos origin = originTile(symm_state);
+
+  if (parent_state.symm_class != symm_state.symm_class ||
+      parent_state.op.ordinal() != symm_state.op.ordinal() ||
+      parent_origin + hex_offset != origin) {
+    return;
+  }
+
+  hash_group::game_hash_t h =
+      undo.hash ^ Hash::calcPawnHash(symm_state, origin, to, black);
+  if (has_from) {
+    h ^= Hash::calcPawnHash(symm_state, origin, from, black);
+  }
+
+  hash_ = h;
+  state_.hashed = 1;
 }
 
 template <uint32_t NPawns, typename Hash>
@@ -1259,6 +1890,74 @@ onoro::proto::GameState Game<NPawns, Hash>::SerializeState() const {
   return state;
 }
 
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::PackState(uint8_t* buf) const {
+  for (uint32_t i = 0; i < NPawns; i++) {
+    buf[i] = pawn_poses_[i].get_bytes();
+  }
+  buf[NPawns] = static_cast<uint8_t>(state_.turn | (state_.blackTurn << 4) |
+                                     (state_.finished << 5));
+}
+
+template <uint32_t NPawns, typename Hash>
+absl::StatusOr<Game<NPawns, Hash>> Game<NPawns, Hash>::UnpackState(
+    const uint8_t* buf) {
+  Game g;
+  g.state_.turn = buf[NPawns] & 0xfu;
+  g.state_.blackTurn = (buf[NPawns] >> 4) & 0x1u;
+  g.state_.finished = (buf[NPawns] >> 5) & 0x1u;
+  g.state_.hashed = 0;
+  g.state_.symm_cached = 0;
+  g.sum_of_mass_ = (HexPos16){ 0, 0 };
+  g.black_board_.clearAll();
+  g.white_board_.clearAll();
+
+  const uint32_t n_pawns = g.nPawnsInPlay();
+  if (n_pawns > NPawns) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Packed game has %u pawns in play, expected at most %u", n_pawns,
+        NPawns));
+  }
+  if (n_pawns < NPawns && g.state_.blackTurn != (g.state_.turn & 1)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Packed game has %s turn on turn %u", g.state_.blackTurn ? "black"
+                                                                 : "white",
+        g.state_.turn));
+  }
+
+  for (uint32_t i = 0; i < NPawns; i++) {
+    idx_t idx(buf[i] & 0x0fu, buf[i] >> 4);
+    if (i >= n_pawns) {
+      if (idx != idx_t::null_idx()) {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "Packed game has pawn %u placed, but only %u pawns in play", i,
+            n_pawns));
+      }
+      g.pawn_poses_[i] = idx;
+      continue;
+    }
+
+    if (idx == idx_t::null_idx() || idx.x() >= getBoardWidth() ||
+        idx.y() >= getBoardWidth()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Packed game has pawn %u at (%u, %u), which is off the board", i,
+          idx.x(), idx.y()));
+    }
+    if (g.getTile(idx) != TileState::TILE_EMPTY) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Packed game has two pawns at (%u, %u)", idx.x(), idx.y()));
+    }
+
+    g.pawn_poses_[i] = idx;
+    // Black has the even indices, white has the odd.
+    board_t& board = (i & 1) ? g.white_board_ : g.black_board_;
+    board.set(idxOrd(idx));
+    g.sum_of_mass_ += static_cast<HexPos16>(idxToPos(idx));
+  }
+
+  return g;
+}
+
 template <uint32_t NPawns, typename Hash>
 absl::StatusOr<Game<NPawns, Hash>> Game<NPawns, Hash>::LoadState(
     const onoro::proto::GameState& state) {
@@ -1268,8 +1967,11 @@ absl::StatusOr<Game<NPawns, Hash>> Game<NPawns, Hash>::LoadState(
     .blackTurn = 1,
     .finished = 0,
     .hashed = 0,
+    .symm_cached = 0,
   };
   g.sum_of_mass_ = (HexPos16){ 0, 0 };
+  g.black_board_.clearAll();
+  g.white_board_.clearAll();
 
   if (state.turn_num() < NPawns - 1 &&
       static_cast<int>(state.turn_num()) != state.pawns_size() - 1) {
@@ -1304,7 +2006,7 @@ absl::StatusOr<Game<NPawns, Hash>> Game<NPawns, Hash>::LoadState(
     minPos =
         HexPos{ std::min(minPos.x, pawn.x()), std::min(minPos.y, pawn.y()) };
     maxPos =
-        HexPos{ std::min(maxPos.x, pawn.x()), std::min(maxPos.y, pawn.y()) };
+        HexPos{ std::max(maxPos.x, pawn.x()), std::max(maxPos.y, pawn.y()) };
   }
 
   HexPos mid = (minPos + maxPos) / 2u;
@@ -1361,7 +2063,7 @@ bool Game<NPawns, Hash>::validate() const {
   uint32_t n_w_pawns = 0;
   HexPos sum_of_mass = { 0, 0 };
 
-  UnionFind<uint32_t> uf(getBoardSize());
+  StaticUnionFind<uint8_t, getBoardSize()> uf;
 
   if (!forEachPawn(
           [this, &n_b_pawns, &n_w_pawns, &sum_of_mass, &uf](idx_t idx) {
@@ -1471,9 +2173,16 @@ template <uint32_t NPawns, typename Hash>
 void Game<NPawns, Hash>::appendTile(idx_t pos) {
   state_.turn++;
   pawn_poses_[state_.turn] = pos;
+  // Black has the even indices, white has the odd.
+  if (state_.turn & 1) {
+    white_board_.set(idxOrd(pos));
+  } else {
+    black_board_.set(idxOrd(pos));
+  }
 
   state_.blackTurn = !state_.blackTurn;
   state_.hashed = 0;
+  state_.symm_cached = 0;
   sum_of_mass_ += static_cast<HexPos16>(idxToPos(pos));
 }
 
@@ -1481,14 +2190,27 @@ template <uint32_t NPawns, typename Hash>
 void Game<NPawns, Hash>::moveTile(idx_t pos, uint32_t i) {
   idx_t old_idx = pawn_poses_[i];
   pawn_poses_[i] = pos;
+  board_t& board = (i & 1) ? white_board_ : black_board_;
+  board.clear(idxOrd(old_idx));
+  board.set(idxOrd(pos));
 
   state_.blackTurn = !state_.blackTurn;
   state_.hashed = 0;
+  state_.symm_cached = 0;
   sum_of_mass_ += static_cast<HexPos16>(idxToPos(pos) - idxToPos(old_idx));
 }
 
 template <uint32_t NPawns, typename Hash>
 bool Game<NPawns, Hash>::checkWin(idx_t last_move) const {
+#ifdef AVX_SUPPORTED
+  return checkWinAVX(last_move);
+#else
+  return checkWinScalar(last_move);
+#endif
+}
+
+template <uint32_t NPawns, typename Hash>
+bool Game<NPawns, Hash>::checkWinScalar(idx_t last_move) const {
   // Check for a win in all 3 directions
   HexPos last_move_pos = idxToPos(last_move);
 
@@ -1530,6 +2252,82 @@ bool Game<NPawns, Hash>::checkWin(idx_t last_move) const {
   return s != 0;
 }
 
+#ifdef AVX_SUPPORTED
+template <uint32_t NPawns, typename Hash>
+bool Game<NPawns, Hash>::checkWinAVX(idx_t last_move) const {
+  static_assert(sizeof(idx_t) == 1);
+  static_assert(NPawns <= 16, "All pawns must fit in one 128-bit vector");
+  static_assert(n_in_row_to_win == 4);
+
+  alignas(16) uint8_t pawn_bytes[16] = { 0 };
+  memcpy(pawn_bytes, pawn_poses_.data(), NPawns);
+  const __m128i pawns =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(pawn_bytes));
+
+  const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+  const __m128i x = _mm_and_si128(pawns, nibble_mask);
+  const __m128i y = _mm_and_si128(_mm_srli_epi16(pawns, 4), nibble_mask);
+  const __m128i dx =
+      _mm_sub_epi8(x, _mm_set1_epi8(static_cast<char>(last_move.x())));
+  const __m128i dy =
+      _mm_sub_epi8(y, _mm_set1_epi8(static_cast<char>(last_move.y())));
+
+  // Only consider pawns in play belonging to the player who made the last
+  // move. Black has the even indices, white has the odd.
+  const __m128i lane =
+      _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i player = _mm_and_si128(
+      _mm_cmpeq_epi8(_mm_and_si128(lane, _mm_set1_epi8(1)),
+                     _mm_set1_epi8(blackTurn() ? 1 : 0)),
+      _mm_cmplt_epi8(lane,
+                     _mm_set1_epi8(static_cast<char>(nPawnsInPlay()))));
+
+  const __m128i zero = _mm_setzero_si128();
+
+  // Returns, in each 64-bit half, a bitvector of the pawns on_line within 3
+  // tiles of last_move, with bit d + 3 corresponding to the pawn d tiles away.
+  // Pawns on the same line are all different distances from last_move, so
+  // summing the bits of the lanes is the same as or'ing them together.
+  auto line_bits = [zero](__m128i on_line, __m128i d) {
+    const __m128i bit_idx = _mm_add_epi8(d, _mm_set1_epi8(3));
+    const __m128i in_range = _mm_and_si128(
+        on_line,
+        _mm_cmpeq_epi8(_mm_min_epu8(bit_idx, _mm_set1_epi8(6)), bit_idx));
+
+    // Lanes with the high bit of their index set are shuffled to zero.
+    const __m128i bits = _mm_shuffle_epi8(
+        _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+        _mm_or_si128(bit_idx,
+                     _mm_andnot_si128(in_range, _mm_set1_epi8(-0x80))));
+    return _mm_sad_epu8(bits, zero);
+  };
+
+  // The same three lines as checkWinScalar, again leaving a zero bit between
+  // each of the sets, all of which contain last_move at bit 3.
+  // - s[0-6]: line running along the x-axis.
+  // - s[8-14]: line running along the line x = y.
+  // - s[16-22]: line running along the y-axis.
+  const __m128i row =
+      line_bits(_mm_and_si128(player, _mm_cmpeq_epi8(dy, zero)), dx);
+  const __m128i diag =
+      line_bits(_mm_and_si128(player, _mm_cmpeq_epi8(dx, dy)), dx);
+  const __m128i col =
+      line_bits(_mm_and_si128(player, _mm_cmpeq_epi8(dx, zero)), dy);
+  const __m128i sum = _mm_add_epi64(
+      row, _mm_add_epi64(_mm_slli_epi64(diag, 8), _mm_slli_epi64(col, 16)));
+  uint64_t s = static_cast<uint64_t>(
+                   _mm_cvtsi128_si64(sum) +
+                   _mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum))) |
+               UINT64_C(0x080808);
+
+  // Check if any 4 bits in a row are set:
+  s = (s & (s << 2));
+  s = (s & (s << 1));
+
+  return s != 0;
+}
+#endif
+
 template <uint32_t NPawns, typename Hash>
 constexpr void Game<NPawns, Hash>::shiftTiles(idx_t offset) {
   if (offset != idx_t(0, 0)) {
@@ -1538,6 +2336,14 @@ constexpr void Game<NPawns, Hash>::shiftTiles(idx_t offset) {
         pawn_poses_[i] += offset;
       }
     }
+
+    // The offset is a pair of 4-bit two's complement numbers, with the carry
+    // out of x borrowed from y when x is negative.
+    int32_t dx = static_cast<int32_t>(offset.x() ^ 0x8u) - 8;
+    int32_t dy = (static_cast<int8_t>(offset.get_bytes()) - dx) / 16;
+    int32_t ord_shift = dx + dy * static_cast<int32_t>(NPawns);
+    black_board_ = black_board_.shifted(ord_shift);
+    white_board_ = white_board_.shifted(ord_shift);
   }
   state_.hashed = 0;
 }
@@ -1562,6 +2368,20 @@ constexpr idx_t Game<NPawns, Hash>::posToIdx(HexPos pos) {
   return idx_t(static_cast<uint32_t>(pos.x), static_cast<uint32_t>(pos.y));
 }
 
+template <uint32_t NPawns, typename Hash>
+constexpr HexPos Game<NPawns, Hash>::transformOffset(HexPos offset, D6 op) {
+  assert(offset.x >= -max_origin_offset && offset.x <= max_origin_offset);
+  assert(offset.y >= -max_origin_offset && offset.y <= max_origin_offset);
+  PackedOffset p = offset_table[offsetTableIdx(offset, op)];
+  return { p.x, p.y };
+}
+
+template <uint32_t NPawns, typename Hash>
+constexpr HexPos Game<NPawns, Hash>::transformOffset(HexPos offset,
+                                                     const HexTransform& t) {
+  return transformOffset(offset, t.op) + t.offset;
+}
+
 template <uint32_t NPawns, typename Hash>
 uint32_t Game<NPawns, Hash>::nPawnsInPlay() const {
   return state_.turn + 1;
@@ -1587,42 +2407,62 @@ std::size_t Game<NPawns, Hash>::hash() const {
 }
 
 template <uint32_t NPawns, typename Hash>
-typename Game<NPawns, Hash>::TileState Game<NPawns, Hash>::getTile(
-    idx_t idx) const {
-  uint64_t i;
-  const uint64_t* pawn_poses =
-      reinterpret_cast<const uint64_t*>(pawn_poses_.data());
-
-  if (idx == idx_t::null_idx()) {
-    return TileState::TILE_EMPTY;
-  }
+typename Game<NPawns, Hash>::CanonicalKey Game<NPawns, Hash>::canonicalKey()
+    const {
+  BoardSymmetryState s = calcSymmetryState();
+  SymmetryClassOpApplyAndReturn(s.symm_class, calcCanonicalKey);
+}
 
-  uint64_t mask = static_cast<uint64_t>(idx.get_bytes());
-  mask = mask | (mask << 8);
-  mask = mask | (mask << 16);
-  mask = mask | (mask << 32);
+template <uint32_t NPawns, typename Hash>
+template <class SymmetryClassOp>
+typename Game<NPawns, Hash>::CanonicalKey
+Game<NPawns, Hash>::calcCanonicalKey() const {
+  typedef typename SymmetryClassOp::Group Group;
+
+  const hash_group::game_hash_t h = hash();
+  const bool black_turn = blackTurn();
+  CanonicalKey key = { h, 0, false };
+
+  // Boards which are symmetric to themselves with colors swapped have views
+  // with equal hashes but different players to move, so whose turn it is in
+  // the view breaks ties between views with equal hashes.
+  auto less = [&key, black_turn](hash_group::game_hash_t view_h,
+                                 bool color_invert) {
+    return view_h < key.hash ||
+           (view_h == key.hash &&
+            (black_turn ^ color_invert) < (black_turn ^ key.color_invert));
+  };
 
-  for (i = 0; i < NPawns / 8; i++) {
-    uint64_t xor_search = mask ^ pawn_poses[i];
+  for (uint32_t op_ord = 0; op_ord < Group::order(); op_ord++) {
+    hash_group::game_hash_t op_h = hash_group::apply<Group>(Group(op_ord), h);
 
-    uint64_t zero_mask = (xor_search - UINT64_C(0x0101010101010101)) &
-                         ~xor_search & UINT64_C(0x8080808080808080);
-    if (zero_mask != 0) {
-      uint32_t set_bit_idx = __builtin_ctzl(zero_mask);
-      // Black has the even indices, white has the odd.
-      return ((set_bit_idx / 8) & 0x1) ? TileState::TILE_WHITE
-                                       : TileState::TILE_BLACK;
+    if (less(op_h, false)) {
+      key = { op_h, static_cast<uint8_t>(op_ord), false };
+    }
+    if (less(hash_group::color_swap(op_h), true)) {
+      key = { hash_group::color_swap(op_h), static_cast<uint8_t>(op_ord),
+              true };
     }
   }
 
-  // only necessary if NPawns not a multiple of eight
-  for (i = 8 * i; i < NPawns; i++) {
-    if (this->pawn_poses_[i] == idx) {
-      return (i & 0x1) ? TileState::TILE_WHITE : TileState::TILE_BLACK;
-    }
+  return key;
+}
+
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::TileState Game<NPawns, Hash>::getTile(
+    idx_t idx) const {
+  if (idx.x() >= NPawns || idx.y() >= NPawns) {
+    return TileState::TILE_EMPTY;
   }
 
-  return TileState::TILE_EMPTY;
+  uint32_t ord = idxOrd(idx);
+  if (black_board_.test(ord)) {
+    return TileState::TILE_BLACK;
+  } else if (white_board_.test(ord)) {
+    return TileState::TILE_WHITE;
+  } else {
+    return TileState::TILE_EMPTY;
+  }
 }
 
 template <uint32_t NPawns, typename Hash>
@@ -1680,42 +2520,182 @@ template <uint32_t NPawns, typename Hash>
 template <class CallbackFnT>
 bool Game<NPawns, Hash>::forEachMove(CallbackFnT cb) const {
   assert(!inPhase2());
-  static constexpr uint32_t tmp_board_tile_bits = 2;
-  static constexpr uint64_t tmp_board_tile_mask =
-      (uint64_t(1) << tmp_board_tile_bits) - 1;
 
-  constexpr uint64_t tmp_board_len =
-      (getBoardSize() * tmp_board_tile_bits + bits_per_uint64 - 1) /
-      bits_per_uint64;
-  // bitvector of moves already taken
-  uint64_t tmp_board[tmp_board_len] = { 0 };
+  return calcP1MoveTiles().forEachSetBit(
+      [&cb](uint32_t ord) { return cb((P1Move){ ordToIdx(ord) }); });
+}
 
-  return forEachPawn([this, &tmp_board, &cb](idx_t next_idx) {
-    return forEachNeighbor(next_idx, [&tmp_board, this,
-                                      &cb](idx_t neighbor_idx) {
-      if (getTile(neighbor_idx) == TileState::TILE_EMPTY) {
-        uint32_t ord = idxOrd(neighbor_idx);
-        uint32_t tb_shift = tmp_board_tile_bits *
-                            (ord % (bits_per_uint64 / tmp_board_tile_bits));
-        uint64_t tbb = tmp_board[ord / (bits_per_uint64 / tmp_board_tile_bits)];
-        uint64_t mask = tmp_board_tile_mask << tb_shift;
-        uint64_t full_mask = uint64_t(min_neighbors_per_pawn) << tb_shift;
-
-        if ((tbb & mask) != full_mask) {
-          tbb += (uint64_t(1) << tb_shift);
-          tmp_board[ord / (bits_per_uint64 / tmp_board_tile_bits)] = tbb;
-
-          if ((tbb & mask) == full_mask) {
-            if (!cb((P1Move){ neighbor_idx })) {
-              return false;
-            }
-          }
-        }
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::board_t Game<NPawns, Hash>::calcP1MoveTiles()
+    const {
+  static_assert(min_neighbors_per_pawn == 2);
+  constexpr int32_t N = static_cast<int32_t>(getBoardWidth());
+
+  // Since no pawn is ever on the edge of the board, shifting the occupied
+  // tiles by the ordinal offset to a neighbor never wraps a pawn around to the
+  // other side of the board.
+  const board_t occupied = black_board_ | white_board_;
+
+  // Tiles with at least one/two neighboring pawns.
+  board_t ones;
+  board_t twos;
+  for (int32_t neighbor_off : { -N - 1, -N, -1, 1, N, N + 1 }) {
+    board_t neighbors = occupied.shifted(neighbor_off);
+    twos |= ones & neighbors;
+    ones |= neighbors;
+  }
+
+  return twos & ~occupied;
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::generateMoves(move_list_t<P1Move>& moves) const {
+  moves.clear();
+  forEachMove([&moves](P1Move move) {
+    moves.push_back(move);
+    return true;
+  });
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::generateMoves(move_list_t<P2Move>& moves) const {
+  moves.clear();
+  forEachMoveP2([&moves](P2Move move) {
+    moves.push_back(move);
+    return true;
+  });
+}
+
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::board_t Game<NPawns, Hash>::calcLineCompletions(
+    const board_t& board) const {
+  static_assert(n_in_row_to_win == 4);
+  constexpr int32_t N = static_cast<int32_t>(getBoardWidth());
+
+  board_t completions;
+
+  // For each of the three line directions, and the offsets (in tiles and x
+  // coordinate) of one step along them.
+  for (auto [step, step_x] : { std::pair<int32_t, int32_t>{ 1, 1 },
+                               std::pair<int32_t, int32_t>{ N, 0 },
+                               std::pair<int32_t, int32_t>{ N + 1, 1 } }) {
+    // line[k + 3] holds, at each tile, whether the tile k steps along the line
+    // from it has a pawn. Masking by column discards tiles whose line wrapped
+    // around to the other side of the board.
+    board_t line[7];
+    for (int32_t k = -3; k <= 3; k++) {
+      if (k != 0) {
+        line[k + 3] =
+            board.shifted(-k * step) & column_masks[k * step_x + 3];
+      }
+    }
+
+    completions |= (line[4] & line[5] & line[6]) |
+                   (line[2] & line[4] & line[5]) |
+                   (line[1] & line[2] & line[4]) |
+                   (line[0] & line[1] & line[2]);
+  }
+
+  return completions & ~(black_board_ | white_board_);
+}
+
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::board_t Game<NPawns, Hash>::calcThreatTiles()
+    const {
+  static_assert(n_in_row_to_win == 4);
+  constexpr int32_t N = static_cast<int32_t>(getBoardWidth());
+
+  const board_t& board = blackTurn() ? black_board_ : white_board_;
+  const board_t empty = ~(black_board_ | white_board_);
+
+  board_t threats;
+
+  // Same as calcLineCompletions, but looking for windows of 4 tiles along a
+  // line where the other 3 tiles are two pawns and one empty tile.
+  for (auto [step, step_x] : { std::pair<int32_t, int32_t>{ 1, 1 },
+                               std::pair<int32_t, int32_t>{ N, 0 },
+                               std::pair<int32_t, int32_t>{ N + 1, 1 } }) {
+    board_t line[7];
+    board_t gap[7];
+    for (int32_t k = -3; k <= 3; k++) {
+      if (k != 0) {
+        const board_t& mask = column_masks[k * step_x + 3];
+        line[k + 3] = board.shifted(-k * step) & mask;
+        gap[k + 3] = empty.shifted(-k * step) & mask;
+      }
+    }
+
+    auto two_and_gap = [&line, &gap](int32_t a, int32_t b, int32_t c) {
+      return (line[a] & line[b] & gap[c]) | (line[a] & gap[b] & line[c]) |
+             (gap[a] & line[b] & line[c]);
+    };
+
+    threats |= two_and_gap(4, 5, 6) | two_and_gap(2, 4, 5) |
+               two_and_gap(1, 2, 4) | two_and_gap(0, 1, 2);
+  }
+
+  return threats & empty;
+}
+
+template <uint32_t NPawns, typename Hash>
+constexpr typename Game<NPawns, Hash>::board_t
+Game<NPawns, Hash>::genColumnMask(int32_t dx) {
+  board_t mask;
+  for (uint32_t y = 0; y < getBoardWidth(); y++) {
+    for (uint32_t x = 0; x < getBoardWidth(); x++) {
+      int32_t shifted_x = static_cast<int32_t>(x) + dx;
+      if (shifted_x >= 0 && shifted_x < static_cast<int32_t>(getBoardWidth())) {
+        mask.set(idxOrd(idx_t(x, y)));
       }
+    }
+  }
+  return mask;
+}
+
+template <uint32_t NPawns, typename Hash>
+absl::optional<P1Move> Game<NPawns, Hash>::findWinningMove() const {
+  assert(!inPhase2());
+
+  const board_t& player_board = blackTurn() ? black_board_ : white_board_;
+  board_t wins = calcLineCompletions(player_board) & calcP1MoveTiles();
+
+  absl::optional<P1Move> move;
+  wins.forEachSetBit([&move](uint32_t ord) {
+    move = P1Move{ ordToIdx(ord) };
+    return false;
+  });
+  return move;
+}
 
+template <uint32_t NPawns, typename Hash>
+absl::optional<P2Move> Game<NPawns, Hash>::findWinningMoveP2() const {
+  assert(inPhase2());
+
+  const board_t& player_board = blackTurn() ? black_board_ : white_board_;
+
+  // Moving a pawn can only remove pawns from lines, so any winning move must
+  // move a pawn to one of these tiles.
+  const board_t wins = calcLineCompletions(player_board);
+  if (wins.empty()) {
+    return {};
+  }
+
+  absl::optional<P2Move> move;
+  forEachMoveP2([this, &player_board, &wins, &move](P2Move m) {
+    if (!wins.test(idxOrd(m.to))) {
       return true;
-    });
+    }
+
+    // Check that the line isn't broken by the pawn leaving its tile.
+    board_t moved_board = player_board;
+    moved_board.clear(idxOrd(pawn_poses_[m.from_idx]));
+    if (calcLineCompletions(moved_board).test(idxOrd(m.to))) {
+      move = m;
+      return false;
+    }
+    return true;
   });
+  return move;
 }
 
 template <uint32_t NPawns, typename Hash>
@@ -1753,44 +2733,24 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
     return true;
   });
 
+  // The groups the pawns split into when removing any one pawn.
+  const PawnGraphCuts cuts(*this);
+
   // Another pass to enumerate all moves
   for (color_pawn_iterator it = color_pawns_begin(blackTurn());
        it != color_pawns_end(blackTurn()); ++it) {
-    UnionFind<uint32_t> uf(getBoardSize());
-
     idx_t next_idx = *it;
+    uint32_t pawn_idx = it.pawnIdx();
 
-    // Calculate the number of disjoint pawn groups after removing the pawn at
-    // next_idx
-    forEachPawn([&uf, &next_idx, this](idx_t idx) {
-      uint32_t idx_val = idxOrd(idx);
-
-      // Skip ourself
-      if (idx == next_idx) {
-        return true;
-      }
-
-      forEachTopLeftNeighbor(
-          idx, [&uf, &next_idx, &idx_val, this](idx_t neighbor_idx) {
-            if (getTile(neighbor_idx) != TileState::TILE_EMPTY &&
-                neighbor_idx != next_idx) {
-              uf.Union(idx_val, idxOrd(neighbor_idx));
-            }
-            return true;
-          });
-
-      return true;
-    });
-
-    uint32_t n_empty_tiles = getBoardSize() - nPawnsInPlay();
-    // the pawn we are moving is its own group
-    uint32_t n_pawn_groups = uf.GetNumGroups() - n_empty_tiles - 1;
+    // The groups the other pawns split into after removing this pawn, all of
+    // which the pawn must touch in its new location.
+    uint32_t pawn_groups = cuts.groupsWithout(pawn_idx);
 
     // number of neighbors with 1 neighbor after removing this piece
     uint32_t n_to_satisfy = 0;
     // decrease neighbor count of all neighbors
     forEachNeighbor(next_idx, [&tmp_board, &n_to_satisfy,
-                               this](idx_t neighbor_idx) {
+                               &cuts](idx_t neighbor_idx) {
       uint32_t neighbor_ord = idxOrd(neighbor_idx);
       uint32_t tb_idx = neighbor_ord / (bits_per_uint64 / tmp_board_tile_bits);
       uint32_t tb_shift =
@@ -1799,7 +2759,7 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
 
       tmp_board[tb_idx] -= uint64_t(1) << tb_shift;
       if (((tmp_board[tb_idx] >> tb_shift) & tmp_board_tile_mask) == 1 &&
-          getTile(neighbor_idx) != TileState::TILE_EMPTY) {
+          cuts.pawnAt(neighbor_idx) != PawnGraphCuts::no_pawn) {
         n_to_satisfy++;
       }
 
@@ -1821,7 +2781,7 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
 
         // skip this tile if it isn't empty (this will also skip the piece's
         // old location since we haven't removed it, which we want)
-        if (getTile(ordToIdx(next_idx_ord)) != TileState::TILE_EMPTY ||
+        if (cuts.pawnAt(ordToIdx(next_idx_ord)) != PawnGraphCuts::no_pawn ||
             ((tmp_board_bitmask >> tb_shift) & tmp_board_tile_mask) <= 1) {
           tmp_board_bitmask = tmp_board_bitmask & ~clr_mask;
           continue;
@@ -1830,15 +2790,14 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
         tmp_board_bitmask = tmp_board_bitmask & ~clr_mask;
 
         uint32_t n_satisfied = 0;
-        uint32_t g1 = -1u;
-        uint32_t g2 = -1u;
         uint32_t groups_touching = 0;
-        forEachNeighbor(ordToIdx(next_idx_ord), [&tmp_board, &next_idx,
-                                                 &n_satisfied, &uf, &g1, &g2,
-                                                 &groups_touching,
-                                                 this](idx_t neighbor_idx) {
+        forEachNeighbor(ordToIdx(next_idx_ord), [&tmp_board, &n_satisfied,
+                                                 &cuts, pawn_idx,
+                                                 &groups_touching](
+                                                    idx_t neighbor_idx) {
           uint32_t neighbor_ord = idxOrd(neighbor_idx);
-          if (getTile(neighbor_idx) == TileState::TILE_EMPTY) {
+          uint32_t neighbor_pawn = cuts.pawnAt(neighbor_idx);
+          if (neighbor_pawn == PawnGraphCuts::no_pawn) {
             return true;
           }
 
@@ -1852,22 +2811,13 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
             n_satisfied++;
           }
 
-          if (neighbor_idx != next_idx) {
-            uint32_t group_id = uf.GetRoot(neighbor_ord);
-            if (group_id != g1) {
-              if (g1 == -1u) {
-                g1 = group_id;
-                groups_touching++;
-              } else if (group_id != g2) {
-                g2 = group_id;
-                groups_touching++;
-              }
-            }
+          if (neighbor_pawn != pawn_idx) {
+            groups_touching |= cuts.groupWithout(neighbor_pawn, pawn_idx);
           }
           return true;
         });
 
-        if (n_satisfied == n_to_satisfy && groups_touching == n_pawn_groups) {
+        if (n_satisfied == n_to_satisfy && groups_touching == pawn_groups) {
           if (!cb((P2Move){ ordToIdx(next_idx_ord),
                             static_cast<uint8_t>(it.pawnIdx()) })) {
             return false;
@@ -1892,6 +2842,110 @@ bool Game<NPawns, Hash>::forEachMoveP2(CallbackFnT cb) const {
   return true;
 }
 
+template <uint32_t NPawns, typename Hash>
+Game<NPawns, Hash>::PawnGraphCuts::PawnGraphCuts(const Game& game)
+    : n_components_(0), time_(0) {
+  static_assert(NPawns < no_pawn);
+  static_assert(NPawns + max_neighbors <= 32,
+                "Pawn groups must fit in a 32-bit mask");
+
+  uint32_t n_pawns = game.nPawnsInPlay();
+
+  for (uint32_t i = 0; i < 256; i++) {
+    pawn_at_[i] = no_pawn;
+  }
+  for (uint32_t i = 0; i < n_pawns; i++) {
+    pawn_at_[game.pawn_poses_[i].get_bytes()] = static_cast<uint8_t>(i);
+  }
+
+  for (uint32_t i = 0; i < n_pawns; i++) {
+    n_neighbors_[i] = 0;
+    n_cut_children_[i] = 0;
+    disc_[i] = no_pawn;
+    is_root_[i] = false;
+
+    game.forEachNeighbor(game.pawn_poses_[i], [this, i](idx_t neighbor_idx) {
+      uint8_t neighbor = pawn_at_[neighbor_idx.get_bytes()];
+      if (neighbor != no_pawn) {
+        neighbors_[i][n_neighbors_[i]++] = neighbor;
+      }
+      return true;
+    });
+  }
+
+  for (uint32_t i = 0; i < n_pawns; i++) {
+    if (disc_[i] == no_pawn) {
+      is_root_[i] = true;
+      dfs(i, no_pawn);
+      n_components_++;
+    }
+  }
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::PawnGraphCuts::dfs(uint32_t pawn, uint32_t parent) {
+  component_[pawn] = static_cast<uint8_t>(n_components_);
+  disc_[pawn] = static_cast<uint8_t>(time_);
+  low_[pawn] = static_cast<uint8_t>(time_);
+  time_++;
+
+  for (uint32_t i = 0; i < n_neighbors_[pawn]; i++) {
+    uint32_t neighbor = neighbors_[pawn][i];
+
+    if (disc_[neighbor] == no_pawn) {
+      dfs(neighbor, pawn);
+      low_[pawn] = std::min(low_[pawn], low_[neighbor]);
+
+      // Removing this pawn cuts off the subtree below the neighbor if nothing
+      // in that subtree can reach above this pawn. For the root of the search,
+      // every subtree is cut off.
+      if (parent == no_pawn || low_[neighbor] >= disc_[pawn]) {
+        cut_children_[pawn][n_cut_children_[pawn]++] =
+            static_cast<uint8_t>(neighbor);
+      }
+    } else if (neighbor != parent) {
+      low_[pawn] = std::min(low_[pawn], disc_[neighbor]);
+    }
+  }
+
+  end_[pawn] = static_cast<uint8_t>(time_);
+}
+
+template <uint32_t NPawns, typename Hash>
+uint32_t Game<NPawns, Hash>::PawnGraphCuts::pawnAt(idx_t idx) const {
+  return pawn_at_[idx.get_bytes()];
+}
+
+template <uint32_t NPawns, typename Hash>
+uint32_t Game<NPawns, Hash>::PawnGraphCuts::groupsWithout(
+    uint32_t removed) const {
+  // Every other component, and the rest of this pawn's component if it isn't
+  // the root of its search tree.
+  uint32_t groups = (uint32_t(1) << n_components_) - 1;
+  if (is_root_[removed]) {
+    groups &= ~(uint32_t(1) << component_[removed]);
+  }
+
+  // Every subtree cut off by removing the pawn.
+  groups |= ((uint32_t(1) << n_cut_children_[removed]) - 1) << NPawns;
+  return groups;
+}
+
+template <uint32_t NPawns, typename Hash>
+uint32_t Game<NPawns, Hash>::PawnGraphCuts::groupWithout(
+    uint32_t pawn, uint32_t removed) const {
+  if (component_[pawn] == component_[removed]) {
+    for (uint32_t i = 0; i < n_cut_children_[removed]; i++) {
+      uint32_t child = cut_children_[removed][i];
+      if (disc_[pawn] >= disc_[child] && disc_[pawn] < end_[child]) {
+        return uint32_t(1) << (NPawns + i);
+      }
+    }
+  }
+
+  return uint32_t(1) << component_[pawn];
+}
+
 template <uint32_t NPawns, typename Hash>
 Score Game<NPawns, Hash>::getScore() const {
   return score_;
@@ -1902,11 +2956,95 @@ void Game<NPawns, Hash>::setScore(Score score) const {
   const_cast<Game*>(this)->score_ = score;
 }
 
+template <uint32_t NPawns, typename Hash>
+TableEntry Game<NPawns, Hash>::getTableEntry() const {
+  return { score_, bound_, best_move_ };
+}
+
+template <uint32_t NPawns, typename Hash>
+void Game<NPawns, Hash>::setTableEntry(const TableEntry& entry) const {
+  Game* g = const_cast<Game*>(this);
+  g->score_ = entry.score;
+  g->bound_ = entry.bound;
+  g->best_move_ = entry.best_move;
+}
+
+template <uint32_t NPawns, typename Hash>
+TableMove Game<NPawns, Hash>::tableMove(P1Move move) const {
+  HexPos origin = originTile(calcSymmetryState());
+  HexTransform frame = GameKey<NPawns>::canonicalFrame(*this);
+  return TableMove(frame.apply(idxToPos(move.loc) - origin), HexPos::origin());
+}
+
+template <uint32_t NPawns, typename Hash>
+TableMove Game<NPawns, Hash>::tableMove(P2Move move) const {
+  HexPos origin = originTile(calcSymmetryState());
+  HexTransform frame = GameKey<NPawns>::canonicalFrame(*this);
+  return TableMove(frame.apply(idxToPos(move.to) - origin),
+                   frame.apply(idxToPos(pawn_poses_[move.from_idx]) - origin));
+}
+
+template <uint32_t NPawns, typename Hash>
+absl::optional<P1Move> Game<NPawns, Hash>::findTableMove(
+    TableMove move) const {
+  if (!move.has_value()) {
+    return {};
+  }
+
+  HexTransform from_frame = GameKey<NPawns>::canonicalFrame(*this).inverse();
+  HexPos to = originTile(calcSymmetryState()) + from_frame.apply(move.to());
+  if (static_cast<uint32_t>(to.x) >= NPawns ||
+      static_cast<uint32_t>(to.y) >= NPawns) {
+    return {};
+  }
+  return P1Move{ posToIdx(to) };
+}
+
+template <uint32_t NPawns, typename Hash>
+absl::optional<P2Move> Game<NPawns, Hash>::findTableMoveP2(
+    TableMove move) const {
+  if (!move.has_value()) {
+    return {};
+  }
+
+  HexTransform from_frame = GameKey<NPawns>::canonicalFrame(*this).inverse();
+  HexPos origin = originTile(calcSymmetryState());
+  HexPos to = origin + from_frame.apply(move.to());
+  HexPos from = origin + from_frame.apply(move.from());
+  if (static_cast<uint32_t>(to.x) >= NPawns ||
+      static_cast<uint32_t>(to.y) >= NPawns ||
+      static_cast<uint32_t>(from.x) >= NPawns ||
+      static_cast<uint32_t>(from.y) >= NPawns) {
+    return {};
+  }
+
+  idx_t from_idx = posToIdx(from);
+  for (color_pawn_iterator it = color_pawns_begin(blackTurn());
+       it != color_pawns_end(blackTurn()); ++it) {
+    if (*it == from_idx) {
+      return P2Move{ posToIdx(to), static_cast<uint8_t>(it.pawnIdx()) };
+    }
+  }
+  return {};
+}
+
 template <uint32_t NPawns, typename Hash>
 typename Game<NPawns, Hash>::BoardSymmetryState
 Game<NPawns, Hash>::calcSymmetryState() const {
-  auto [x, y] = sum_of_mass_;
-  uint32_t n_pawns = nPawnsInPlay();
+  if (!state_.symm_cached) {
+    BoardSymmetryState s = calcSymmetryState(sum_of_mass_, nPawnsInPlay());
+    const_cast<Game<NPawns, Hash>*>(this)->symm_state_ =
+        BoardSymmStateData(s.op, s.symm_class);
+    const_cast<Game<NPawns, Hash>*>(this)->state_.symm_cached = 1;
+    return s;
+  }
+  return symm_state_.parseSymmetryState();
+}
+
+template <uint32_t NPawns, typename Hash>
+typename Game<NPawns, Hash>::BoardSymmetryState
+Game<NPawns, Hash>::calcSymmetryState(HexPos16 sum_of_mass, uint32_t n_pawns) {
+  auto [x, y] = sum_of_mass;
 
   if (n_pawns == NPawns) {
     x %= NPawns;
@@ -1930,10 +3068,16 @@ Game<NPawns, Hash>::calcSymmetryState() const {
 template <uint32_t NPawns, typename Hash>
 constexpr HexPos Game<NPawns, Hash>::originTile(
     const typename Game<NPawns, Hash>::BoardSymmetryState& state) const {
+  return originTile(sum_of_mass_, nPawnsInPlay(), state);
+}
+
+template <uint32_t NPawns, typename Hash>
+constexpr HexPos Game<NPawns, Hash>::originTile(
+    HexPos16 sum_of_mass, uint32_t n_pawns,
+    const typename Game<NPawns, Hash>::BoardSymmetryState& state) {
   // Operate under the assumption that x, y >= 0
-  uint32_t x = static_cast<uint32_t>(sum_of_mass_.x);
-  uint32_t y = static_cast<uint32_t>(sum_of_mass_.y);
-  uint32_t n_pawns = nPawnsInPlay();
+  uint32_t x = static_cast<uint32_t>(sum_of_mass.x);
+  uint32_t y = static_cast<uint32_t>(sum_of_mass.y);
   HexPos truncated_com = { static_cast<int32_t>(x / n_pawns),
                            static_cast<int32_t>(y / n_pawns) };
   return truncated_com + state.center_offset;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <type_traits>
+
 #include "game.h"
+#include "game_key.h"
 #include "game_view.h"
 
 namespace onoro {
@@ -21,6 +24,18 @@ class GameEq {
                            const GameView<NPawns>& view2,
                            typename Game<NPawns>::BoardSymmetryState s1,
                            typename Game<NPawns>::BoardSymmetryState s2);
+
+  /*
+   * Compares g1 with g2 by moving every pawn of g1 into the frame of g2 with
+   * `to_g2`, collecting them into one board per color, and comparing those
+   * boards with the boards of g2. Unlike looking up each moved pawn in g2, no
+   * step depends on the outcome of the previous one, so this doesn't branch
+   * per pawn and board comparisons are a few wide compares. It is slower when
+   * games differ, since it never exits early.
+   */
+  static bool compareBoards(const Game<NPawns>& g1, const Game<NPawns>& g2,
+                            HexPos origin1, const HexTransform& to_g2,
+                            bool same_color);
 };
 
 template <uint32_t NPawns>
@@ -68,28 +83,36 @@ bool GameEq<NPawns>::compareViews(
     return false;
   }
 
+  // Points in game 1 are translated to view 1 with view_op1, and from there
+  // back to game 2 with the inverse of view 2's op. The ops are applied one
+  // after the other, since both views may have non-identity ops when comparing
+  // canonical views. Pawns are first canonicalized relative to the origin of
+  // game 1, and afterward decanonicalized relative to the origin of game 2.
+  //
+  // All of these ops are affine, so they are collapsed into one transform up
+  // front, and each pawn is moved with a single lookup in the offset table.
   Group view_op1 = view1.template op<Group>();
-  Group view_op2 = view2.template op<Group>();
-
-  // Group operation to translate a point in view 2 to a point in view 1.
-  Group to_view1 = view_op1 * view_op2.inverse();
+  Group from_view2 = view2.template op<Group>().inverse();
 
   HexPos origin1 = g1.originTile(s1);
   HexPos origin2 = g2.originTile(s2);
 
-  // Canonicalizing/decanonicalizing group ops to apply to points before
-  // transforming them according to the symmetry matching op.
-  D6 canon1 = s1.op;
-  D6 decanon2 = s2.op.inverse();
+  HexTransform to_g2 =
+      HexTransform(s2.op.inverse(), origin2)
+          .after(symmetryClassTransform<SymmetryClassOp>(from_view2))
+          .after(symmetryClassTransform<SymmetryClassOp>(view_op1))
+          .after(HexTransform(s1.op, HexPos{ 0, 0 }));
+
+  // Almost every probe of a table is of a game in the trivial symmetry class,
+  // and most comparisons of games with the same hash and pawn counts are of
+  // equal games, so these take the path without early exits.
+  if constexpr (std::is_same<SymmetryClassOp, TrivialOp>::value) {
+    return compareBoards(g1, g2, origin1, to_g2, same_color);
+  }
 
-  return g1.forEachPawn([&g1, &g2, same_color, to_view1, origin1, origin2,
-                         canon1, decanon2](idx_t idx) {
-    HexPos p2 = (Game<NPawns>::idxToPos(idx) - origin1).apply_d6_c(canon1);
-    // printf("p2 from (%d, %d) to ", p2.x, p2.y);
-    p2 = SymmetryClassOp::apply_fn(p2, to_view1);
-    // printf("(%d, %d) after applying %s\n", p2.x, p2.y,
-    //        to_view1.toString().c_str());
-    idx_t idx2 = Game<NPawns>::posToIdx(p2.apply_d6_c(decanon2) + origin2);
+  return g1.forEachPawn([&g1, &g2, same_color, origin1, to_g2](idx_t idx) {
+    idx_t idx2 = Game<NPawns>::posToIdx(Game<NPawns>::transformOffset(
+        Game<NPawns>::idxToPos(idx) - origin1, to_g2));
 
     // printf("Pos (%d, %d) translated to (%d, %d)\n", idx.x(), idx.y(),
     // idx2.x(),
@@ -111,4 +134,66 @@ bool GameEq<NPawns>::compareViews(
   });
 }
 
+template <uint32_t NPawns>
+bool GameEq<NPawns>::compareBoards(const Game<NPawns>& g1,
+                                   const Game<NPawns>& g2, HexPos origin1,
+                                   const HexTransform& to_g2, bool same_color) {
+  typedef typename Game<NPawns>::board_t board_t;
+
+  // Black pawns are at even indices of pawn_poses_, and white at odd indices.
+  board_t boards[2];
+  bool off_board = false;
+  for (uint32_t i = 0; i < g1.nPawnsInPlay(); i++) {
+    HexPos p = Game<NPawns>::transformOffset(
+        Game<NPawns>::idxToPos(g1.pawn_poses_[i]) - origin1, to_g2);
+    bool off = (static_cast<uint32_t>(p.x) >= NPawns) |
+               (static_cast<uint32_t>(p.y) >= NPawns);
+    off_board |= off;
+    // Pawns moved off of the board make the games different, but are still
+    // set somewhere on the board to keep the loop free of branches.
+    uint32_t ord = Game<NPawns>::idxOrd(Game<NPawns>::posToIdx(p));
+    boards[i & 1].set(off ? 0 : ord);
+  }
+
+  if (off_board) {
+    return false;
+  }
+  return same_color
+             ? (boards[0] == g2.black_board_ && boards[1] == g2.white_board_)
+             : (boards[0] == g2.white_board_ && boards[1] == g2.black_board_);
+}
+
+/*
+ * Compares games up to symmetries, for use in tables hashed with
+ * CanonicalGameHash. Several views of a game may tie on the smallest hash, so
+ * the canonical views of two equivalent games may differ, and comparing them
+ * with GameEq could miss the match. Instead, games are compared by their
+ * GameKeys, which are exact.
+ */
+template <uint32_t NPawns>
+class CanonicalGameEq {
+ public:
+  using is_transparent = void;
+
+  bool operator()(const GameView<NPawns>& view1,
+                  const GameView<NPawns>& view2) const noexcept {
+    return (*this)(view1.game(), view2.game());
+  }
+
+  bool operator()(const GameView<NPawns>& view1,
+                  const Game<NPawns>& game2) const noexcept {
+    return (*this)(view1.game(), game2);
+  }
+
+  bool operator()(const Game<NPawns>& game1,
+                  const GameView<NPawns>& view2) const noexcept {
+    return (*this)(game1, view2.game());
+  }
+
+  bool operator()(const Game<NPawns>& game1,
+                  const Game<NPawns>& game2) const noexcept {
+    return GameKey<NPawns>(game1) == GameKey<NPawns>(game2);
+  }
+};
+
 }  // namespace onoro
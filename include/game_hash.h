@@ -51,6 +51,15 @@ class GameHash {
 
   static constexpr game_hash_t calcHash(const Game<NPawns>& game) noexcept;
 
+  /*
+   * Returns the contribution of a single pawn at `pawn_pos` to the hash of a
+   * game with the given symmetry state and origin tile. The hash of a game is
+   * the xor of the contributions of all of its pawns.
+   */
+  static constexpr game_hash_t calcPawnHash(
+      const typename Game<NPawns>::BoardSymmetryState& symm_state,
+      HexPos origin, HexPos pawn_pos, bool black) noexcept;
+
   bool validate() const;
 
   static std::string printD6Hash(game_hash_t);
@@ -189,34 +198,31 @@ constexpr game_hash_t GameHash<NPawns>::calcHash(
          symm_state.center_offset.y);
   */
 
-  const SymmTable& hash_table = getHashTable(symm_state.symm_class);
-
   game_hash_t h = 0;
-  game.forEachPawn([&game, &h, symm_state, origin, hash_table](idx_t pawn_idx) {
-    HexPos pawn_pos = Game<NPawns>::idxToPos(pawn_idx);
-
-    // printf("Trans (%d, %d) -> ", (pawn_pos - origin).x, (pawn_pos -
-    // origin).y);
+  for (bool black : { true, false }) {
+    game.forEachPlayerPawn(black, [&h, symm_state, origin,
+                                   black](idx_t pawn_idx) {
+      h ^= calcPawnHash(symm_state, origin, Game<NPawns>::idxToPos(pawn_idx),
+                        black);
+      return true;
+    });
+  }
 
-    // transform pawn_pos according to symm_state.op
-    pawn_pos = (pawn_pos - origin).apply_d6_c(symm_state.op) + getCenter();
-    HashEl hash_el = hashLookup(hash_table, pawn_pos);
+  return h;
+}
 
-    /*
-    printf("(%d, %d)\n", (pawn_pos - getCenter()).x,
-           (pawn_pos - getCenter()).y);
-    printf("hash: %s\n", printD3Hash(hash_el.black_hash()).c_str());
-    */
+template <uint32_t NPawns>
+constexpr game_hash_t GameHash<NPawns>::calcPawnHash(
+    const typename Game<NPawns>::BoardSymmetryState& symm_state,
+    HexPos origin, HexPos pawn_pos, bool black) noexcept {
+  const SymmTable& hash_table = getHashTable(symm_state.symm_class);
 
-    if (game.getTile(pawn_idx) == Game<NPawns>::TileState::TILE_BLACK) {
-      h = h ^ hash_el.black_hash();
-    } else {
-      h = h ^ hash_el.white_hash();
-    }
-    return true;
-  });
+  // transform pawn_pos according to symm_state.op
+  pawn_pos = Game<NPawns>::transformOffset(pawn_pos - origin, symm_state.op) +
+             getCenter();
+  HashEl hash_el = hashLookup(hash_table, pawn_pos);
 
-  return h;
+  return black ? hash_el.black_hash() : hash_el.white_hash();
 }
 
 template <uint32_t NPawns>
@@ -893,4 +899,23 @@ GameHash<NPawns>::initTrivialTable() {
   return table;
 }
 
+/*
+ * Hashes games by the hash of their canonical view, for use in tables which
+ * store each game once for all games equivalent to it under symmetries. Views
+ * passed to this hasher are expected to be canonical views.
+ */
+template <uint32_t NPawns>
+class CanonicalGameHash {
+ public:
+  using is_transparent = void;
+
+  game_hash_t operator()(const GameView<NPawns>& view) const noexcept {
+    return view.hash();
+  }
+
+  game_hash_t operator()(const Game<NPawns>& game) const noexcept {
+    return game.canonicalKey().hash;
+  }
+};
+
 }  // namespace onoro
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <absl/hash/hash.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#include "game.h"
+#include "hash_group.h"
+#include "hex_pos.h"
+
+namespace onoro {
+
+/*
+ * A compact key identifying a game up to symmetries, which can be stored in
+ * place of the whole game in tables and compared with one 64-bit compare per
+ * word.
+ *
+ * The key holds the tiles of the pawns of the player to move, followed by the
+ * tiles of the other player's pawns, each sorted and relative to the bottom
+ * left corner of the bounding box of all pawns. Since all pawns are connected,
+ * pawns span at most NPawns tiles in each direction, so each tile takes
+ * 2 * ceil(log2(NPawns)) bits. Like GameEq, pawns are first aligned with the
+ * symmetry state of the game, and the key is the smallest encoding over the
+ * group of the game's symmetry class. This way all games equivalent under
+ * symmetries and color inversions share the same key, and games which aren't
+ * equivalent always have different keys.
+ *
+ * Each player's list of pawns is padded to ceil(NPawns / 2) pawns by repeating
+ * its last pawn, which is how the number of pawns of each player is encoded.
+ * Keys don't record whether the game is finished.
+ */
+template <uint32_t NPawns>
+class GameKey {
+  static constexpr uint32_t calcCoordBits() {
+    uint32_t bits = 1;
+    while ((1u << bits) < NPawns) {
+      bits++;
+    }
+    return bits;
+  }
+
+  static constexpr uint32_t coord_bits = calcCoordBits();
+  static constexpr uint32_t pawn_bits = 2 * coord_bits;
+  static constexpr uint32_t pawns_per_word = 64 / pawn_bits;
+  static constexpr uint32_t max_player_pawns = (NPawns + 1) / 2;
+  static constexpr uint32_t n_slots = 2 * max_player_pawns;
+
+ public:
+  static constexpr uint32_t n_words =
+      (n_slots + pawns_per_word - 1) / pawns_per_word;
+
+  using words_t = std::array<uint64_t, n_words>;
+
+  explicit GameKey(const Game<NPawns>& game);
+
+  /*
+   * Returns the transform taking the offsets of tiles from the origin tile of
+   * `game` into the frame of its key, before the pawns are moved to the corner
+   * of their bounding box. All games with the same key have their pawns on the
+   * same tiles in this frame, so a tile in it refers to the same tile of every
+   * game equivalent to `game`, up to the symmetries of the board itself.
+   */
+  static HexTransform canonicalFrame(const Game<NPawns>& game);
+
+  /*
+   * Constructs a game with the pawns of this key. The game is equivalent to
+   * every game with this key, but is only the same as one of them up to
+   * symmetries and color inversions.
+   */
+  Game<NPawns> toGame() const;
+
+  const words_t& words() const {
+    return words_;
+  }
+
+  /*
+   * A 64-bit hash of the key, shared by all equivalent games like the key
+   * itself. Unlike the canonical hash of the game, which leaves parts of the
+   * hash space empty for some symmetry classes, every word of the key is passed
+   * through a full 64-bit mixer, so keys of inequivalent games only collide by
+   * chance. Tables which store this in place of the whole key treat games with
+   * equal hashes as the same game.
+   */
+  uint64_t hash64() const {
+    uint64_t h = n_words;
+    for (uint64_t word : words_) {
+      h = mix64(h ^ word);
+    }
+    return h;
+  }
+
+  bool operator==(const GameKey& other) const {
+    return words_ == other.words_;
+  }
+
+  bool operator!=(const GameKey& other) const {
+    return words_ != other.words_;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const GameKey& key) {
+    return H::combine_contiguous(std::move(h), key.words_.data(), n_words);
+  }
+
+ private:
+  // The positions of the pawns of one player.
+  struct Pawns {
+    uint32_t n;
+    std::array<int32_t, max_player_pawns> x;
+    std::array<int32_t, max_player_pawns> y;
+
+    HexPos pos(uint32_t i) const {
+      return HexPos{ x[i], y[i] };
+    }
+
+    void push_back(HexPos pos) {
+      x[n] = pos.x;
+      y[n] = pos.y;
+      n++;
+    }
+  };
+
+  // The finalizer of splitmix64, a bijection on 64-bit words.
+  static constexpr uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+  }
+
+  // An encoding of a game, and the group operation it was encoded with.
+  struct Encoding {
+    words_t words;
+    HexTransform op;
+  };
+
+  /*
+   * Returns the smallest encoding of the pawns of `game`, and the transform
+   * which moves offsets from the origin tile into the frame of the encoding.
+   */
+  static Encoding calcEncoding(const Game<NPawns>& game);
+
+  /*
+   * Returns the smallest encoding of the pawns of both players over all
+   * operations of the group of SymmetryClassOp. The pawns have already been
+   * aligned with `align_op`, which is folded into the transform returned with
+   * the encoding.
+   */
+  template <class SymmetryClassOp>
+  static Encoding minEncoding(const Pawns& to_move, const Pawns& other,
+                              D6 align_op);
+
+  /*
+   * Encodes the pawns of both players with the group operation `op` applied to
+   * each of them.
+   */
+  template <class SymmetryClassOp>
+  static words_t encode(const Pawns& to_move, const Pawns& other,
+                        typename SymmetryClassOp::Group op);
+
+  static uint32_t slotValue(const words_t& words, uint32_t slot) {
+    return (words[slot / pawns_per_word] >>
+            (pawn_bits * (slot % pawns_per_word))) &
+           ((1u << pawn_bits) - 1);
+  }
+
+  /*
+   * Decodes the pawns of the player whose pawns start at `first_slot`,
+   * returning the number of pawns found.
+   */
+  Pawns decodePlayer(uint32_t first_slot) const;
+
+  words_t words_;
+};
+
+template <uint32_t NPawns>
+GameKey<NPawns>::GameKey(const Game<NPawns>& game)
+    : words_(calcEncoding(game).words) {}
+
+template <uint32_t NPawns>
+HexTransform GameKey<NPawns>::canonicalFrame(const Game<NPawns>& game) {
+  return calcEncoding(game).op;
+}
+
+template <uint32_t NPawns>
+typename GameKey<NPawns>::Encoding GameKey<NPawns>::calcEncoding(
+    const Game<NPawns>& game) {
+  typename Game<NPawns>::BoardSymmetryState s = game.calcSymmetryState();
+  HexPos origin = game.originTile(s);
+
+  Pawns to_move;
+  Pawns other;
+  to_move.n = 0;
+  other.n = 0;
+
+  auto add_pawns = [&game, &s, origin](bool black, Pawns& pawns) {
+    for (auto it = game.color_pawns_begin(black);
+         it != game.color_pawns_end(black); ++it) {
+      pawns.push_back(Game<NPawns>::transformOffset(
+          Game<NPawns>::idxToPos(*it) - origin, s.op));
+    }
+  };
+  add_pawns(game.blackTurn(), to_move);
+  add_pawns(!game.blackTurn(), other);
+
+  SymmetryClassOpApplyAndReturn(s.symm_class, minEncoding, to_move, other,
+                                s.op);
+}
+
+template <uint32_t NPawns>
+template <class SymmetryClassOp>
+typename GameKey<NPawns>::Encoding GameKey<NPawns>::minEncoding(
+    const Pawns& to_move, const Pawns& other, D6 align_op) {
+  typedef typename SymmetryClassOp::Group Group;
+
+  words_t min_words = encode<SymmetryClassOp>(to_move, other, Group(0));
+  uint32_t min_op_ord = 0;
+  for (uint32_t op_ord = 1; op_ord < Group::order(); op_ord++) {
+    words_t words = encode<SymmetryClassOp>(to_move, other, Group(op_ord));
+    if (words < min_words) {
+      min_words = words;
+      min_op_ord = op_ord;
+    }
+  }
+  return { min_words,
+           symmetryClassTransform<SymmetryClassOp>(Group(min_op_ord))
+               .after(HexTransform(align_op, HexPos{ 0, 0 })) };
+}
+
+template <uint32_t NPawns>
+template <class SymmetryClassOp>
+typename GameKey<NPawns>::words_t GameKey<NPawns>::encode(
+    const Pawns& to_move, const Pawns& other,
+    typename SymmetryClassOp::Group op) {
+  Pawns moved_to_move;
+  Pawns moved_other;
+  moved_to_move.n = 0;
+  moved_other.n = 0;
+  HexPos corner{ INT32_MAX, INT32_MAX };
+
+  auto move_pawns = [op, &corner](const Pawns& pawns, Pawns& moved) {
+    for (uint32_t i = 0; i < pawns.n; i++) {
+      HexPos pos = SymmetryClassOp::apply_fn(pawns.pos(i), op);
+      corner = HexPos{ std::min(corner.x, pos.x), std::min(corner.y, pos.y) };
+      moved.push_back(pos);
+    }
+  };
+  move_pawns(to_move, moved_to_move);
+  move_pawns(other, moved_other);
+
+  std::array<uint32_t, n_slots> slots;
+  auto fill_slots = [&corner, &slots](const Pawns& pawns,
+                                      uint32_t first_slot) {
+    uint32_t* player_slots = &slots[first_slot];
+    const uint32_t n_pawns = pawns.n;
+
+    // Players have few pawns, so insertion sort them.
+    for (uint32_t i = 0; i < n_pawns; i++) {
+      HexPos pos = pawns.pos(i) - corner;
+      assert(pos.x >= 0 && pos.x < (1 << coord_bits));
+      assert(pos.y >= 0 && pos.y < (1 << coord_bits));
+      uint32_t value = (static_cast<uint32_t>(pos.y) << coord_bits) |
+                       static_cast<uint32_t>(pos.x);
+
+      uint32_t j = i;
+      for (; j > 0 && player_slots[j - 1] > value; j--) {
+        player_slots[j] = player_slots[j - 1];
+      }
+      player_slots[j] = value;
+    }
+    for (uint32_t i = n_pawns; i < max_player_pawns; i++) {
+      player_slots[i] = player_slots[n_pawns - 1];
+    }
+  };
+  fill_slots(moved_to_move, 0);
+  fill_slots(moved_other, max_player_pawns);
+
+  words_t words{};
+  for (uint32_t slot = 0; slot < n_slots; slot++) {
+    words[slot / pawns_per_word] |= static_cast<uint64_t>(slots[slot])
+                                    << (pawn_bits * (slot % pawns_per_word));
+  }
+  return words;
+}
+
+template <uint32_t NPawns>
+typename GameKey<NPawns>::Pawns GameKey<NPawns>::decodePlayer(
+    uint32_t first_slot) const {
+  static constexpr uint32_t coord_mask = (1u << coord_bits) - 1;
+
+  Pawns pawns;
+  pawns.n = 0;
+  uint32_t prev_value = 0;
+  for (uint32_t i = 0; i < max_player_pawns; i++) {
+    uint32_t value = slotValue(words_, first_slot + i);
+    // Pawns are sorted, so the first repeated pawn is padding.
+    if (i != 0 && value == prev_value) {
+      break;
+    }
+    pawns.push_back(HexPos{ static_cast<int32_t>(value & coord_mask),
+                            static_cast<int32_t>(value >> coord_bits) });
+    prev_value = value;
+  }
+  return pawns;
+}
+
+template <uint32_t NPawns>
+Game<NPawns> GameKey<NPawns>::toGame() const {
+  Pawns to_move = decodePlayer(0);
+  Pawns other = decodePlayer(max_player_pawns);
+
+  // Black places the first pawn, so black never has fewer pawns than white.
+  bool black_turn = to_move.n >= other.n;
+  uint32_t n_pawns = to_move.n + other.n;
+
+  onoro::proto::GameState state;
+  state.set_black_turn(black_turn);
+  state.set_turn_num(n_pawns - 1);
+  state.set_finished(false);
+
+  auto add_pawns = [&state](const Pawns& pawns, bool black) {
+    for (uint32_t i = 0; i < pawns.n; i++) {
+      onoro::proto::GameState::Pawn& pawn = *state.add_pawns();
+      pawn.set_x(pawns.x[i]);
+      pawn.set_y(pawns.y[i]);
+      pawn.set_black(black);
+    }
+  };
+  add_pawns(to_move, black_turn);
+  add_pawns(other, !black_turn);
+
+  absl::StatusOr<Game<NPawns>> game = Game<NPawns>::LoadState(state);
+  if (!game.ok()) {
+    fprintf(stderr, "Failed to construct game from key: %s\n",
+            game.status().ToString().c_str());
+    abort();
+  }
+  return *game;
+}
+
+}  // namespace onoro
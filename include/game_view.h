@@ -21,6 +21,10 @@ class GameView {
   template <class Group>
   constexpr GameView(const Game<NPawns>*, Group view_op, bool color_invert);
 
+  // Constructs the canonical view of a game from its canonical key.
+  constexpr GameView(const Game<NPawns>*,
+                     typename Game<NPawns>::CanonicalKey key);
+
   GameView(const GameView& view) = default;
 
   // Applies the group operation to this view.
@@ -83,6 +87,14 @@ constexpr GameView<NPawns>::GameView(const Game<NPawns>* game, Group view_op,
       color_invert_(color_invert),
       hash_(hash_group::apply<Group>(view_op, game->hash())) {}
 
+template <uint32_t NPawns>
+constexpr GameView<NPawns>::GameView(const Game<NPawns>* game,
+                                     typename Game<NPawns>::CanonicalKey key)
+    : game_(game),
+      view_op_ordinal_(key.op_ordinal),
+      color_invert_(key.color_invert),
+      hash_(key.hash) {}
+
 template <uint32_t NPawns>
 template <class Group>
 constexpr void GameView<NPawns>::apply(Group op) {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 #include "hash_group.h"
 
 namespace onoro {
@@ -519,6 +522,115 @@ typedef SymmetryClassOp<SymmetryClass::CE> C2CEOp;
 typedef SymmetryClassOp<SymmetryClass::EV> C2EVOp;
 typedef SymmetryClassOp<SymmetryClass::TRIVIAL> TrivialOp;
 
+/*
+ * An affine map of hex coordinates, taking p to p.apply_d6_c(op) + offset.
+ * Every operation of every symmetry class is one of these, as is any
+ * composition of them, so a chain of symmetry operations can be collapsed into
+ * a single D6 operation and a translation.
+ */
+struct HexTransform {
+  D6 op;
+  HexPos offset;
+
+  constexpr HexTransform() : op(), offset(0, 0) {}
+  constexpr HexTransform(D6 op, HexPos offset) : op(op), offset(offset) {}
+
+  constexpr HexPos apply(HexPos p) const {
+    return p.apply_d6_c(op) + offset;
+  }
+
+  // Returns the transform which applies `first`, then this transform.
+  constexpr HexTransform after(const HexTransform& first) const;
+
+  // Returns the transform which undoes this transform.
+  constexpr HexTransform inverse() const {
+    D6 inv = op.inverse();
+    return { inv, (HexPos{ 0, 0 } - offset).apply_d6_c(inv) };
+  }
+
+  /*
+   * Returns the transform equal to fn, which must be an affine map whose
+   * linear part is a D6 operation. The transform is found by evaluating fn, so
+   * it doesn't depend on how ops of the groups are multiplied.
+   */
+  template <class Fn>
+  static constexpr HexTransform fromFn(Fn fn);
+};
+
+template <class Fn>
+constexpr HexTransform HexTransform::fromFn(Fn fn) {
+  HexPos offset = fn(HexPos{ 0, 0 });
+  HexPos x = fn(HexPos{ 1, 0 }) - offset;
+  HexPos y = fn(HexPos{ 0, 1 }) - offset;
+  for (uint32_t op_ord = 0; op_ord < D6::order(); op_ord++) {
+    D6 op(op_ord);
+    if (HexPos{ 1, 0 }.apply_d6_c(op) == x &&
+        HexPos{ 0, 1 }.apply_d6_c(op) == y) {
+      return { op, offset };
+    }
+  }
+  __builtin_unreachable();
+}
+
+/*
+ * Table of the D6 operation composing two D6 operations, indexed by
+ * `second.ordinal() * D6::order() + first.ordinal()`.
+ */
+static constexpr std::array<uint8_t, D6::order() * D6::order()>
+genD6ComposeTable() {
+  std::array<uint8_t, D6::order() * D6::order()> table{};
+  for (uint32_t second = 0; second < D6::order(); second++) {
+    for (uint32_t first = 0; first < D6::order(); first++) {
+      HexTransform t = HexTransform::fromFn([second, first](HexPos p) {
+        return p.apply_d6_c(D6(first)).apply_d6_c(D6(second));
+      });
+      table[second * D6::order() + first] =
+          static_cast<uint8_t>(t.op.ordinal());
+    }
+  }
+  return table;
+}
+
+static constexpr std::array<uint8_t, D6::order() * D6::order()>
+    d6_compose_table = genD6ComposeTable();
+
+constexpr HexTransform HexTransform::after(const HexTransform& first) const {
+  return { D6(d6_compose_table[op.ordinal() * D6::order() +
+                               first.op.ordinal()]),
+           apply(first.offset) };
+}
+
+/*
+ * Returns the table of the transforms of each operation of the group of
+ * SymmetryClassOp, indexed by the ordinal of the operation.
+ */
+template <class SymmetryClassOp>
+constexpr std::array<HexTransform, SymmetryClassOp::Group::order()>
+genSymmetryClassTransforms() {
+  typedef typename SymmetryClassOp::Group Group;
+
+  std::array<HexTransform, Group::order()> table;
+  for (uint32_t op_ord = 0; op_ord < Group::order(); op_ord++) {
+    table[op_ord] = HexTransform::fromFn([op_ord](HexPos p) {
+      return SymmetryClassOp::apply_fn(p, Group(op_ord));
+    });
+  }
+  return table;
+}
+
+template <class SymmetryClassOp>
+inline constexpr std::array<HexTransform, SymmetryClassOp::Group::order()>
+    symmetry_class_transforms = genSymmetryClassTransforms<SymmetryClassOp>();
+
+/*
+ * Returns the transform of the operation `op` of the group of SymmetryClassOp.
+ */
+template <class SymmetryClassOp>
+constexpr HexTransform symmetryClassTransform(
+    typename SymmetryClassOp::Group op) {
+  return symmetry_class_transforms<SymmetryClassOp>[op.ordinal()];
+}
+
 /*
  * Calls fn templated with the corresponding symmetry class op based on
  * symm_class, forwarding all arguments following the first two arguments to the
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <absl/types/optional.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "game.h"
+
+namespace onoro {
+
+/*
+ * A small, fast PRNG (SplitMix64) for random playouts. Each thread owns its
+ * own generator, so playouts never contend on the lock of the global rand().
+ */
+class SplitMix64 {
+ public:
+  explicit SplitMix64(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+  }
+
+  // Returns a uniformly random integer in [0, n).
+  uint32_t below(uint32_t n) {
+    return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+  }
+
+ private:
+  uint64_t state_;
+};
+
+/*
+ * Returns a uniformly random legal move from `g`, generating the moves of `g`
+ * in a single pass, or nothing if there are no legal moves.
+ */
+template <class MoveClass, uint32_t NPawns>
+absl::optional<MoveClass> randomMove(const Game<NPawns>& g, SplitMix64& rng) {
+  typename Game<NPawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  if (moves.empty()) {
+    return {};
+  }
+  return moves[rng.below(moves.size())];
+}
+
+/*
+ * How to search a position with findMoveMCTS.
+ */
+struct MctsOptions {
+  uint32_t n_threads = 1;
+  // The total number of playouts to run, split between all threads.
+  uint64_t n_playouts = 100000;
+  // The maximum number of nodes in the tree. Once the tree is full, playouts
+  // continue from its leaves without growing it. The tree always has room for
+  // the children of the root.
+  uint32_t max_nodes = 1u << 20;
+  // The exploration constant of UCT.
+  double exploration = 1.4;
+  // Random playouts which don't finish within this many moves are ties.
+  uint32_t max_rollout_moves = 256;
+  uint64_t seed = 0;
+};
+
+template <class MoveClass>
+struct MctsResult {
+  // The most visited move from the root, or nothing if there are no legal
+  // moves.
+  absl::optional<MoveClass> move;
+  // The fraction of playouts through `move` which the current player won,
+  // counting ties as half a win.
+  double win_rate;
+  uint64_t n_playouts;
+  uint32_t n_nodes;
+};
+
+/*
+ * Monte-Carlo tree search with UCT selection and random playouts. All threads
+ * grow one shared tree, and a thread descending through a node adds a virtual
+ * loss to it until its playout finishes, steering the other threads towards
+ * different parts of the tree.
+ *
+ * Nodes are allocated from a pool sized up front, so growing the tree never
+ * takes a lock or calls malloc, and the whole tree is reclaimed at once before
+ * the next search.
+ */
+template <uint32_t NPawns>
+class Mcts {
+  // Visits of a leaf node before it is expanded.
+  static constexpr uint32_t expand_visits = 1;
+
+  enum NodeState : uint8_t {
+    UNEXPANDED,
+    EXPANDING,
+    EXPANDED,
+    // The tree was full when the node was to be expanded, so it stays a leaf.
+    LEAF,
+  };
+
+  struct Node {
+    std::atomic<uint32_t> visits;
+    // The number of playouts in progress through this node.
+    std::atomic<uint32_t> virtual_loss;
+    // The sum of the outcomes of playouts through this node for the player
+    // who made the move into it, with 2 for a win, 1 for a tie and 0 for a
+    // loss.
+    std::atomic<uint64_t> reward;
+    std::atomic<uint8_t> state;
+
+    // Set before the node is marked EXPANDED, and never changed after.
+    uint32_t first_child;
+    uint16_t n_children;
+
+    // The move into this node. from_idx is only used by phase 2 moves.
+    idx_t to;
+    uint8_t from_idx;
+    bool black_moved;
+  };
+
+  static constexpr uint32_t no_node = UINT32_MAX;
+
+ public:
+  explicit Mcts(const MctsOptions& options)
+      : options_(withValidLimits(options)),
+        nodes_(new Node[options_.max_nodes]),
+        n_nodes_(1),
+        n_playouts_(0) {
+    initNode(nodes_[0], idx_t(), 0, false);
+  }
+
+  Mcts(const Mcts&) = delete;
+  Mcts& operator=(const Mcts&) = delete;
+
+  /*
+   * Searches `root` with options.n_playouts playouts from options.n_threads
+   * threads. MoveClass must be the type of moves from `root`.
+   *
+   * The tree of the previous search is discarded all at once, and its nodes
+   * are reused for this search, so a game played with one Mcts maps the node
+   * pool only once.
+   */
+  template <class MoveClass>
+  MctsResult<MoveClass> search(const Game<NPawns>& root) {
+    root_ = root;
+    n_nodes_.store(1, std::memory_order_relaxed);
+    n_playouts_.store(0, std::memory_order_relaxed);
+    initNode(nodes_[0], idx_t(), 0, false);
+
+    run();
+    return result<MoveClass>();
+  }
+
+ private:
+  // Runs options.n_playouts playouts from options.n_threads threads.
+  void run() {
+    std::vector<std::thread> threads;
+    for (uint32_t t = 1; t < options_.n_threads; t++) {
+      threads.emplace_back([this, t]() { runThread(t); });
+    }
+    runThread(0);
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  template <class MoveClass>
+  MctsResult<MoveClass> result() const;
+
+  // The tree always has room for the root and its children, so there is a
+  // move to return however small max_nodes is.
+  static MctsOptions withValidLimits(MctsOptions options) {
+    options.max_nodes =
+        std::max({ options.max_nodes,
+                   1 + P1Move::maxMoves<NPawns>(),
+                   1 + P2Move::maxMoves<NPawns>() });
+    options.n_threads = std::max(options.n_threads, 1u);
+    return options;
+  }
+
+  static void initNode(Node& node, idx_t to, uint8_t from_idx,
+                       bool black_moved) {
+    node.visits.store(0, std::memory_order_relaxed);
+    node.virtual_loss.store(0, std::memory_order_relaxed);
+    node.reward.store(0, std::memory_order_relaxed);
+    node.state.store(UNEXPANDED, std::memory_order_relaxed);
+    node.first_child = 0;
+    node.n_children = 0;
+    node.to = to;
+    node.from_idx = from_idx;
+    node.black_moved = black_moved;
+  }
+
+  static void makeNodeMove(Game<NPawns>& g, const Node& node) {
+    if (g.inPhase2()) {
+      g.makeMove(P2Move{ node.to, node.from_idx });
+    } else {
+      g.makeMove(P1Move{ node.to });
+    }
+  }
+
+  /*
+   * Reserves `n` nodes from the pool, returning the index of the first, or
+   * no_node if the pool is full.
+   */
+  uint32_t allocNodes(uint32_t n) {
+    uint32_t first = n_nodes_.load(std::memory_order_relaxed);
+    do {
+      if (options_.max_nodes - first < n) {
+        return no_node;
+      }
+    } while (!n_nodes_.compare_exchange_weak(first, first + n,
+                                             std::memory_order_relaxed));
+    return first;
+  }
+
+  /*
+   * Expands `node`, the node of position `g`, unless another thread got to it
+   * first. Returns true if the node is expanded when this returns.
+   */
+  bool tryExpand(Node& node, const Game<NPawns>& g);
+
+  template <class MoveClass>
+  void addChildren(Node& node, const Game<NPawns>& g);
+
+  // Returns the child of `node` with the best UCT value.
+  uint32_t selectChild(const Node& node) const;
+
+  /*
+   * Plays random moves from `g` until the game ends, returning +1 if black
+   * wins, -1 if white wins and 0 if there's no winner within
+   * options.max_rollout_moves moves.
+   */
+  int32_t rollout(Game<NPawns>& g, SplitMix64& rng) const;
+
+  void runThread(uint32_t thread_idx);
+
+  Game<NPawns> root_;
+  const MctsOptions options_;
+
+  std::unique_ptr<Node[]> nodes_;
+  std::atomic<uint32_t> n_nodes_;
+  std::atomic<uint64_t> n_playouts_;
+};
+
+template <uint32_t NPawns>
+bool Mcts<NPawns>::tryExpand(Node& node, const Game<NPawns>& g) {
+  uint8_t expected = UNEXPANDED;
+  if (!node.state.compare_exchange_strong(expected, EXPANDING,
+                                          std::memory_order_relaxed)) {
+    return expected == EXPANDED;
+  }
+
+  if (g.inPhase2()) {
+    addChildren<P2Move>(node, g);
+  } else {
+    addChildren<P1Move>(node, g);
+  }
+  return node.state.load(std::memory_order_relaxed) == EXPANDED;
+}
+
+template <uint32_t NPawns>
+template <class MoveClass>
+void Mcts<NPawns>::addChildren(Node& node, const Game<NPawns>& g) {
+  typename Game<NPawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+
+  uint32_t first = moves.empty() ? 0 : allocNodes(moves.size());
+  if (first == no_node) {
+    node.state.store(LEAF, std::memory_order_relaxed);
+    return;
+  }
+
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    if constexpr (std::is_same<MoveClass, P2Move>::value) {
+      initNode(nodes_[first + i], moves[i].to, moves[i].from_idx,
+               g.blackTurn());
+    } else {
+      initNode(nodes_[first + i], moves[i].loc, 0, g.blackTurn());
+    }
+  }
+  node.first_child = first;
+  node.n_children = static_cast<uint16_t>(moves.size());
+  // Publish the children to threads which see the node as expanded.
+  node.state.store(EXPANDED, std::memory_order_release);
+}
+
+template <uint32_t NPawns>
+uint32_t Mcts<NPawns>::selectChild(const Node& node) const {
+  uint32_t parent_visits =
+      std::max(node.visits.load(std::memory_order_relaxed) +
+                   node.virtual_loss.load(std::memory_order_relaxed),
+               1u);
+  double log_visits = std::log(static_cast<double>(parent_visits));
+
+  uint32_t best = node.first_child;
+  double best_value = -1;
+  for (uint32_t i = node.first_child; i < node.first_child + node.n_children;
+       i++) {
+    const Node& child = nodes_[i];
+    // Playouts in progress count as losses until they finish.
+    uint32_t n = child.visits.load(std::memory_order_relaxed) +
+                 child.virtual_loss.load(std::memory_order_relaxed);
+    if (n == 0) {
+      return i;
+    }
+
+    double value =
+        child.reward.load(std::memory_order_relaxed) / (2. * n) +
+        options_.exploration * std::sqrt(log_visits / n);
+    if (value > best_value) {
+      best = i;
+      best_value = value;
+    }
+  }
+  return best;
+}
+
+template <uint32_t NPawns>
+int32_t Mcts<NPawns>::rollout(Game<NPawns>& g, SplitMix64& rng) const {
+  for (uint32_t i = 0; i < options_.max_rollout_moves; i++) {
+    if (g.isFinished()) {
+      return g.blackWins() ? 1 : -1;
+    }
+
+    bool moved;
+    if (g.inPhase2()) {
+      absl::optional<P2Move> move = randomMove<P2Move>(g, rng);
+      moved = move.has_value();
+      if (moved) {
+        g.makeMove(*move);
+      }
+    } else {
+      absl::optional<P1Move> move = randomMove<P1Move>(g, rng);
+      moved = move.has_value();
+      if (moved) {
+        g.makeMove(*move);
+      }
+    }
+
+    // A player without legal moves loses.
+    if (!moved) {
+      return g.blackTurn() ? -1 : 1;
+    }
+  }
+  return g.isFinished() ? (g.blackWins() ? 1 : -1) : 0;
+}
+
+template <uint32_t NPawns>
+void Mcts<NPawns>::runThread(uint32_t thread_idx) {
+  SplitMix64 rng(options_.seed + thread_idx * UINT64_C(0x632be59bd9b4e019));
+  std::vector<uint32_t> path;
+
+  while (n_playouts_.fetch_add(1, std::memory_order_relaxed) <
+         options_.n_playouts) {
+    Game<NPawns> board = root_;
+    path.clear();
+    path.push_back(0);
+    uint32_t node_idx = 0;
+    // The outcome of the playout: +1 if black won, -1 if white won, 0 if tied.
+    int32_t result;
+
+    while (true) {
+      Node& node = nodes_[node_idx];
+      if (board.isFinished()) {
+        result = board.blackWins() ? 1 : -1;
+        break;
+      }
+
+      uint8_t state = node.state.load(std::memory_order_acquire);
+      if (state != EXPANDED) {
+        bool expand =
+            state == UNEXPANDED &&
+            (node_idx == 0 ||
+             node.visits.load(std::memory_order_relaxed) >= expand_visits);
+        if (!expand || !tryExpand(node, board)) {
+          result = rollout(board, rng);
+          break;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+      }
+
+      if (node.n_children == 0) {
+        // A player without legal moves loses.
+        result = board.blackTurn() ? -1 : 1;
+        break;
+      }
+
+      node_idx = selectChild(node);
+      Node& child = nodes_[node_idx];
+      child.virtual_loss.fetch_add(1, std::memory_order_relaxed);
+      makeNodeMove(board, child);
+      path.push_back(node_idx);
+    }
+
+    for (uint32_t i = 0; i < path.size(); i++) {
+      Node& node = nodes_[path[i]];
+      uint64_t reward = node.black_moved ? 1 + result : 1 - result;
+      node.reward.fetch_add(reward, std::memory_order_relaxed);
+      node.visits.fetch_add(1, std::memory_order_relaxed);
+      if (i != 0) {
+        node.virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+template <uint32_t NPawns>
+template <class MoveClass>
+MctsResult<MoveClass> Mcts<NPawns>::result() const {
+  MctsResult<MoveClass> res;
+  res.win_rate = 0;
+  res.n_playouts = std::min(n_playouts_.load(), options_.n_playouts);
+  res.n_nodes = n_nodes_.load();
+
+  const Node& root = nodes_[0];
+  if (root.state.load(std::memory_order_acquire) != EXPANDED) {
+    return res;
+  }
+
+  const Node* best = nullptr;
+  for (uint32_t i = root.first_child; i < root.first_child + root.n_children;
+       i++) {
+    const Node& child = nodes_[i];
+    if (best == nullptr || child.visits > best->visits) {
+      best = &child;
+    }
+  }
+  if (best == nullptr) {
+    return res;
+  }
+
+  if constexpr (std::is_same<MoveClass, P2Move>::value) {
+    res.move = P2Move{ best->to, best->from_idx };
+  } else {
+    res.move = P1Move{ best->to };
+  }
+  if (best->visits != 0) {
+    res.win_rate = best->reward / (2. * best->visits);
+  }
+  return res;
+}
+
+/*
+ * Searches `g` with Monte-Carlo tree search, for positions too deep to solve
+ * exactly. MoveClass must be the type of moves from `g`. Searching several
+ * positions with one Mcts avoids reallocating the node pool for each.
+ */
+template <uint32_t NPawns, class MoveClass>
+MctsResult<MoveClass> findMoveMCTS(const Game<NPawns>& g,
+                                   const MctsOptions& options) {
+  Mcts<NPawns> mcts(options);
+  return mcts.template search<MoveClass>(g);
+}
+
+}  // namespace onoro
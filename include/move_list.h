@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+namespace onoro {
+
+/*
+ * A list of at most Capacity moves, stored inline so it can live on the stack
+ * of a search. The storage for moves is left uninitialized until moves are
+ * added, so constructing an empty list costs nothing regardless of its
+ * capacity.
+ */
+template <class MoveClass, uint32_t Capacity>
+class MoveList {
+  static_assert(std::is_trivially_copyable<MoveClass>::value &&
+                    std::is_trivially_destructible<MoveClass>::value,
+                "Moves are never destroyed, so must be trivially destructible");
+
+ public:
+  MoveList() : size_(0) {}
+
+  MoveList(const MoveList&) = delete;
+  MoveList& operator=(const MoveList&) = delete;
+
+  static constexpr uint32_t capacity() {
+    return Capacity;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  void push_back(MoveClass move) {
+    assert(size_ < Capacity);
+    new (&storage_[size_ * sizeof(MoveClass)]) MoveClass(move);
+    size_++;
+  }
+
+  MoveClass& operator[](uint32_t i) {
+    return data()[i];
+  }
+
+  const MoveClass& operator[](uint32_t i) const {
+    return data()[i];
+  }
+
+  MoveClass* begin() {
+    return data();
+  }
+
+  MoveClass* end() {
+    return data() + size_;
+  }
+
+  const MoveClass* begin() const {
+    return data();
+  }
+
+  const MoveClass* end() const {
+    return data() + size_;
+  }
+
+ private:
+  MoveClass* data() {
+    return std::launder(reinterpret_cast<MoveClass*>(storage_));
+  }
+
+  const MoveClass* data() const {
+    return std::launder(reinterpret_cast<const MoveClass*>(storage_));
+  }
+
+  uint32_t size_;
+  alignas(MoveClass) unsigned char storage_[Capacity * sizeof(MoveClass)];
+};
+
+}  // namespace onoro
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <absl/types/optional.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "game.h"
+
+namespace onoro {
+
+/*
+ * Orders the moves of a search so the moves most likely to cause a cutoff are
+ * searched first. Moves are ordered by, from most to least important:
+ *  - the best move stored in the transposition table,
+ *  - moves to tiles which leave the current player one pawn away from
+ *    winning,
+ *  - the killer moves of the current ply, which recently caused a cutoff in a
+ *    sibling of this position,
+ *  - the history of each move, which counts how often the move caused a cutoff
+ *    anywhere in the search, weighted towards cutoffs near the root.
+ *
+ * Killers and history are keyed by the tiles a move is made from and to, so
+ * they are shared between positions. If heuristics are disabled, only the
+ * table move is moved to the front.
+ *
+ * This holds the state of a single search thread, and isn't thread safe.
+ */
+template <uint32_t NPawns>
+class MoveOrder {
+  template <class MoveClass>
+  using move_list_t =
+      typename Game<NPawns>::template move_list_t<MoveClass>;
+
+ public:
+  // Killer moves are only tracked for the first max_ply plies of a search.
+  static constexpr uint32_t max_ply = 64;
+  static constexpr uint32_t n_killers = 2;
+
+  explicit MoveOrder(bool use_heuristics = true)
+      : use_heuristics_(use_heuristics), history_(n_keys, 0) {
+    for (auto& killers : killers_) {
+      killers.fill(no_key);
+    }
+  }
+
+  MoveOrder(const MoveOrder&) = delete;
+  MoveOrder& operator=(const MoveOrder&) = delete;
+
+  /*
+   * Sorts `moves` from the position `g`, `ply` moves from the root of the
+   * search. `table_move` is the best move stored for `g`, if there is one.
+   */
+  template <class MoveClass>
+  void orderMoves(const Game<NPawns>& g, uint32_t ply,
+                  absl::optional<MoveClass> table_move,
+                  move_list_t<MoveClass>& moves) const;
+
+  /*
+   * Records that `move`, searched `depth` moves deep from the position `g`
+   * `ply` moves from the root, caused a cutoff.
+   */
+  template <class MoveClass>
+  void recordCutoff(const Game<NPawns>& g, uint32_t ply, uint32_t depth,
+                    MoveClass move);
+
+ private:
+  static constexpr uint32_t board_size = NPawns * NPawns;
+  // Phase 1 moves have no tile they are made from, and use board_size in its
+  // place.
+  static constexpr uint32_t n_keys = (board_size + 1) * board_size;
+  static constexpr uint32_t no_key = UINT32_MAX;
+
+  // Keep history counts small enough to fit under the priority bits.
+  static constexpr uint32_t priority_shift = 28;
+  static constexpr uint32_t max_history = (1u << priority_shift) - 1;
+
+  enum Priority : uint32_t {
+    PRIORITY_NONE = 0,
+    PRIORITY_KILLER = 1,
+    PRIORITY_THREAT = 2,
+    PRIORITY_TABLE = 3,
+  };
+
+  static uint32_t moveKey(const Game<NPawns>& g, P1Move move) {
+    return board_size * board_size + Game<NPawns>::idxOrd(move.loc);
+  }
+
+  static uint32_t moveKey(const Game<NPawns>& g, P2Move move) {
+    return board_size * Game<NPawns>::idxOrd(g.idxAt(move.from_idx)) +
+           Game<NPawns>::idxOrd(move.to);
+  }
+
+  static idx_t moveTo(P1Move move) {
+    return move.loc;
+  }
+
+  static idx_t moveTo(P2Move move) {
+    return move.to;
+  }
+
+  bool isKiller(uint32_t ply, uint32_t key) const {
+    if (ply >= max_ply) {
+      return false;
+    }
+    return std::find(killers_[ply].begin(), killers_[ply].end(), key) !=
+           killers_[ply].end();
+  }
+
+  bool use_heuristics_;
+
+  // Indexed by moveKey().
+  std::vector<uint32_t> history_;
+
+  // The most recent moves to cause a cutoff at each ply, most recent first.
+  std::array<std::array<uint32_t, n_killers>, max_ply> killers_;
+};
+
+template <uint32_t NPawns>
+template <class MoveClass>
+void MoveOrder<NPawns>::orderMoves(const Game<NPawns>& g, uint32_t ply,
+                                   absl::optional<MoveClass> table_move,
+                                   move_list_t<MoveClass>& moves) const {
+  if (!use_heuristics_) {
+    if (table_move.has_value()) {
+      MoveClass* it = std::find(moves.begin(), moves.end(), *table_move);
+      if (it != moves.end()) {
+        std::rotate(moves.begin(), it, it + 1);
+      }
+    }
+    return;
+  }
+
+  const typename Game<NPawns>::board_t threats = g.calcThreatTiles();
+
+  // Sort keys hold the priority of each move in the upper bits and the
+  // inverted index of the move in the lower bits, so sorting them in
+  // descending order keeps equal priority moves in generation order.
+  std::array<uint64_t, move_list_t<MoveClass>::capacity()> sort_keys;
+  const uint32_t n_moves = moves.size();
+  for (uint32_t i = 0; i < n_moves; i++) {
+    MoveClass move = moves[i];
+    uint32_t key = moveKey(g, move);
+
+    uint32_t priority;
+    if (table_move.has_value() && move == *table_move) {
+      priority = PRIORITY_TABLE << priority_shift;
+    } else if (threats.test(Game<NPawns>::idxOrd(moveTo(move)))) {
+      priority = (PRIORITY_THREAT << priority_shift) | history_[key];
+    } else if (isKiller(ply, key)) {
+      priority = (PRIORITY_KILLER << priority_shift) | history_[key];
+    } else {
+      priority = history_[key];
+    }
+
+    sort_keys[i] = (static_cast<uint64_t>(priority) << 32) | (~i);
+  }
+
+  std::sort(sort_keys.begin(), sort_keys.begin() + n_moves,
+            std::greater<uint64_t>());
+
+  std::array<MoveClass, move_list_t<MoveClass>::capacity()> unsorted;
+  std::copy(moves.begin(), moves.end(), unsorted.begin());
+  for (uint32_t i = 0; i < n_moves; i++) {
+    moves[i] = unsorted[~static_cast<uint32_t>(sort_keys[i])];
+  }
+}
+
+template <uint32_t NPawns>
+template <class MoveClass>
+void MoveOrder<NPawns>::recordCutoff(const Game<NPawns>& g, uint32_t ply,
+                                     uint32_t depth, MoveClass move) {
+  if (!use_heuristics_) {
+    return;
+  }
+
+  uint32_t key = moveKey(g, move);
+  history_[key] = std::min(history_[key] + depth * depth, max_history);
+
+  if (ply < max_ply && killers_[ply][0] != key) {
+    std::copy_backward(killers_[ply].begin(), killers_[ply].end() - 1,
+                       killers_[ply].end());
+    killers_[ply][0] = key;
+  }
+}
+
+}  // namespace onoro
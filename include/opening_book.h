@@ -0,0 +1,400 @@
+#pragma once
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_format.h>
+#include <absl/types/optional.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+#include "game_key.h"
+
+namespace onoro {
+
+/*
+ * A read-only database of searched positions, stored in a compact binary file
+ * which is memory mapped, so opening a book costs nothing regardless of its
+ * size and lookups read straight out of the mapped file. Records hold the
+ * scores found by search, which may only be bounds.
+ *
+ * A book file is a header followed by an array of records sorted by key, where
+ * each record holds the hash of the GameKey of a game (see GameKey::hash64)
+ * and its packed score, bound and best move. Games are found by binary
+ * searching for their key. Inequivalent games only share a record if their
+ * 64-bit hashes collide, which is vanishingly unlikely for books of any size
+ * that fits in memory.
+ * Files are written in native byte order, and can only be read by a book with
+ * the same number of pawns.
+ */
+template <uint32_t NPawns>
+class OpeningBook {
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_pawns;
+    uint64_t n_records;
+  };
+
+  struct Record {
+    uint64_t key;
+
+    /*
+     * Layout of the data word of a record:
+     *  [0, 24): the packed score.
+     *  [24, 26): the bound of the score.
+     *  [26, 47): the packed best move.
+     */
+    uint64_t data;
+
+    bool operator<(const Record& other) const {
+      return key < other.key;
+    }
+  };
+
+  static_assert(sizeof(Header) == 24);
+  static_assert(sizeof(Record) == 16);
+
+  static constexpr char magic[8] = "ONOROBK";
+  static constexpr uint32_t version = 3;
+
+  static constexpr uint32_t bound_shift = Score::packed_bits;
+  static constexpr uint32_t move_shift = bound_shift + 2;
+
+  static_assert(move_shift + TableMove::packed_bits <= 64);
+
+ public:
+  /*
+   * Maps the book stored at `path`, returning an error if the file can't be
+   * read or isn't a book for games with NPawns pawns.
+   */
+  static absl::StatusOr<OpeningBook> open(const std::string& path);
+
+  /*
+   * Writes the score, bound and best move of each game in `table` to a new
+   * book at `path`, replacing any existing file. The table must be able to
+   * iterate over its games with forEachGame(). If `base` is given, its records
+   * are copied into the new book too, except where a game in `table` has a
+   * deeper score.
+   *
+   * The book is written to a temporary file which is moved into place, so a
+   * book may be rewritten while it is mapped.
+   */
+  template <class Table>
+  static absl::Status write(const std::string& path, const Table& table,
+                            const OpeningBook* base = nullptr);
+
+  /*
+   * Merges the records of `shards` into a new book at `path`, replacing any
+   * existing file. Shards are books written from the tables of separate
+   * searches. Where several shards have a record of the same game, the deepest
+   * record is kept, and if all of their scores are exact, the scores are
+   * merged, so the new book knows everything any shard did. Returns an error
+   * without writing the book if two exact scores of a game conflict.
+   */
+  static absl::Status merge(const std::string& path,
+                            const std::vector<const OpeningBook*>& shards);
+
+  OpeningBook(OpeningBook&& other)
+      : map_(other.map_), map_size_(other.map_size_),
+        records_(other.records_), n_records_(other.n_records_) {
+    other.map_ = nullptr;
+  }
+
+  OpeningBook(const OpeningBook&) = delete;
+  OpeningBook& operator=(const OpeningBook&) = delete;
+  OpeningBook& operator=(OpeningBook&&) = delete;
+
+  ~OpeningBook() {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+  }
+
+  absl::optional<onoro::Score> find(const onoro::Game<NPawns>& game) const {
+    absl::optional<onoro::TableEntry> entry = findEntry(game);
+    if (entry.has_value()) {
+      return entry->score;
+    }
+    return {};
+  }
+
+  absl::optional<onoro::TableEntry> findEntry(
+      const onoro::Game<NPawns>& game) const {
+    const Record* record = findRecord(GameKey<NPawns>(game).hash64());
+    if (record == nullptr) {
+      return {};
+    }
+    return unpack(record->data);
+  }
+
+  std::size_t size() const {
+    return n_records_;
+  }
+
+ private:
+  OpeningBook(void* map, std::size_t map_size)
+      : map_(map), map_size_(map_size),
+        records_(reinterpret_cast<const Record*>(
+            static_cast<const char*>(map) + sizeof(Header))),
+        n_records_(static_cast<const Header*>(map)->n_records) {}
+
+  static uint64_t pack(const TableEntry& entry) {
+    return static_cast<uint64_t>(entry.score.packed()) |
+           (static_cast<uint64_t>(entry.bound) << bound_shift) |
+           (static_cast<uint64_t>(entry.best_move.packed()) << move_shift);
+  }
+
+  static TableEntry unpack(uint64_t data) {
+    return { Score::fromPacked(static_cast<uint32_t>(data)),
+             static_cast<ScoreBound>((data >> bound_shift) & 0x3u),
+             TableMove::fromPacked(static_cast<uint32_t>(data >> move_shift)) };
+  }
+
+  /*
+   * How many moves deep a score is valid for. Scores which have found a win
+   * are valid for all deeper searches.
+   */
+  static uint32_t scoreDepth(Score score) {
+    if (score.turn_count_win() != 0) {
+      return UINT32_MAX;
+    }
+    return score.turn_count_tie();
+  }
+
+  const Record* findRecord(uint64_t key) const {
+    const Record* end = records_ + n_records_;
+    const Record* it = std::lower_bound(records_, end, Record{ key, 0 });
+    if (it == end || it->key != key) {
+      return nullptr;
+    }
+    return it;
+  }
+
+  static absl::Status writeRecords(const std::string& path,
+                                   const std::vector<Record>& records);
+
+  void* map_;
+  std::size_t map_size_;
+
+  const Record* records_;
+  std::size_t n_records_;
+};
+
+template <uint32_t NPawns>
+absl::StatusOr<OpeningBook<NPawns>> OpeningBook<NPawns>::open(
+    const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrFormat("Failed to open book %s: %s",
+                                               path, strerror(errno)));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return absl::InternalError(
+        absl::StrFormat("Failed to stat book %s: %s", path, strerror(err)));
+  }
+
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  if (size < sizeof(Header)) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Book %s is too small to hold a header", path));
+  }
+
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping holds its own reference to the file.
+  close(fd);
+  if (map == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to map book %s: %s", path, strerror(errno)));
+  }
+
+  // The book owns the mapping from here on, and unmaps it on errors.
+  OpeningBook book(map, size);
+
+  const Header* header = static_cast<const Header*>(map);
+  if (memcmp(header->magic, magic, sizeof(magic)) != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("%s is not an opening book", path));
+  }
+  if (header->version != version) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Book %s has version %u, expected %u", path,
+                        header->version, version));
+  }
+  if (header->n_pawns != NPawns) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Book %s is for games with %u pawns, expected %u",
+                        path, header->n_pawns, NPawns));
+  }
+  if (header->n_records > (size - sizeof(Header)) / sizeof(Record)) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Book %s is truncated, expected %u records", path, header->n_records));
+  }
+
+  // Lookups only touch a few pages of the book each, so don't read ahead.
+  madvise(map, size, MADV_RANDOM);
+
+  return book;
+}
+
+template <uint32_t NPawns>
+template <class Table>
+absl::Status OpeningBook<NPawns>::write(const std::string& path,
+                                        const Table& table,
+                                        const OpeningBook* base) {
+  std::vector<Record> records;
+  records.reserve(table.size());
+  table.forEachGame([&records](const Game<NPawns>& game) {
+    records.push_back(
+        { GameKey<NPawns>(game).hash64(), pack(game.getTableEntry()) });
+    return true;
+  });
+
+  // Sort stably so the first record of each key comes from the earliest game
+  // with that key.
+  std::stable_sort(records.begin(), records.end());
+  records.erase(std::unique(records.begin(), records.end(),
+                            [](const Record& r1, const Record& r2) {
+                              return r1.key == r2.key;
+                            }),
+                records.end());
+
+  if (base != nullptr) {
+    std::vector<Record> merged;
+    merged.reserve(records.size() + base->n_records_);
+
+    auto it = records.begin();
+    for (std::size_t i = 0; i < base->n_records_; i++) {
+      const Record& base_record = base->records_[i];
+      for (; it != records.end() && it->key < base_record.key; it++) {
+        merged.push_back(*it);
+      }
+
+      if (it != records.end() && it->key == base_record.key) {
+        if (scoreDepth(unpack(it->data).score) >=
+            scoreDepth(unpack(base_record.data).score)) {
+          merged.push_back(*it);
+        } else {
+          merged.push_back(base_record);
+        }
+        it++;
+      } else {
+        merged.push_back(base_record);
+      }
+    }
+    merged.insert(merged.end(), it, records.end());
+    records = std::move(merged);
+  }
+
+  return writeRecords(path, records);
+}
+
+template <uint32_t NPawns>
+absl::Status OpeningBook<NPawns>::merge(
+    const std::string& path, const std::vector<const OpeningBook*>& shards) {
+  std::size_t n_records = 0;
+  for (const OpeningBook* shard : shards) {
+    n_records += shard->n_records_;
+  }
+
+  std::vector<Record> records;
+  records.reserve(n_records);
+  for (const OpeningBook* shard : shards) {
+    records.insert(records.end(), shard->records_,
+                   shard->records_ + shard->n_records_);
+  }
+  std::stable_sort(records.begin(), records.end());
+
+  std::vector<Record> merged;
+  merged.reserve(records.size());
+  for (auto it = records.begin(); it != records.end();) {
+    const uint64_t key = it->key;
+    auto group_end =
+        std::find_if(it, records.end(),
+                     [key](const Record& r) { return r.key != key; });
+
+    // Keep the entry of the deepest record, with the scores of all records
+    // merged into it if they are all exact.
+    auto deepest = std::max_element(
+        it, group_end, [](const Record& r1, const Record& r2) {
+          return scoreDepth(unpack(r1.data).score) <
+                 scoreDepth(unpack(r2.data).score);
+        });
+    TableEntry entry = unpack(deepest->data);
+    bool all_exact = std::all_of(it, group_end, [](const Record& r) {
+      return unpack(r.data).bound == ScoreBound::BOUND_EXACT;
+    });
+
+    if (all_exact) {
+      Score score = entry.score;
+      for (; it != group_end; it++) {
+        Score other = unpack(it->data).score;
+        if (!score.compatible(other)) {
+          return absl::FailedPreconditionError(absl::StrFormat(
+              "Shards have incompatible scores %s and %s for key %016x",
+              score.Print(), other.Print(), key));
+        }
+        score.merge(other);
+      }
+      entry.score = score;
+    }
+
+    merged.push_back({ key, pack(entry) });
+    it = group_end;
+  }
+
+  return writeRecords(path, merged);
+}
+
+template <uint32_t NPawns>
+absl::Status OpeningBook<NPawns>::writeRecords(
+    const std::string& path, const std::vector<Record>& records) {
+  Header header;
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.n_pawns = NPawns;
+  header.n_records = records.size();
+
+  const std::string tmp_path = path + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to create book %s: %s", tmp_path, strerror(errno)));
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(records.data(), sizeof(Record), records.size(), file) ==
+                records.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    unlink(tmp_path.c_str());
+    return absl::InternalError(
+        absl::StrFormat("Failed to write book %s", tmp_path));
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    int err = errno;
+    unlink(tmp_path.c_str());
+    return absl::InternalError(absl::StrFormat(
+        "Failed to move book %s into place: %s", path, strerror(err)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace onoro
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace onoro {
+
+/*
+ * How a PageBuffer asks the kernel to back its memory with huge pages.
+ */
+enum class HugePages {
+  // Use the default page size.
+  NONE,
+  // Request transparent huge pages with madvise(MADV_HUGEPAGE). The kernel may
+  // still hand out small pages, e.g. if THP is disabled or memory is
+  // fragmented.
+  TRANSPARENT,
+  // Map the buffer from the explicit huge page pool with MAP_HUGETLB, falling
+  // back to transparent huge pages if the pool is too small.
+  EXPLICIT,
+};
+
+struct PageBufferOptions {
+  HugePages huge_pages = HugePages::NONE;
+
+  // If set, interleaves the pages of the buffer across all online NUMA nodes,
+  // instead of placing each page on the node of the thread which first
+  // touches it.
+  bool numa_interleave = false;
+};
+
+/*
+ * Reads a sysfs list of comma separated ranges, like "0-1,3", calling `cb(i)`
+ * with every number listed. Returns false if the file can't be opened.
+ */
+template <class CallbackFn>
+bool forEachInRangeList(const std::string& path, CallbackFn cb) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (f == nullptr) {
+    return false;
+  }
+
+  unsigned first, last;
+  int n;
+  while ((n = fscanf(f, "%u-%u", &first, &last)) >= 1) {
+    if (n == 1) {
+      last = first;
+    }
+    for (unsigned i = first; i <= last; i++) {
+      cb(i);
+    }
+    if (fgetc(f) != ',') {
+      break;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/*
+ * Returns the CPUs of each online NUMA node, or nothing if the nodes can't be
+ * read from sysfs. A thread pinned to the CPUs of a node places the pages it
+ * first touches on that node.
+ */
+inline std::vector<cpu_set_t> numaNodeCpus() {
+  std::vector<cpu_set_t> node_cpus;
+  bool ok = forEachInRangeList(
+      "/sys/devices/system/node/online", [&node_cpus](unsigned node) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        bool found = forEachInRangeList(
+            "/sys/devices/system/node/node" + std::to_string(node) +
+                "/cpulist",
+            [&cpus](unsigned cpu) {
+              if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &cpus);
+              }
+            });
+        // Memory-only nodes have no CPUs to touch their pages from.
+        if (found && CPU_COUNT(&cpus) != 0) {
+          node_cpus.push_back(cpus);
+        }
+      });
+  if (!ok) {
+    node_cpus.clear();
+  }
+  return node_cpus;
+}
+
+/*
+ * A large, zero-filled buffer mapped directly from the kernel, which can be
+ * backed by huge pages and interleaved across NUMA nodes. Large tables which
+ * are probed at random suffer a dTLB miss on nearly every access with 4 KiB
+ * pages, which huge pages mostly avoid.
+ *
+ * The policies are only requests, so the buffer reports what it actually got.
+ */
+class PageBuffer {
+ public:
+  static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+  PageBuffer() : map_(nullptr), map_size_(0), data_(nullptr), size_(0) {}
+
+  PageBuffer(const PageBuffer&) = delete;
+  PageBuffer& operator=(const PageBuffer&) = delete;
+
+  PageBuffer(PageBuffer&& other) : PageBuffer() {
+    *this = std::move(other);
+  }
+
+  PageBuffer& operator=(PageBuffer&& other) {
+    std::swap(map_, other.map_);
+    std::swap(map_size_, other.map_size_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(hugetlb_, other.hugetlb_);
+    std::swap(interleaved_, other.interleaved_);
+    return *this;
+  }
+
+  ~PageBuffer() {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+  }
+
+  /*
+   * Maps a buffer of at least `size` bytes. Throws std::bad_alloc if the
+   * buffer can't be mapped at all, like operator new.
+   */
+  static PageBuffer allocate(std::size_t size, const PageBufferOptions& opts);
+
+  void* data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // True if the buffer was mapped from the explicit huge page pool.
+  bool hugetlb() const {
+    return hugetlb_;
+  }
+
+  // True if the pages of the buffer are interleaved across NUMA nodes.
+  bool interleaved() const {
+    return interleaved_;
+  }
+
+  /*
+   * Returns the number of bytes of the buffer currently backed by huge pages,
+   * as reported by /proc/self/smaps. Pages are only allocated when first
+   * touched, so this should be checked after the buffer has been written to.
+   */
+  std::size_t hugePageBytes() const;
+
+ private:
+  // Flag for mbind(2), which glibc doesn't declare without libnuma.
+  static constexpr int mpol_interleave = 3;
+
+  // Applies an interleave policy over all online NUMA nodes to the buffer,
+  // returning true on success.
+  bool interleave();
+
+  void* map_;
+  std::size_t map_size_;
+  void* data_;
+  std::size_t size_;
+  bool hugetlb_ = false;
+  bool interleaved_ = false;
+};
+
+inline PageBuffer PageBuffer::allocate(std::size_t size,
+                                       const PageBufferOptions& opts) {
+  PageBuffer buf;
+  if (size == 0) {
+    return buf;
+  }
+
+  if (opts.huge_pages == HugePages::EXPLICIT) {
+    std::size_t map_size =
+        (size + huge_page_size - 1) & ~(huge_page_size - 1);
+    void* map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (map != MAP_FAILED) {
+      buf.map_ = map;
+      buf.map_size_ = map_size;
+      buf.data_ = map;
+      buf.size_ = size;
+      buf.hugetlb_ = true;
+    }
+  }
+
+  if (buf.map_ == nullptr) {
+    bool want_huge = opts.huge_pages != HugePages::NONE;
+    // Over-allocate so the buffer can start on a huge page boundary, otherwise
+    // the pages at either end of the buffer can't be huge pages.
+    std::size_t map_size = want_huge ? size + huge_page_size : size;
+    void* map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    buf.map_ = map;
+    buf.map_size_ = map_size;
+    buf.data_ = map;
+    buf.size_ = size;
+
+    if (want_huge) {
+      uintptr_t start = reinterpret_cast<uintptr_t>(map);
+      uintptr_t aligned = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+      buf.data_ = reinterpret_cast<void*>(aligned);
+      madvise(buf.data_, size, MADV_HUGEPAGE);
+    }
+  }
+
+  if (opts.numa_interleave) {
+    buf.interleaved_ = buf.interleave();
+  }
+  return buf;
+}
+
+inline bool PageBuffer::interleave() {
+  unsigned long node_mask = 0;
+  bool ok = forEachInRangeList("/sys/devices/system/node/online",
+                               [&node_mask](unsigned node) {
+                                 if (node < 64) {
+                                   node_mask |= 1ul << node;
+                                 }
+                               });
+  if (!ok) {
+    return false;
+  }
+
+  // Interleaving over a single node does nothing.
+  if (__builtin_popcountl(node_mask) < 2) {
+    return false;
+  }
+  return syscall(SYS_mbind, data_, size_, mpol_interleave, &node_mask,
+                 sizeof(node_mask) * 8 + 1, 0) == 0;
+}
+
+inline std::size_t PageBuffer::hugePageBytes() const {
+  if (data_ == nullptr) {
+    return 0;
+  }
+  if (hugetlb_) {
+    return size_;
+  }
+
+  FILE* f = fopen("/proc/self/smaps", "r");
+  if (f == nullptr) {
+    return 0;
+  }
+
+  uintptr_t begin = reinterpret_cast<uintptr_t>(data_);
+  uintptr_t end = begin + size_;
+  std::size_t huge_kb = 0;
+  // Whether the mapping of the current smaps entry overlaps the buffer. The
+  // buffer may be split into several mappings with different flags.
+  bool in_buffer = false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    uintptr_t map_begin, map_end;
+    std::size_t kb;
+    // Only the header line of each entry starts with an address range.
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &map_begin, &map_end) == 2) {
+      in_buffer = map_begin < end && map_end > begin;
+    } else if (in_buffer &&
+               sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+      huge_kb += kb;
+    }
+  }
+  fclose(f);
+
+  return std::min(huge_kb << 10, size_);
+}
+
+}  // namespace onoro
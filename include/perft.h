@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "game.h"
+
+namespace onoro {
+
+/*
+ * Counts the games reached after exactly `depth` moves from `g`, where
+ * finished games have no moves. This is a cheap, deterministic measure of move
+ * generation speed, and a check of its correctness.
+ *
+ * The moves of the last move are counted without being made. All other moves
+ * are made and undone in place on `g`, which is restored before returning.
+ */
+template <uint32_t NPawns, class MoveClass>
+uint64_t perft(onoro::Game<NPawns>& g, uint32_t depth) {
+  if (depth == 0) {
+    return 1;
+  }
+
+  typename onoro::Game<NPawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  if (depth == 1) {
+    return moves.size();
+  }
+
+  uint64_t n_leaves = 0;
+  for (MoveClass move : moves) {
+    auto undo = g.makeMove(move);
+    if (g.isFinished()) {
+      // Finished games have no moves.
+    } else if (std::is_same<MoveClass, onoro::P2Move>::value ||
+               g.inPhase2()) {
+      n_leaves += perft<NPawns, onoro::P2Move>(g, depth - 1);
+    } else {
+      n_leaves += perft<NPawns, onoro::P1Move>(g, depth - 1);
+    }
+    g.unmakeMove(move, undo);
+  }
+  return n_leaves;
+}
+
+}  // namespace onoro
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "game.h"
+
+namespace onoro {
+
+/*
+ * Plays `n_playouts` games of uniformly random moves from the start of the
+ * game, calling `cb(g, ply)` with every position reached, starting with the
+ * start of the game at ply 0. A playout ends after `max_playout_len`
+ * positions, or at the first position which is finished or has no moves,
+ * after that position has been passed to `cb`.
+ *
+ * Moves are chosen with a std::mt19937 seeded with `seed`, whose output is
+ * defined by the standard, so the playouts are the same on every machine.
+ *
+ * Returns false as soon as `cb` returns false, and true otherwise.
+ */
+template <uint32_t NPawns, class CallbackFn>
+bool forEachPlayoutPosition(uint32_t seed, uint32_t n_playouts,
+                            uint32_t max_playout_len, CallbackFn cb) {
+  std::mt19937 rng(seed);
+  std::vector<Game<NPawns>> children;
+
+  for (uint32_t i = 0; i < n_playouts; i++) {
+    Game<NPawns> g;
+
+    for (uint32_t ply = 0; ply < max_playout_len; ply++) {
+      if (!cb(static_cast<const Game<NPawns>&>(g), ply)) {
+        return false;
+      }
+      if (g.isFinished()) {
+        break;
+      }
+
+      children.clear();
+      auto add_child = [&g, &children](auto move) {
+        children.emplace_back(g, move);
+        return true;
+      };
+      if (g.inPhase2()) {
+        g.forEachMoveP2(add_child);
+      } else {
+        g.forEachMove(add_child);
+      }
+
+      if (children.empty()) {
+        break;
+      }
+      g = children[rng() % children.size()];
+    }
+  }
+  return true;
+}
+
+}  // namespace onoro
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <absl/types/optional.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+#include "move_order.h"
+#include "opening_book.h"
+#include "search_stats.h"
+#include "tablebase.h"
+#include "timing.h"
+
+namespace onoro {
+
+/*
+ * The score to store in a table for the outcome `value` (as returned by
+ * Searcher::findMoveAB) of a search `depth` moves deep. Wins and losses found
+ * by the search are only known to happen within `depth` moves.
+ */
+inline Score valueToScore(int32_t value, uint32_t depth) {
+  if (value > 0) {
+    return Score::win(depth);
+  } else if (value < 0) {
+    return Score::lose(depth);
+  } else {
+    return Score::tie(depth);
+  }
+}
+
+/*
+ * Returns the outcome stored in `entry` for a search `depth` moves deep, along
+ * with whether that outcome is exact or a bound, if the entry was stored by a
+ * deep enough search.
+ *
+ * Only ties can be stored as bounds: a win is at least as good as any outcome,
+ * and a loss at most as good, so they are always exact.
+ */
+inline absl::optional<std::pair<int32_t, ScoreBound>> entryValue(
+    const TableEntry& entry, uint32_t depth) {
+  const Score& score = entry.score;
+  if (!score.determined(depth)) {
+    return {};
+  }
+  if (score.turn_count_win() != 0 && depth >= score.turn_count_win()) {
+    return std::make_pair(score.curPlayerWins() ? 1 : -1,
+                          ScoreBound::BOUND_EXACT);
+  }
+  return std::make_pair(0, entry.bound);
+}
+
+/*
+ * The state of one search thread: alpha-beta search over the table `table`,
+ * which may be shared with other searchers if it is thread safe, along with
+ * this thread's move ordering state and counters.
+ *
+ * A search is abandoned once `stop` is set, if given, or once the deadline set
+ * with setDeadline() passes. Abandoned searches return meaningless results,
+ * which callers must discard.
+ */
+template <uint32_t NPawns, class Table>
+class Searcher {
+ public:
+  Searcher(Table& table, const OpeningBook<NPawns>* book = nullptr,
+           bool move_ordering = true, const std::atomic<bool>* stop = nullptr,
+           const Tablebase<NPawns>* tablebase = nullptr)
+      : table_(table),
+        book_(book),
+        tablebase_(tablebase),
+        order_(move_ordering),
+        stop_(stop) {}
+
+  Searcher(const Searcher&) = delete;
+  Searcher& operator=(const Searcher&) = delete;
+
+  /*
+   * Abandons searches once the CLOCK_MONOTONIC time `deadline` passes.
+   */
+  void setDeadline(const struct timespec& deadline) {
+    has_deadline_ = true;
+    deadline_ = deadline;
+    out_of_time_ = false;
+  }
+
+  void clearDeadline() {
+    has_deadline_ = false;
+    out_of_time_ = false;
+  }
+
+  // True if a search was abandoned because the deadline passed.
+  bool outOfTime() const {
+    return out_of_time_;
+  }
+
+  /*
+   * Checks the deadline now, instead of waiting for the search to check it.
+   */
+  void checkDeadline() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (elapsedSeconds(now, deadline_) <= 0) {
+      out_of_time_ = true;
+    }
+  }
+
+  // Resets the move count and search stats.
+  void resetCounters() {
+    n_moves_ = 0;
+    stats_ = SearchStats();
+  }
+
+  // The number of moves made since the counters were last reset.
+  uint64_t nMoves() const {
+    return n_moves_;
+  }
+
+  const SearchStats& stats() const {
+    return stats_;
+  }
+
+  /*
+   * Searches for the best move from `g` up to `depth` moves ahead with
+   * findMoveAB. Returns no score if there are no legal moves.
+   */
+  template <class MoveClass>
+  std::pair<absl::optional<Score>, MoveClass> findMove(
+      Game<NPawns>& g, uint32_t depth, uint32_t move_offset = 0);
+
+ private:
+  // The deadline is only checked every deadline_check_interval moves, since
+  // reading the clock isn't free.
+  static constexpr uint64_t deadline_check_interval = 1024;
+
+  /*
+   * True if the search in progress should be abandoned, either because its
+   * result is no longer needed or because it ran out of time.
+   */
+  bool aborted() const {
+    return out_of_time_ ||
+           (stop_ != nullptr && stop_->load(std::memory_order_relaxed));
+  }
+
+  /*
+   * Returns the stored entry for `g`, looking in the tablebase and then the
+   * opening book first. Their entries are only used if they decide the
+   * outcome of a search `depth` moves deep, otherwise the entry in the table
+   * is used.
+   */
+  absl::optional<TableEntry> probeEntry(const Game<NPawns>& g,
+                                        uint32_t depth) const {
+    if (tablebase_ != nullptr) {
+      absl::optional<TableEntry> entry = tablebase_->findEntry(g);
+      if (entry.has_value() && entry->score.determined(depth)) {
+        return entry;
+      }
+    }
+    if (book_ != nullptr) {
+      absl::optional<TableEntry> entry = book_->findEntry(g);
+      if (entry.has_value() && entry->score.determined(depth)) {
+        return entry;
+      }
+    }
+    return table_.findEntry(g);
+  }
+
+  /*
+   * Counts a table probe of `g` in the search stats. Finding the symmetry
+   * class of `g` isn't free, so this is skipped entirely without search stats.
+   */
+  void countProbe(const Game<NPawns>& g, bool found, bool cutoff) {
+    if constexpr (SearchStats::enabled) {
+      stats_.countProbe(g.calcSymmetryState().symm_class, found, cutoff);
+    }
+  }
+
+  /*
+   * Alpha-beta search from `g` up to `depth` moves ahead, caching results in
+   * the table. Returns the expected outcome in terms of the player to go, i.e.
+   * +1 = current player wins, 0 = tie, -1 = current player loses, along with
+   * the chosen move. If there are no legal moves, the current player loses and
+   * no move is returned. If the outcome is outside of (alpha, beta), it is
+   * only a bound on the true outcome.
+   *
+   * Every searched game is stored in the table, along with whether its outcome
+   * is exact or a bound and the best move found from it. Outcomes stored in
+   * the table, the opening book or the tablebase cut the search off when they
+   * are exact or their bound falls outside of (alpha, beta). Moves are
+   * searched in the order chosen by the move ordering, which is told about
+   * every cutoff.
+   *
+   * `ply` is the number of moves made from the root of the search. At the
+   * root, stored outcomes are only used to order moves, since the root has to
+   * return a move. If move_offset is nonzero, the moves from this position are
+   * searched in order starting from the move at index move_offset, wrapping
+   * around to the first moves at the end. This is used to give each search
+   * thread a different move order at the root.
+   *
+   * Moves are made and undone in place on `g`, which is restored before
+   * returning.
+   */
+  template <class MoveClass>
+  std::pair<int32_t, absl::optional<MoveClass>> findMoveAB(
+      Game<NPawns>& g, uint32_t depth, uint32_t ply, int32_t alpha,
+      int32_t beta, uint32_t move_offset = 0);
+
+  Table& table_;
+  const OpeningBook<NPawns>* book_;
+  const Tablebase<NPawns>* tablebase_;
+  MoveOrder<NPawns> order_;
+
+  const std::atomic<bool>* stop_;
+  bool has_deadline_ = false;
+  struct timespec deadline_;
+  bool out_of_time_ = false;
+
+  uint64_t n_moves_ = 0;
+  SearchStats stats_;
+};
+
+template <uint32_t NPawns, class Table>
+template <class MoveClass>
+std::pair<absl::optional<Score>, MoveClass>
+Searcher<NPawns, Table>::findMove(Game<NPawns>& g, uint32_t depth,
+                                  uint32_t move_offset) {
+  auto [score, move] =
+      findMoveAB<MoveClass>(g, depth, /*ply=*/0, -1, 1, move_offset);
+
+  if (!move.has_value()) {
+    return { {}, MoveClass() };
+  }
+  return { valueToScore(score, depth), *move };
+}
+
+template <uint32_t NPawns, class Table>
+template <class MoveClass>
+std::pair<int32_t, absl::optional<MoveClass>>
+Searcher<NPawns, Table>::findMoveAB(Game<NPawns>& g, uint32_t depth,
+                                    uint32_t ply, int32_t alpha, int32_t beta,
+                                    uint32_t move_offset) {
+  const bool root = ply == 0;
+  stats_.countNode(ply);
+
+  if (depth == 0) {
+    return { 0, {} };
+  }
+
+  absl::optional<MoveClass> winning_move = MoveClass::findWinningMoveFn(g);
+  if (winning_move.has_value()) {
+    return { 1, winning_move };
+  }
+
+  absl::optional<TableEntry> entry = probeEntry(g, depth);
+  absl::optional<MoveClass> table_move;
+  if (entry.has_value()) {
+    auto value = entryValue(*entry, depth);
+    if (!root && value.has_value()) {
+      auto [score, bound] = *value;
+      if (bound == ScoreBound::BOUND_EXACT ||
+          (bound == ScoreBound::BOUND_LOWER && score >= beta) ||
+          (bound == ScoreBound::BOUND_UPPER && score <= alpha)) {
+        countProbe(g, /*found=*/true, /*cutoff=*/true);
+        return { score, {} };
+      }
+    }
+    table_move = MoveClass::findTableMoveFn(g, entry->best_move);
+  }
+  countProbe(g, entry.has_value(), /*cutoff=*/false);
+
+  typename Game<NPawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  stats_.countExpansion(ply, moves.size());
+
+  // The children of depth 1 searches are never searched, so their order
+  // doesn't matter.
+  if (depth > 1) {
+    order_.orderMoves(g, ply, table_move, moves);
+  }
+
+  const int32_t orig_alpha = alpha;
+  int32_t best_score = -1;
+  absl::optional<MoveClass> best_move;
+
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    MoveClass move = moves[(i + move_offset) % moves.size()];
+    auto undo = g.makeMove(move);
+    n_moves_++;
+    if (has_deadline_ && n_moves_ % deadline_check_interval == 0) {
+      checkDeadline();
+    }
+    int32_t score;
+
+    // If this move finished the game, it means playing it made us win.
+    if (g.isFinished()) {
+      score = 1;
+    } else if (std::is_same<MoveClass, P2Move>::value || g.inPhase2()) {
+      score =
+          -findMoveAB<P2Move>(g, depth - 1, ply + 1, -beta, -alpha).first;
+    } else {
+      score =
+          -findMoveAB<P1Move>(g, depth - 1, ply + 1, -beta, -alpha).first;
+    }
+    g.unmakeMove(move, undo);
+
+    // The child search may have been cut short, in which case its score can't
+    // be trusted.
+    if (aborted()) {
+      return { 0, {} };
+    }
+
+    if (!best_move.has_value() || score > best_score) {
+      best_move = move;
+      best_score = score;
+
+      if (best_score >= beta) {
+        stats_.countCutoff(i);
+        order_.recordCutoff(g, ply, depth, move);
+        break;
+      }
+      alpha = std::max(alpha, best_score);
+    }
+  }
+
+  ScoreBound bound = ScoreBound::BOUND_EXACT;
+  if (best_score <= orig_alpha) {
+    bound = ScoreBound::BOUND_UPPER;
+  } else if (best_score >= beta) {
+    bound = ScoreBound::BOUND_LOWER;
+  }
+
+  g.setTableEntry({ valueToScore(best_score, depth), bound,
+                    best_move.has_value() ? g.tableMove(*best_move)
+                                          : TableMove::none() });
+  table_.insert_or_assign(g);
+
+  return { best_score, best_move };
+}
+
+/*
+ * The move count, search time and search stats of one search thread.
+ */
+struct SearchThreadStats {
+  uint64_t n_moves;
+  double search_time;
+  SearchStats stats;
+};
+
+/*
+ * How to search a position with findMoveParallel and findMoveIterative.
+ */
+template <uint32_t NPawns>
+struct SearchOptions {
+  uint32_t n_threads = 1;
+  // Whether to order moves by threats, killer moves and history.
+  bool move_ordering = true;
+  // An opening book to probe before the table, if not null.
+  const OpeningBook<NPawns>* book = nullptr;
+  // A tablebase to probe before the book and the table, if not null.
+  const Tablebase<NPawns>* tablebase = nullptr;
+};
+
+/*
+ * Lazy SMP search: runs findMove on the root position from
+ * options.n_threads threads sharing the table `m`, each with a different root
+ * move order. Only the result of the main thread is used; the helper threads
+ * only serve to fill the table with results the main thread can reuse, and
+ * are stopped as soon as the main thread finishes. With more than one thread,
+ * the table must be thread safe.
+ *
+ * If `deadline` is given, the search is abandoned once it passes, in which
+ * case `out_of_time` is set and the result is meaningless.
+ *
+ * Per-thread search statistics are written to `stats`, with the main thread's
+ * statistics first.
+ */
+template <uint32_t NPawns, class MoveClass, class Table>
+std::pair<absl::optional<Score>, MoveClass> findMoveParallel(
+    const Game<NPawns>& g, Table& m, uint32_t depth,
+    const SearchOptions<NPawns>& options,
+    std::vector<SearchThreadStats>& stats,
+    const struct timespec* deadline = nullptr, bool* out_of_time = nullptr) {
+  const uint32_t n_threads = std::max(options.n_threads, 1u);
+  stats.assign(n_threads, SearchThreadStats());
+  std::atomic<bool> stop_search = false;
+
+  auto run_search = [&g, &m, depth, &options, deadline, &stats, &stop_search,
+                     &out_of_time](uint32_t thread_idx) {
+    struct timespec start, end;
+
+    // Each thread searches on its own copy of the board, with its own move
+    // ordering state.
+    Game<NPawns> board = g;
+    Searcher<NPawns, Table> searcher(m, options.book, options.move_ordering,
+                                     &stop_search, options.tablebase);
+    if (deadline != nullptr) {
+      searcher.setDeadline(*deadline);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    auto res = searcher.template findMove<MoveClass>(board, depth, thread_idx);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    stats[thread_idx] = { searcher.nMoves(), elapsedSeconds(start, end),
+                          searcher.stats() };
+    if (thread_idx == 0 && out_of_time != nullptr) {
+      *out_of_time = searcher.outOfTime();
+    }
+    return res;
+  };
+
+  std::vector<std::thread> helpers;
+  for (uint32_t i = 1; i < n_threads; i++) {
+    helpers.emplace_back(run_search, i);
+  }
+
+  auto res = run_search(0);
+
+  stop_search = true;
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+
+  return res;
+}
+
+/*
+ * Iterative deepening search: runs findMoveParallel on `g` to depths 1, 2, ...
+ * up to max_depth, sharing the table `m` between iterations so each iteration
+ * can reuse the scores and best moves found by the previous ones.
+ *
+ * If movetime_ms is nonzero, the search stops once movetime_ms milliseconds
+ * have passed, abandoning the iteration in progress. The first iteration is
+ * always completed, so there is a move to return.
+ *
+ * Returns the result of the deepest completed iteration, and sets
+ * `completed_depth` to its depth. Search statistics are summed over all
+ * iterations into `stats`.
+ */
+template <uint32_t NPawns, class MoveClass, class Table>
+std::pair<absl::optional<Score>, MoveClass> findMoveIterative(
+    const Game<NPawns>& g, Table& m, uint32_t max_depth, uint32_t movetime_ms,
+    const SearchOptions<NPawns>& options,
+    std::vector<SearchThreadStats>& stats, uint32_t& completed_depth) {
+  const uint32_t n_threads = std::max(options.n_threads, 1u);
+  std::pair<absl::optional<Score>, MoveClass> res;
+  std::vector<SearchThreadStats> iter_stats;
+  stats.assign(n_threads, SearchThreadStats());
+  completed_depth = 0;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += movetime_ms / 1000;
+  deadline.tv_nsec += (movetime_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  for (uint32_t depth = 1; depth <= max_depth; depth++) {
+    const bool has_deadline = movetime_ms != 0 && depth > 1;
+    bool out_of_time = false;
+
+    auto iter_res = findMoveParallel<NPawns, MoveClass>(
+        g, m, depth, options, iter_stats, has_deadline ? &deadline : nullptr,
+        &out_of_time);
+
+    for (uint32_t t = 0; t < n_threads; t++) {
+      stats[t].n_moves += iter_stats[t].n_moves;
+      stats[t].search_time += iter_stats[t].search_time;
+      stats[t].stats.merge(iter_stats[t].stats);
+    }
+
+    if (out_of_time) {
+      break;
+    }
+    res = iter_res;
+    completed_depth = depth;
+
+    // Searching deeper can't change the outcome once a win or loss is found.
+    if (!res.first.has_value() || res.first->turn_count_win() != 0) {
+      break;
+    }
+
+    if (movetime_ms != 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (elapsedSeconds(now, deadline) <= 0) {
+        break;
+      }
+    }
+  }
+
+  return res;
+}
+
+}  // namespace onoro
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <absl/strings/str_format.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "hex_pos.h"
+
+/*
+ * Search statistics are collected in debug builds, or when SEARCH_STATS is
+ * defined. Otherwise all counters compile to nothing.
+ */
+#if defined(DEBUG_BUILD) || defined(SEARCH_STATS)
+#define ONORO_SEARCH_STATS 1
+#else
+#define ONORO_SEARCH_STATS 0
+#endif
+
+namespace onoro {
+
+/*
+ * Counters of the work done by one search thread. Each thread counts into its
+ * own instance, which is aligned to a cache line so threads never write to the
+ * same line, and instances are merged once the search is done.
+ *
+ * Counters are kept for:
+ *  - the number of nodes visited at each ply, and the number of moves
+ *    generated from the nodes which were expanded, giving the branching
+ *    factor of each ply,
+ *  - the number of table probes, entries found and cutoffs from stored
+ *    entries, by the symmetry class of the probed game,
+ *  - the number of beta cutoffs by the index of the move causing them in the
+ *    ordered move list.
+ *
+ * Plies and move indices past the end of their arrays are counted in the last
+ * element.
+ */
+class alignas(64) SearchStats {
+ public:
+  static constexpr bool enabled = ONORO_SEARCH_STATS;
+
+  static constexpr uint32_t max_ply = 32;
+  static constexpr uint32_t max_move_idx = 32;
+  static constexpr uint32_t n_symm_classes =
+      static_cast<uint32_t>(SymmetryClass::TRIVIAL) + 1;
+
+  void countNode(uint32_t ply) {
+    if constexpr (enabled) {
+      nodes_[plyIdx(ply)]++;
+    }
+  }
+
+  void countExpansion(uint32_t ply, uint32_t n_moves) {
+    if constexpr (enabled) {
+      expanded_[plyIdx(ply)]++;
+      generated_moves_[plyIdx(ply)] += n_moves;
+    }
+  }
+
+  /*
+   * Counts a table probe for a game of symmetry class `symm_class`, which
+   * found an entry if `found`, and cut the search off if `cutoff`.
+   */
+  void countProbe(SymmetryClass symm_class, bool found, bool cutoff) {
+    if constexpr (enabled) {
+      uint32_t c = static_cast<uint32_t>(symm_class);
+      probes_[c]++;
+      probes_found_[c] += found;
+      probe_cutoffs_[c] += cutoff;
+    }
+  }
+
+  void countCutoff(uint32_t move_idx) {
+    if constexpr (enabled) {
+      cutoffs_[std::min(move_idx, max_move_idx - 1)]++;
+    }
+  }
+
+  void merge(const SearchStats& other) {
+    if constexpr (enabled) {
+      addTo(nodes_, other.nodes_);
+      addTo(expanded_, other.expanded_);
+      addTo(generated_moves_, other.generated_moves_);
+      addTo(probes_, other.probes_);
+      addTo(probes_found_, other.probes_found_);
+      addTo(probe_cutoffs_, other.probe_cutoffs_);
+      addTo(cutoffs_, other.cutoffs_);
+    }
+  }
+
+  uint64_t totalProbes() const {
+    return sum(probes_);
+  }
+
+  uint64_t totalProbeCutoffs() const {
+    return sum(probe_cutoffs_);
+  }
+
+  /*
+   * Formats the stats as a single line of JSON. Per-ply arrays stop at the
+   * deepest ply visited. Probes of each symmetry class are listed with the
+   * order of the class's group, which is how many views of a probed game its
+   * GameKey is chosen from.
+   */
+  std::string toJson() const;
+
+ private:
+  static constexpr uint32_t plyIdx(uint32_t ply) {
+    return std::min(ply, max_ply - 1);
+  }
+
+  template <std::size_t N>
+  static void addTo(std::array<uint64_t, N>& sums,
+                    const std::array<uint64_t, N>& values) {
+    for (std::size_t i = 0; i < N; i++) {
+      sums[i] += values[i];
+    }
+  }
+
+  template <std::size_t N>
+  static uint64_t sum(const std::array<uint64_t, N>& values) {
+    uint64_t total = 0;
+    for (uint64_t value : values) {
+      total += value;
+    }
+    return total;
+  }
+
+  template <class SymmetryClassOp>
+  static uint32_t groupOrder() {
+    return SymmetryClassOp::Group::order();
+  }
+
+  static uint32_t symmClassOrder(SymmetryClass symm_class) {
+    SymmetryClassOpApplyAndReturn(symm_class, groupOrder);
+  }
+
+  static const char* symmClassName(SymmetryClass symm_class);
+
+  template <std::size_t N>
+  static std::string jsonArray(const std::array<uint64_t, N>& values,
+                               std::size_t len);
+
+  // Counters take no space when stats are disabled.
+  template <std::size_t N>
+  using counters_t = std::array<uint64_t, enabled ? N : 0>;
+
+  counters_t<max_ply> nodes_{};
+  counters_t<max_ply> expanded_{};
+  counters_t<max_ply> generated_moves_{};
+
+  counters_t<n_symm_classes> probes_{};
+  counters_t<n_symm_classes> probes_found_{};
+  counters_t<n_symm_classes> probe_cutoffs_{};
+
+  counters_t<max_move_idx> cutoffs_{};
+};
+
+inline const char* SearchStats::symmClassName(SymmetryClass symm_class) {
+  switch (symm_class) {
+    case SymmetryClass::C:
+      return "C";
+    case SymmetryClass::V:
+      return "V";
+    case SymmetryClass::E:
+      return "E";
+    case SymmetryClass::CV:
+      return "CV";
+    case SymmetryClass::CE:
+      return "CE";
+    case SymmetryClass::EV:
+      return "EV";
+    case SymmetryClass::TRIVIAL:
+      return "TRIVIAL";
+  }
+  __builtin_unreachable();
+}
+
+template <std::size_t N>
+std::string SearchStats::jsonArray(const std::array<uint64_t, N>& values,
+                                   std::size_t len) {
+  std::string res = "[";
+  for (std::size_t i = 0; i < len; i++) {
+    absl::StrAppendFormat(&res, "%s%u", i == 0 ? "" : ", ", values[i]);
+  }
+  return res + "]";
+}
+
+inline std::string SearchStats::toJson() const {
+  if constexpr (!enabled) {
+    return "{}";
+  }
+
+  std::size_t n_plies = nodes_.size();
+  while (n_plies > 0 && nodes_[n_plies - 1] == 0) {
+    n_plies--;
+  }
+  std::size_t n_move_idxs = cutoffs_.size();
+  while (n_move_idxs > 0 && cutoffs_[n_move_idxs - 1] == 0) {
+    n_move_idxs--;
+  }
+
+  std::string branching = "[";
+  for (std::size_t i = 0; i < n_plies; i++) {
+    // Plies where no nodes were expanded have no branching factor.
+    if (expanded_[i] == 0) {
+      absl::StrAppendFormat(&branching, "%snull", i == 0 ? "" : ", ");
+    } else {
+      absl::StrAppendFormat(
+          &branching, "%s%.3f", i == 0 ? "" : ", ",
+          (double) generated_moves_[i] / (double) expanded_[i]);
+    }
+  }
+  branching += "]";
+
+  std::string probes = "{";
+  for (uint32_t c = 0; c < probes_.size(); c++) {
+    SymmetryClass symm_class = static_cast<SymmetryClass>(c);
+    absl::StrAppendFormat(&probes,
+                          "%s\"%s\": {\"probes\": %u, \"found\": %u, "
+                          "\"cutoffs\": %u, \"group_order\": %u}",
+                          c == 0 ? "" : ", ", symmClassName(symm_class),
+                          probes_[c], probes_found_[c], probe_cutoffs_[c],
+                          symmClassOrder(symm_class));
+  }
+  probes += "}";
+
+  return absl::StrFormat(
+      "{\"nodes_per_ply\": %s, \"branching_factor_per_ply\": %s, "
+      "\"tt_probes\": %s, \"cutoffs_by_move_idx\": %s}",
+      jsonArray(nodes_, n_plies), branching, probes,
+      jsonArray(cutoffs_, n_move_idxs));
+}
+
+}  // namespace onoro
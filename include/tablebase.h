@@ -0,0 +1,894 @@
+#pragma once
+
+#include <absl/container/flat_hash_set.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_format.h>
+#include <absl/types/optional.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "game_key.h"
+
+namespace onoro {
+
+/*
+ * Counts of the outcomes of the positions of a tablebase, returned by
+ * Tablebase::build.
+ */
+struct TablebaseStats {
+  uint64_t n_positions = 0;
+  uint64_t n_wins = 0;
+  uint64_t n_losses = 0;
+  uint64_t n_draws = 0;
+  // The longest win or loss, in moves.
+  uint32_t max_distance = 0;
+};
+
+/*
+ * An endgame tablebase: the exact outcome of every phase 2 position reachable
+ * from the start of the game, for games small enough to solve completely.
+ * Like OpeningBook, the tablebase is a memory mapped file, and positions are
+ * found by the hash of their GameKey, so two games with colliding hashes share
+ * an outcome.
+ *
+ * A tablebase file is a header, followed by an index of 2^index_bits + 1
+ * offsets, then the sorted keys of all positions, then one 16-bit outcome per
+ * key. Index entry i is the offset of the first key whose top index_bits bits
+ * are at least i, so a lookup only binary searches the few keys of one bucket.
+ * Files are written in native byte order, and can only be read by a tablebase
+ * with the same number of pawns.
+ *
+ * Outcomes hold the number of moves until the game is decided, like Score, in
+ * bits [1, 16), and whether the player to move wins in bit 0. An outcome of 0
+ * is a draw: neither player can force a win.
+ */
+template <uint32_t NPawns>
+class Tablebase {
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_pawns;
+    uint64_t n_records;
+    uint32_t index_bits;
+    uint32_t reserved;
+  };
+
+  static_assert(sizeof(Header) == 32);
+
+  static constexpr char magic[8] = "ONOROTB";
+  static constexpr uint32_t version = 3;
+
+  // Scores can't count more moves to a win than this.
+  static constexpr uint32_t max_distance = 0xfff;
+  // Draws are tied for as many moves as a Score can hold.
+  static constexpr uint32_t draw_depth = 0x7ff;
+  // The most index bits used for large tablebases, keeping the index at
+  // 128 MiB.
+  static constexpr uint32_t max_index_bits = 24;
+
+ public:
+  /*
+   * Maps the tablebase stored at `path`, returning an error if the file can't
+   * be read or isn't a tablebase for games with NPawns pawns.
+   */
+  static absl::StatusOr<Tablebase> open(const std::string& path);
+
+  /*
+   * Solves every phase 2 position reachable from the start of the game by
+   * retrograde analysis, writing the tablebase to `path`, replacing any
+   * existing file. The work is split between `n_threads` threads.
+   *
+   * The positions are found with a breadth-first search which streams them to
+   * the work file `path`.positions as they are discovered, and the moves
+   * between them are written to the work file `path`.children, so only the
+   * keys and outcomes of positions are held in memory. Both work files are
+   * removed once the tablebase is written.
+   *
+   * Positions are then solved by backward induction, in passes over the moves
+   * between positions. Pass d finds every position decided in d moves:
+   * positions with a move to a position lost in d - 1 moves are won, and
+   * positions whose moves all lead to positions won in fewer than d moves are
+   * lost. Positions which are still undecided when a pass finds nothing are
+   * draws.
+   */
+  static absl::StatusOr<TablebaseStats> build(const std::string& path,
+                                              uint32_t n_threads = 1);
+
+  Tablebase(Tablebase&& other)
+      : map_(other.map_), map_size_(other.map_size_),
+        index_bits_(other.index_bits_), index_(other.index_),
+        keys_(other.keys_), values_(other.values_),
+        n_records_(other.n_records_) {
+    other.map_ = nullptr;
+  }
+
+  Tablebase(const Tablebase&) = delete;
+  Tablebase& operator=(const Tablebase&) = delete;
+  Tablebase& operator=(Tablebase&&) = delete;
+
+  ~Tablebase() {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+  }
+
+  absl::optional<onoro::Score> find(const onoro::Game<NPawns>& game) const {
+    absl::optional<onoro::TableEntry> entry = findEntry(game);
+    if (entry.has_value()) {
+      return entry->score;
+    }
+    return {};
+  }
+
+  /*
+   * Returns the exact outcome of `game`, if it's in the tablebase. Draws are
+   * returned as ties for as many moves as a Score can hold. The tablebase
+   * doesn't store moves, so the entry has no best move.
+   */
+  absl::optional<onoro::TableEntry> findEntry(
+      const onoro::Game<NPawns>& game) const {
+    // Only phase 2 positions are stored, so don't bother hashing the rest.
+    if (!game.inPhase2()) {
+      return {};
+    }
+
+    const uint64_t key = GameKey<NPawns>(game).hash64();
+    const uint64_t bucket = index_bits_ == 0 ? 0 : key >> (64 - index_bits_);
+    const uint64_t* begin = keys_ + index_[bucket];
+    const uint64_t* end = keys_ + index_[bucket + 1];
+    const uint64_t* it = std::lower_bound(begin, end, key);
+    if (it == end || *it != key) {
+      return {};
+    }
+    return TableEntry{ valueScore(values_[it - keys_]),
+                       ScoreBound::BOUND_EXACT, TableMove::none() };
+  }
+
+  std::size_t size() const {
+    return n_records_;
+  }
+
+ private:
+  class Builder;
+
+  Tablebase(void* map, std::size_t map_size)
+      : map_(map), map_size_(map_size),
+        index_bits_(static_cast<const Header*>(map)->index_bits),
+        index_(reinterpret_cast<const uint64_t*>(
+            static_cast<const char*>(map) + sizeof(Header))),
+        keys_(index_ + indexSize(index_bits_)), values_(nullptr),
+        n_records_(static_cast<const Header*>(map)->n_records) {
+    values_ = reinterpret_cast<const uint16_t*>(keys_ + n_records_);
+  }
+
+  static constexpr uint16_t value(bool wins, uint32_t distance) {
+    return static_cast<uint16_t>((distance << 1) | (wins ? 1 : 0));
+  }
+
+  static constexpr bool valueWins(uint16_t value) {
+    return (value & 1) != 0;
+  }
+
+  static constexpr uint32_t valueDistance(uint16_t value) {
+    return value >> 1;
+  }
+
+  static Score valueScore(uint16_t value) {
+    if (value == 0) {
+      return Score::tie(draw_depth);
+    }
+    return valueWins(value) ? Score::win(valueDistance(value))
+                            : Score::lose(valueDistance(value));
+  }
+
+  static constexpr std::size_t indexSize(uint32_t index_bits) {
+    return (std::size_t(1) << index_bits) + 1;
+  }
+
+  // The expected size of a file with this many index bits and records.
+  static constexpr std::size_t fileSize(uint32_t index_bits,
+                                        uint64_t n_records) {
+    return sizeof(Header) + indexSize(index_bits) * sizeof(uint64_t) +
+           n_records * (sizeof(uint64_t) + sizeof(uint16_t));
+  }
+
+  void* map_;
+  std::size_t map_size_;
+
+  uint32_t index_bits_;
+  const uint64_t* index_;
+  const uint64_t* keys_;
+  const uint16_t* values_;
+  std::size_t n_records_;
+};
+
+template <uint32_t NPawns>
+absl::StatusOr<Tablebase<NPawns>> Tablebase<NPawns>::open(
+    const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrFormat(
+        "Failed to open tablebase %s: %s", path, strerror(errno)));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return absl::InternalError(absl::StrFormat(
+        "Failed to stat tablebase %s: %s", path, strerror(err)));
+  }
+
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  if (size < sizeof(Header)) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Tablebase %s is too small to hold a header", path));
+  }
+
+  // Validate the header before mapping the rest of the file, since the
+  // constructor trusts it to find the index, keys and values.
+  Header header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    int err = errno;
+    close(fd);
+    return absl::InternalError(absl::StrFormat(
+        "Failed to read tablebase %s: %s", path, strerror(err)));
+  }
+  absl::Status status;
+  if (memcmp(header.magic, magic, sizeof(magic)) != 0) {
+    status = absl::InvalidArgumentError(
+        absl::StrFormat("%s is not a tablebase", path));
+  } else if (header.version != version) {
+    status = absl::InvalidArgumentError(
+        absl::StrFormat("Tablebase %s has version %u, expected %u", path,
+                        header.version, version));
+  } else if (header.n_pawns != NPawns) {
+    status = absl::InvalidArgumentError(
+        absl::StrFormat("Tablebase %s is for games with %u pawns, expected %u",
+                        path, header.n_pawns, NPawns));
+  } else if (header.index_bits > max_index_bits ||
+             fileSize(header.index_bits, header.n_records) > size) {
+    status = absl::InvalidArgumentError(
+        absl::StrFormat("Tablebase %s is truncated, expected %u records",
+                        path, header.n_records));
+  }
+  if (!status.ok()) {
+    close(fd);
+    return status;
+  }
+
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping holds its own reference to the file.
+  close(fd);
+  if (map == MAP_FAILED) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to map tablebase %s: %s", path, strerror(errno)));
+  }
+
+  // Lookups only touch a few pages of the tablebase each, so don't read
+  // ahead.
+  madvise(map, size, MADV_RANDOM);
+
+  return Tablebase(map, size);
+}
+
+/*
+ * The state of one tablebase build. The position and children work files are
+ * indexed by the order positions were discovered in.
+ */
+template <uint32_t NPawns>
+class Tablebase<NPawns>::Builder {
+  static constexpr std::size_t packed_size = Game<NPawns>::packed_size;
+
+  // Positions are expanded in batches of this many, so the breadth-first
+  // search only holds a batch of positions in memory at a time.
+  static constexpr uint64_t batch_size = 1 << 16;
+
+  // Threads claim this many positions at a time from a parallel loop.
+  static constexpr uint64_t chunk_size = 256;
+
+  static constexpr uint32_t no_position = UINT32_MAX;
+
+  /*
+   * The keys of all positions found so far, split into independently locked
+   * shards so all threads can add the positions they find.
+   */
+  class KeySet {
+    static constexpr uint32_t n_shards = 64;
+    static constexpr uint32_t cache_line_size = 64;
+
+   public:
+    // Adds `key` to the set, returning true if it wasn't there already.
+    bool insert(uint64_t key) {
+      Shard& shard = shards_[key % n_shards];
+      std::lock_guard<std::mutex> lock(shard.lock);
+      return shard.keys.insert(key).second;
+    }
+
+   private:
+    struct alignas(cache_line_size) Shard {
+      std::mutex lock;
+      absl::flat_hash_set<uint64_t> keys;
+    };
+
+    std::array<Shard, n_shards> shards_;
+  };
+
+ public:
+  Builder(const std::string& path, uint32_t n_threads)
+      : path_(path),
+        positions_path_(path + ".positions"),
+        children_path_(path + ".children"),
+        n_threads_(std::max(n_threads, 1u)) {}
+
+  Builder(const Builder&) = delete;
+  Builder& operator=(const Builder&) = delete;
+
+  ~Builder() {
+    if (positions_fd_ >= 0) {
+      close(positions_fd_);
+      unlink(positions_path_.c_str());
+    }
+    if (children_fd_ >= 0) {
+      close(children_fd_);
+      unlink(children_path_.c_str());
+    }
+  }
+
+  absl::StatusOr<TablebaseStats> run();
+
+ private:
+  /*
+   * Calls `fn(thread_idx, i)` for every i in [0, n), split between all
+   * threads.
+   */
+  template <class Fn>
+  void parallelFor(uint64_t n, Fn fn) const;
+
+  /*
+   * Finds every phase 2 position reachable from the start of the game,
+   * appending them to the positions file along with their keys.
+   */
+  absl::Status enumerate();
+
+  /*
+   * Appends the children of `games` which haven't been found yet to either
+   * `phase1` or `phase2`, split by phase. Children of phase 1 games are
+   * deduplicated with `phase1_keys`, and of phase 2 games with keys_.
+   */
+  void expand(const std::vector<Game<NPawns>>& games, KeySet& phase1_keys,
+              std::vector<Game<NPawns>>& phase1,
+              std::vector<Game<NPawns>>& phase2);
+
+  absl::Status appendPositions(const std::vector<Game<NPawns>>& games);
+
+  absl::Status readPositions(uint64_t first, uint64_t n,
+                             std::vector<Game<NPawns>>& games) const;
+
+  // Returns the index of the position whose GameKey hashes to `key`, or
+  // no_position.
+  uint32_t findPosition(uint64_t key) const;
+
+  /*
+   * Writes the moves of every position to the children file, as the indices
+   * of the positions they lead to, and decides positions with a winning move
+   * or no moves at all.
+   */
+  absl::Status link();
+
+  // Solves all positions by backward induction.
+  absl::Status solve();
+
+  absl::Status write() const;
+
+  absl::Status ioError(const char* what, const std::string& path) const {
+    return absl::InternalError(
+        absl::StrFormat("Failed to %s %s: %s", what, path, strerror(errno)));
+  }
+
+  const std::string path_;
+  const std::string positions_path_;
+  const std::string children_path_;
+  const uint32_t n_threads_;
+
+  int positions_fd_ = -1;
+  int children_fd_ = -1;
+  uint64_t n_positions_ = 0;
+
+  KeySet key_set_;
+  // The key of each position, in the order of the positions file.
+  std::vector<uint64_t> keys_;
+  // All keys in sorted order, and the index of the position of each.
+  std::vector<uint64_t> sorted_keys_;
+  std::vector<uint32_t> sorted_positions_;
+
+  // The offset of the first child of each position in the children file, and
+  // the total number of children at the end.
+  std::vector<uint64_t> child_offsets_;
+  std::unique_ptr<std::atomic<uint16_t>[]> values_;
+
+  TablebaseStats stats_;
+};
+
+template <uint32_t NPawns>
+absl::StatusOr<TablebaseStats> Tablebase<NPawns>::build(
+    const std::string& path, uint32_t n_threads) {
+  Builder builder(path, n_threads);
+  return builder.run();
+}
+
+template <uint32_t NPawns>
+absl::StatusOr<TablebaseStats> Tablebase<NPawns>::Builder::run() {
+  absl::Status status = enumerate();
+  if (status.ok()) {
+    status = link();
+  }
+  if (status.ok()) {
+    status = solve();
+  }
+  if (status.ok()) {
+    status = write();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  return stats_;
+}
+
+template <uint32_t NPawns>
+template <class Fn>
+void Tablebase<NPawns>::Builder::parallelFor(uint64_t n, Fn fn) const {
+  std::atomic<uint64_t> next_chunk = 0;
+  auto run = [n, &fn, &next_chunk](uint32_t thread_idx) {
+    for (uint64_t begin = next_chunk.fetch_add(chunk_size); begin < n;
+         begin = next_chunk.fetch_add(chunk_size)) {
+      for (uint64_t i = begin; i < std::min(begin + chunk_size, n); i++) {
+        fn(thread_idx, i);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 1; t < n_threads_; t++) {
+    threads.emplace_back(run, t);
+  }
+  run(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::enumerate() {
+  positions_fd_ = ::open(positions_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                         0644);
+  if (positions_fd_ < 0) {
+    return ioError("create", positions_path_);
+  }
+
+  // Phase 1 games are only kept one layer at a time, since each move places a
+  // pawn and no game is ever repeated in a later layer.
+  std::vector<Game<NPawns>> layer = { Game<NPawns>() };
+  std::vector<Game<NPawns>> next;
+  std::vector<Game<NPawns>> phase2;
+  while (!layer.empty()) {
+    KeySet layer_keys;
+    next.clear();
+    phase2.clear();
+    expand(layer, layer_keys, next, phase2);
+    absl::Status status = appendPositions(phase2);
+    if (!status.ok()) {
+      return status;
+    }
+    std::swap(layer, next);
+  }
+
+  // The positions file doubles as the queue of the breadth-first search over
+  // phase 2 positions.
+  KeySet unused_keys;
+  for (uint64_t first = 0; first < n_positions_; first += layer.size()) {
+    absl::Status status = readPositions(
+        first, std::min(batch_size, n_positions_ - first), layer);
+    if (!status.ok()) {
+      return status;
+    }
+
+    phase2.clear();
+    expand(layer, unused_keys, next, phase2);
+    status = appendPositions(phase2);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  if (n_positions_ >= no_position) {
+    return absl::ResourceExhaustedError(absl::StrFormat(
+        "Found %u positions, more than a tablebase can index", n_positions_));
+  }
+  stats_.n_positions = n_positions_;
+  return absl::OkStatus();
+}
+
+template <uint32_t NPawns>
+void Tablebase<NPawns>::Builder::expand(
+    const std::vector<Game<NPawns>>& games, KeySet& phase1_keys,
+    std::vector<Game<NPawns>>& phase1, std::vector<Game<NPawns>>& phase2) {
+  std::vector<std::vector<Game<NPawns>>> thread_phase1(n_threads_);
+  std::vector<std::vector<Game<NPawns>>> thread_phase2(n_threads_);
+
+  parallelFor(games.size(), [this, &games, &phase1_keys, &thread_phase1,
+                             &thread_phase2](uint32_t t, uint64_t i) {
+    const Game<NPawns>& g = games[i];
+    auto add_child = [this, &phase1_keys, &thread_phase1, &thread_phase2, t](
+                         const Game<NPawns>& child) {
+      // Finished games are decided by the move into them, so the tablebase
+      // doesn't need them.
+      if (child.isFinished()) {
+        return;
+      }
+      if (child.inPhase2()) {
+        if (key_set_.insert(GameKey<NPawns>(child).hash64())) {
+          thread_phase2[t].push_back(child);
+        }
+      } else if (phase1_keys.insert(GameKey<NPawns>(child).hash64())) {
+        thread_phase1[t].push_back(child);
+      }
+    };
+
+    if (g.inPhase2()) {
+      typename Game<NPawns>::template move_list_t<P2Move> moves;
+      g.generateMoves(moves);
+      for (P2Move move : moves) {
+        add_child(Game<NPawns>(g, move));
+      }
+    } else {
+      typename Game<NPawns>::template move_list_t<P1Move> moves;
+      g.generateMoves(moves);
+      for (P1Move move : moves) {
+        add_child(Game<NPawns>(g, move));
+      }
+    }
+  });
+
+  for (uint32_t t = 0; t < n_threads_; t++) {
+    phase1.insert(phase1.end(), thread_phase1[t].begin(),
+                  thread_phase1[t].end());
+    phase2.insert(phase2.end(), thread_phase2[t].begin(),
+                  thread_phase2[t].end());
+  }
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::appendPositions(
+    const std::vector<Game<NPawns>>& games) {
+  std::vector<uint8_t> buf(games.size() * packed_size);
+  for (uint64_t i = 0; i < games.size(); i++) {
+    games[i].PackState(&buf[i * packed_size]);
+    keys_.push_back(GameKey<NPawns>(games[i]).hash64());
+  }
+
+  off_t offset = n_positions_ * packed_size;
+  for (std::size_t written = 0; written < buf.size();) {
+    ssize_t res = pwrite(positions_fd_, buf.data() + written,
+                         buf.size() - written, offset + written);
+    if (res < 0) {
+      return ioError("write", positions_path_);
+    }
+    written += res;
+  }
+  n_positions_ += games.size();
+  return absl::OkStatus();
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::readPositions(
+    uint64_t first, uint64_t n, std::vector<Game<NPawns>>& games) const {
+  std::vector<uint8_t> buf(n * packed_size);
+  off_t offset = first * packed_size;
+  for (std::size_t read = 0; read < buf.size();) {
+    ssize_t res = pread(positions_fd_, buf.data() + read, buf.size() - read,
+                        offset + read);
+    if (res <= 0) {
+      return ioError("read", positions_path_);
+    }
+    read += res;
+  }
+
+  games.clear();
+  for (uint64_t i = 0; i < n; i++) {
+    absl::StatusOr<Game<NPawns>> game =
+        Game<NPawns>::UnpackState(&buf[i * packed_size]);
+    if (!game.ok()) {
+      return game.status();
+    }
+    games.push_back(*game);
+  }
+  return absl::OkStatus();
+}
+
+template <uint32_t NPawns>
+uint32_t Tablebase<NPawns>::Builder::findPosition(uint64_t key) const {
+  auto it = std::lower_bound(sorted_keys_.begin(), sorted_keys_.end(), key);
+  if (it == sorted_keys_.end() || *it != key) {
+    return no_position;
+  }
+  return sorted_positions_[it - sorted_keys_.begin()];
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::link() {
+  const uint64_t n = n_positions_;
+
+  sorted_positions_.resize(n);
+  std::iota(sorted_positions_.begin(), sorted_positions_.end(), 0);
+  std::sort(sorted_positions_.begin(), sorted_positions_.end(),
+            [this](uint32_t p1, uint32_t p2) { return keys_[p1] < keys_[p2]; });
+  sorted_keys_.resize(n);
+  for (uint64_t i = 0; i < n; i++) {
+    sorted_keys_[i] = keys_[sorted_positions_[i]];
+  }
+  keys_.clear();
+  keys_.shrink_to_fit();
+
+  values_.reset(new std::atomic<uint16_t>[n]);
+  child_offsets_.assign(n + 1, 0);
+
+  void* map = nullptr;
+  if (n != 0) {
+    map = mmap(nullptr, n * packed_size, PROT_READ, MAP_SHARED, positions_fd_,
+               0);
+    if (map == MAP_FAILED) {
+      return ioError("map", positions_path_);
+    }
+  }
+  const uint8_t* positions = static_cast<const uint8_t*>(map);
+
+  // Count the moves of each position first, so every thread knows where to
+  // write the children of its positions.
+  std::atomic<bool> corrupt = false;
+  parallelFor(n, [this, positions, &corrupt](uint32_t, uint64_t i) {
+    absl::StatusOr<Game<NPawns>> g =
+        Game<NPawns>::UnpackState(&positions[i * packed_size]);
+    uint16_t val = 0;
+    uint64_t n_children = 0;
+    if (!g.ok()) {
+      corrupt = true;
+    } else if (g->findWinningMoveP2().has_value()) {
+      val = value(/*wins=*/true, 1);
+    } else {
+      typename Game<NPawns>::template move_list_t<P2Move> moves;
+      g->generateMoves(moves);
+      if (moves.empty()) {
+        // A player without legal moves loses.
+        val = value(/*wins=*/false, 1);
+      }
+      n_children = moves.size();
+    }
+    values_[i].store(val, std::memory_order_relaxed);
+    child_offsets_[i + 1] = n_children;
+  });
+  std::partial_sum(child_offsets_.begin(), child_offsets_.end(),
+                   child_offsets_.begin());
+  const uint64_t n_children = child_offsets_[n];
+
+  children_fd_ = ::open(children_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                        0644);
+  if (children_fd_ < 0 ||
+      ftruncate(children_fd_, n_children * sizeof(uint32_t)) != 0) {
+    if (map != nullptr) {
+      munmap(map, n * packed_size);
+    }
+    return ioError("create", children_path_);
+  }
+
+  void* children_map = nullptr;
+  if (n_children != 0) {
+    children_map = mmap(nullptr, n_children * sizeof(uint32_t),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, children_fd_, 0);
+    if (children_map == MAP_FAILED) {
+      munmap(map, n * packed_size);
+      return ioError("map", children_path_);
+    }
+  }
+  uint32_t* children = static_cast<uint32_t*>(children_map);
+
+  parallelFor(n, [this, positions, children, &corrupt](uint32_t, uint64_t i) {
+    if (child_offsets_[i] == child_offsets_[i + 1]) {
+      return;
+    }
+
+    const Game<NPawns> g =
+        *Game<NPawns>::UnpackState(&positions[i * packed_size]);
+    typename Game<NPawns>::template move_list_t<P2Move> moves;
+    g.generateMoves(moves);
+
+    uint32_t* out = children + child_offsets_[i];
+    for (P2Move move : moves) {
+      // Every unfinished child was found by enumerate().
+      uint32_t child =
+          findPosition(GameKey<NPawns>(Game<NPawns>(g, move)).hash64());
+      if (child == no_position) {
+        corrupt = true;
+      }
+      *out++ = child;
+    }
+  });
+
+  if (map != nullptr) {
+    munmap(map, n * packed_size);
+  }
+  if (children_map != nullptr) {
+    munmap(children_map, n_children * sizeof(uint32_t));
+  }
+  if (corrupt) {
+    return absl::InternalError(absl::StrFormat(
+        "Positions in %s don't match the positions found", positions_path_));
+  }
+  return absl::OkStatus();
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::solve() {
+  const uint64_t n = n_positions_;
+  const uint64_t n_children = child_offsets_[n];
+
+  void* map = nullptr;
+  if (n_children != 0) {
+    map = mmap(nullptr, n_children * sizeof(uint32_t), PROT_READ, MAP_SHARED,
+               children_fd_, 0);
+    if (map == MAP_FAILED) {
+      return ioError("map", children_path_);
+    }
+    // Every pass reads the whole file in order.
+    madvise(map, n_children * sizeof(uint32_t), MADV_SEQUENTIAL);
+  }
+  const uint32_t* children = static_cast<const uint32_t*>(map);
+
+  absl::Status status;
+  for (uint32_t distance = 2;; distance++) {
+    if (distance > max_distance) {
+      status = absl::ResourceExhaustedError(absl::StrFormat(
+          "Positions are still being decided after %u moves", max_distance));
+      break;
+    }
+
+    std::atomic<uint64_t> n_decided = 0;
+    parallelFor(n, [this, children, distance, &n_decided](uint32_t,
+                                                          uint64_t i) {
+      if (values_[i].load(std::memory_order_relaxed) != 0 ||
+          child_offsets_[i] == child_offsets_[i + 1]) {
+        return;
+      }
+
+      // Positions decided in this pass are ignored, so the order positions
+      // are visited in doesn't matter.
+      bool all_won = true;
+      for (uint64_t c = child_offsets_[i]; c < child_offsets_[i + 1]; c++) {
+        uint16_t child = values_[children[c]].load(std::memory_order_relaxed);
+        if (child == 0 || valueDistance(child) >= distance) {
+          all_won = false;
+        } else if (!valueWins(child)) {
+          values_[i].store(value(/*wins=*/true, distance),
+                           std::memory_order_relaxed);
+          n_decided.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+      }
+      if (all_won) {
+        values_[i].store(value(/*wins=*/false, distance),
+                         std::memory_order_relaxed);
+        n_decided.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+
+    if (n_decided == 0) {
+      break;
+    }
+  }
+
+  if (map != nullptr) {
+    munmap(map, n_children * sizeof(uint32_t));
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  for (uint64_t i = 0; i < n; i++) {
+    uint16_t val = values_[i].load(std::memory_order_relaxed);
+    if (val == 0) {
+      stats_.n_draws++;
+      continue;
+    }
+    if (valueWins(val)) {
+      stats_.n_wins++;
+    } else {
+      stats_.n_losses++;
+    }
+    stats_.max_distance = std::max(stats_.max_distance, valueDistance(val));
+  }
+  return absl::OkStatus();
+}
+
+template <uint32_t NPawns>
+absl::Status Tablebase<NPawns>::Builder::write() const {
+  const uint64_t n = n_positions_;
+
+  // Aim for a handful of keys per bucket.
+  uint32_t index_bits = 0;
+  while (index_bits < max_index_bits && (n >> (index_bits + 4)) != 0) {
+    index_bits++;
+  }
+
+  std::vector<uint64_t> index(indexSize(index_bits));
+  for (uint64_t bucket = 0; bucket < index.size(); bucket++) {
+    if (index_bits == 0) {
+      index[bucket] = bucket == 0 ? 0 : n;
+      continue;
+    }
+    uint64_t first_key = bucket << (64 - index_bits);
+    index[bucket] =
+        bucket == index.size() - 1
+            ? n
+            : std::lower_bound(sorted_keys_.begin(), sorted_keys_.end(),
+                               first_key) -
+                  sorted_keys_.begin();
+  }
+
+  Header header;
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.n_pawns = NPawns;
+  header.n_records = n;
+  header.index_bits = index_bits;
+  header.reserved = 0;
+
+  const std::string tmp_path = path_ + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return ioError("create", tmp_path);
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(index.data(), sizeof(uint64_t), index.size(), file) ==
+                index.size() &&
+            fwrite(sorted_keys_.data(), sizeof(uint64_t), n, file) == n;
+  for (uint64_t i = 0; ok && i < n; i++) {
+    uint16_t val =
+        values_[sorted_positions_[i]].load(std::memory_order_relaxed);
+    ok = fwrite(&val, sizeof(val), 1, file) == 1;
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    absl::Status status = ioError("write", tmp_path);
+    unlink(tmp_path.c_str());
+    return status;
+  }
+
+  if (rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    absl::Status status = ioError("rename tablebase to", path_);
+    unlink(tmp_path.c_str());
+    return status;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace onoro
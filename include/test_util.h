@@ -0,0 +1,84 @@
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/types/optional.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+#include "game_key.h"
+#include "playout.h"
+#include "transposition_table.h"
+
+namespace onoro {
+namespace test {
+
+/*
+ * Generates n game states, no two of which are symmetric to each other, by
+ * playing random moves from the start of the game, restarting whenever a game
+ * finishes. The i-th game is given a tie score of i % 16, so games found in a
+ * table can be told apart by their scores.
+ */
+template <uint32_t NPawns>
+std::vector<Game<NPawns>> genGames(uint32_t n) {
+  std::vector<Game<NPawns>> games;
+  TranspositionTable<NPawns> seen;
+  if (n == 0) {
+    return games;
+  }
+
+  forEachPlayoutPosition<NPawns>(
+      /*seed=*/0, UINT32_MAX, UINT32_MAX,
+      [n, &games, &seen](const Game<NPawns>& g, uint32_t ply) {
+        if (ply == 0 || g.isFinished() || seen.find(g).has_value()) {
+          return true;
+        }
+
+        Game<NPawns> game = g;
+        game.setScore(Score::tie(games.size() % 16));
+        seen.insert(game);
+        games.push_back(game);
+        return games.size() < n;
+      });
+
+  return games;
+}
+
+/*
+ * Finds two inequivalent games with the same canonical hash and the same player
+ * to move in their canonical views, which a table keyed by the canonical hash
+ * couldn't tell apart. Such games are too rare to find quickly with 8 pawns,
+ * but the first pair with 12 pawns is found within a few thousand playouts.
+ */
+template <uint32_t NPawns>
+absl::optional<std::pair<Game<NPawns>, Game<NPawns>>>
+findCanonicalHashCollision() {
+  // Games keyed by their canonical hash and whether black is to move in their
+  // canonical view.
+  absl::flat_hash_map<std::pair<hash_group::game_hash_t, bool>, Game<NPawns>>
+      games_by_hash;
+  absl::optional<std::pair<Game<NPawns>, Game<NPawns>>> pair;
+
+  forEachPlayoutPosition<NPawns>(
+      /*seed=*/0, /*n_playouts=*/10000, UINT32_MAX,
+      [&games_by_hash, &pair](const Game<NPawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        typename Game<NPawns>::CanonicalKey key = g.canonicalKey();
+        auto [it, inserted] = games_by_hash.emplace(
+            std::make_pair(key.hash, g.blackTurn() ^ key.color_invert), g);
+        if (!inserted && GameKey<NPawns>(it->second) != GameKey<NPawns>(g)) {
+          pair.emplace(it->second, g);
+          return false;
+        }
+        return true;
+      });
+
+  return pair;
+}
+
+}  // namespace test
+}  // namespace onoro
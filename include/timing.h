@@ -0,0 +1,15 @@
+#pragma once
+
+#include <time.h>
+
+namespace onoro {
+
+// Returns the seconds from `start` to `end`, which is negative if `end` comes
+// first.
+inline double elapsedSeconds(const struct timespec& start,
+                             const struct timespec& end) {
+  return (end.tv_sec - start.tv_sec) +
+         (((double) (end.tv_nsec - start.tv_nsec)) / 1000000000.);
+}
+
+}  // namespace onoro
@@ -1,26 +1,42 @@
 #pragma once
 
-#include <absl/container/flat_hash_set.h>
+#include <absl/container/flat_hash_map.h>
 #include <absl/status/statusor.h>
 #include <absl/strings/str_format.h>
 
 #include "game.h"
+#include "game_key.h"
 
 namespace onoro {
 
+/*
+ * A transposition table storing the table entries of games keyed by their
+ * GameKey, so all games equivalent under symmetries share one entry and are
+ * found with a single lookup. Only keys are stored, not whole games, so each
+ * entry takes a fraction of the memory of a game.
+ */
 template <uint32_t NPawns>
 class TranspositionTable {
-  using TableT =
-      absl::flat_hash_set<onoro::Game<NPawns>, onoro::GameHash<NPawns>,
-                          onoro::GameEq<NPawns>>;
-  using SymmState = typename Game<NPawns>::BoardSymmetryState;
+  using TableT = absl::flat_hash_map<GameKey<NPawns>, TableEntry>;
 
  public:
   TranspositionTable() {}
 
   absl::optional<onoro::Score> find(const onoro::Game<NPawns>& game) const {
-    SymmState s = game.calcSymmetryState();
-    SymmetryClassOpApplyAndReturn(s.symm_class, tryFindSymmetries, game, s);
+    auto it = table_.find(GameKey<NPawns>(game));
+    if (it != table_.end()) {
+      return it->second.score;
+    }
+    return {};
+  }
+
+  absl::optional<onoro::TableEntry> findEntry(
+      const onoro::Game<NPawns>& game) const {
+    auto it = table_.find(GameKey<NPawns>(game));
+    if (it != table_.end()) {
+      return it->second;
+    }
+    return {};
   }
 
   void clear() {
@@ -28,57 +44,34 @@ class TranspositionTable {
   }
 
   void insert(const onoro::Game<NPawns>& game) {
-    table_.insert(game);
+    table_.emplace(GameKey<NPawns>(game), game.getTableEntry());
   }
 
   void insert_or_assign(const onoro::Game<NPawns>& game) {
-    auto [it, inserted] = table_.insert(game);
-    if (!inserted) {
-      it->setScore(game.getScore());
-    }
+    table_.insert_or_assign(GameKey<NPawns>(game), game.getTableEntry());
   }
 
-  const TableT& table() const {
-    return table_;
+  std::size_t size() const {
+    return table_.size();
   }
 
- private:
-  template <class SymmetryClassOp>
-  absl::optional<onoro::Score> tryFindSymmetries(
-      const onoro::Game<NPawns>& game, SymmState symm_state) const {
-    typedef typename SymmetryClassOp::Group Group;
-
-    // printf("%s\n", view.game().Print().c_str());
-    onoro::GameView<NPawns> view(&game);
-
-    for (bool swap_colors : { false, true }) {
-      (void) swap_colors;
-
-      for (uint32_t op_ord = 0; op_ord < Group::order(); op_ord++) {
-        Group op(op_ord);
-        view.setOp(op);
-        // printf("hash: %s\n",
-        //        GameHash<NPawns>::printC2Hash(view.hash()).c_str());
-
-        auto it = table_.find(view);
-        if (it != table_.end()) {
-          /*printf("Found under %s (%s) (%s)!\n", op.toString().c_str(),
-                 swap_colors ? "swapped" : "not swapped",
-                 symm_state.op.toString().c_str());
-          printf("\n");*/
-          return it->getScore();
-          /*} else {
-            printf("Didn't find under %s (%s) (%s)!\n", op.toString().c_str(),
-                   swap_colors ? "swapped" : "not swapped",
-                   symm_state.op.toString().c_str());*/
-        }
+  /*
+   * Calls `cb` with a game equivalent to each game in the table, with its
+   * table entry set, until `cb` returns false. Returns false if any call to
+   * `cb` returned false. Table moves don't depend on which equivalent game they
+   * were made from, so the best move of the entry is found from the game `cb`
+   * is called with as the same move it was from the inserted game.
+   */
+  template <class CallbackFn>
+  bool forEachGame(CallbackFn cb) const {
+    for (const auto& [key, entry] : table_) {
+      Game<NPawns> game = key.toGame();
+      game.setTableEntry(entry);
+      if (!cb(game)) {
+        return false;
       }
-
-      view.invertColors();
     }
-    // printf("\n");
-
-    return {};
+    return true;
   }
 
  private:
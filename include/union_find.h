@@ -2,15 +2,17 @@
 
 #include <stdint.h>
 
-template <typename T>
-class UnionFind {
+#include <array>
+#include <limits>
+
+/*
+ * The operations shared by UnionFind and StaticUnionFind, which only differ in
+ * where they keep their buffer of parent indices. Derived classes provide
+ * buffer(), returning a pointer to the start of that buffer.
+ */
+template <class Derived, typename T>
+class UnionFindBase {
  public:
-  UnionFind(uint32_t capacity);
-  ~UnionFind();
-
-  UnionFind(const UnionFind&) = delete;
-  UnionFind(UnionFind&&) = default;
-
   uint32_t GetNumGroups() const;
 
   uint32_t GetRoot(uint32_t idx);
@@ -21,43 +23,35 @@ class UnionFind {
   // Unions the two elements, returning the new parent of both.
   uint32_t Union(uint32_t a, uint32_t b);
 
- private:
-  T* buffer_;
-  uint32_t buffer_size_;
+ protected:
+  explicit constexpr UnionFindBase(uint32_t n_groups) : n_groups_(n_groups) {}
+
   uint32_t n_groups_;
-};
 
-template <typename T>
-UnionFind<T>::UnionFind(uint32_t capacity)
-    : buffer_size_(capacity), n_groups_(capacity) {
-  buffer_ = new T[capacity];
-  for (uint32_t i = 0; i < capacity; i++) {
-    buffer_[i] = i;
+ private:
+  T* buffer() {
+    return static_cast<Derived*>(this)->buffer();
   }
-}
-
-template <typename T>
-UnionFind<T>::~UnionFind() {
-  delete[] buffer_;
-}
+};
 
-template <typename T>
-uint32_t UnionFind<T>::GetNumGroups() const {
+template <class Derived, typename T>
+uint32_t UnionFindBase<Derived, T>::GetNumGroups() const {
   return n_groups_;
 }
 
-template <typename T>
-uint32_t UnionFind<T>::GetRoot(uint32_t idx) {
-  uint32_t parent = buffer_[idx];
+template <class Derived, typename T>
+uint32_t UnionFindBase<Derived, T>::GetRoot(uint32_t idx) {
+  T* buffer = this->buffer();
+  uint32_t parent = buffer[idx];
 
   // The common case, after the tree has been flattened.
-  if (buffer_[parent] == parent) {
+  if (buffer[parent] == parent) {
     return parent;
   }
 
   while (parent != idx) {
-    uint32_t pp = buffer_[parent];
-    buffer_[idx] = pp;
+    uint32_t pp = buffer[parent];
+    buffer[idx] = static_cast<T>(pp);
 
     idx = parent;
     parent = pp;
@@ -66,20 +60,103 @@ uint32_t UnionFind<T>::GetRoot(uint32_t idx) {
   return idx;
 }
 
-template <typename T>
-uint32_t UnionFind<T>::Find(uint32_t idx) {
+template <class Derived, typename T>
+uint32_t UnionFindBase<Derived, T>::Find(uint32_t idx) {
   return GetRoot(idx);
 }
 
-template <typename T>
-uint32_t UnionFind<T>::Union(uint32_t a, uint32_t b) {
+template <class Derived, typename T>
+uint32_t UnionFindBase<Derived, T>::Union(uint32_t a, uint32_t b) {
   uint32_t ra = GetRoot(a);
   uint32_t rb = GetRoot(b);
 
   if (ra != rb) {
-    buffer_[rb] = ra;
+    buffer()[rb] = static_cast<T>(ra);
     n_groups_--;
   }
 
   return ra;
 }
+
+template <typename T>
+class UnionFind : public UnionFindBase<UnionFind<T>, T> {
+ public:
+  UnionFind(uint32_t capacity);
+  ~UnionFind();
+
+  UnionFind(const UnionFind&) = delete;
+  UnionFind(UnionFind&&) = default;
+
+ private:
+  friend class UnionFindBase<UnionFind<T>, T>;
+
+  T* buffer() {
+    return buffer_;
+  }
+
+  T* buffer_;
+  uint32_t buffer_size_;
+};
+
+template <typename T>
+UnionFind<T>::UnionFind(uint32_t capacity)
+    : UnionFindBase<UnionFind<T>, T>(capacity), buffer_size_(capacity) {
+  buffer_ = new T[capacity];
+  for (uint32_t i = 0; i < capacity; i++) {
+    buffer_[i] = i;
+  }
+}
+
+template <typename T>
+UnionFind<T>::~UnionFind() {
+  delete[] buffer_;
+}
+
+/*
+ * A UnionFind over a fixed number of elements, stored inline so it never
+ * allocates. Elements are indexes into the buffer, so T only has to hold
+ * Capacity - 1.
+ */
+template <typename T, uint32_t Capacity>
+class StaticUnionFind : public UnionFindBase<StaticUnionFind<T, Capacity>, T> {
+  static_assert(Capacity - 1 <= std::numeric_limits<T>::max(),
+                "T is too small to hold every element of the union find");
+
+ public:
+  constexpr StaticUnionFind();
+
+  // Splits every element back into its own set, so one instance can be reused
+  // without being reconstructed.
+  void Reset();
+
+ private:
+  friend class UnionFindBase<StaticUnionFind<T, Capacity>, T>;
+
+  static constexpr std::array<T, Capacity> genIdentity() {
+    std::array<T, Capacity> identity{};
+    for (uint32_t i = 0; i < Capacity; i++) {
+      identity[i] = static_cast<T>(i);
+    }
+    return identity;
+  }
+
+  // The buffer of a union find where every element is in its own set.
+  static constexpr std::array<T, Capacity> identity_ = genIdentity();
+
+  T* buffer() {
+    return buffer_.data();
+  }
+
+  std::array<T, Capacity> buffer_;
+};
+
+template <typename T, uint32_t Capacity>
+constexpr StaticUnionFind<T, Capacity>::StaticUnionFind()
+    : UnionFindBase<StaticUnionFind<T, Capacity>, T>(Capacity),
+      buffer_(identity_) {}
+
+template <typename T, uint32_t Capacity>
+void StaticUnionFind<T, Capacity>::Reset() {
+  buffer_ = identity_;
+  this->n_groups_ = Capacity;
+}
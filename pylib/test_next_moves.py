@@ -11,6 +11,11 @@ import test_next_moves_cc
 
 Pawn = GameState.Pawn
 
+# The size of a packed game with 16 pawns, and an upper bound on the number of
+# children of any game.
+PACKED_SIZE = 17
+MAX_CHILDREN = 8 * (16 * 16 - 16)
+
 
 def gen_starting_game(n_pawns: int) -> Onoro:
   pawns = (
@@ -63,6 +68,23 @@ def get_next_moves_cc(game: Onoro) -> Iterable[Onoro]:
       print(deserialize(g, game.num_pawns, check_errors=False).__repr__(check_errors=False))
       raise e
 
+def get_next_moves_cc_packed(game: Onoro) -> Iterable[Onoro]:
+  states = GameStates(state=[game.serialize()])
+  packed = test_next_moves_cc.pack_states(states.SerializeToString())
+
+  children = bytearray(PACKED_SIZE * MAX_CHILDREN)
+  parents = bytearray(4 * MAX_CHILDREN)
+  moves = bytearray(2 * MAX_CHILDREN)
+  n_expanded, n_children = test_next_moves_cc.gen_next_moves_packed(
+      packed, children, parents, moves)
+  assert(n_expanded == 1)
+
+  gs = GameStates()
+  gs.ParseFromString(test_next_moves_cc.unpack_states(
+      bytes(children[:n_children * PACKED_SIZE])))
+  for g in gs.state:
+    yield deserialize(g, game.num_pawns)
+
 def get_next_moves_py(game: Onoro) -> Iterable[Onoro]:
   for move in game.Moves():
     g = copy.deepcopy(game)
@@ -80,6 +102,12 @@ def test_next_moves(game: Onoro) -> bool:
     assert(g not in s_py)
     s_py.add(g)
 
+  s_packed = set(get_next_moves_cc_packed(game))
+  if s_packed != s_cc:
+    print(game)
+    print('Packed moves differ from the moves of gen_next_moves')
+    return False
+
   cc_only = s_cc - s_py
   py_only = s_py - s_cc
 
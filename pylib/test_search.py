@@ -0,0 +1,135 @@
+from __future__ import annotations
+
+import copy
+import random
+from concurrent.futures import ThreadPoolExecutor
+from typing import List, Tuple
+
+from onoro import Onoro, deserialize
+from game_state_pb2 import GameState
+import onoro_search
+
+Pawn = GameState.Pawn
+
+NUM_PAWNS = 16
+
+
+def gen_starting_game(num_pawns: int) -> Onoro:
+  pawns = (
+      Pawn(x=1, y=1, black=True),
+      Pawn(x=1, y=2, black=False),
+      Pawn(x=2, y=2, black=True),
+    )
+  return Onoro(num_pawns, pawns, False)
+
+
+def gen_positions(n: int) -> List[Onoro]:
+  game = gen_starting_game(NUM_PAWNS)
+  positions = []
+  while len(positions) < n:
+    if game.HasWinner():
+      game = gen_starting_game(NUM_PAWNS)
+    positions.append(copy.deepcopy(game))
+    game.MakeMove(random.choice(list(game.Moves())))
+  return positions
+
+
+def search(searcher: onoro_search.Searcher, game: Onoro,
+           depth: int) -> Tuple[Onoro, int, str]:
+  state_bytes = bytes(game.serialize().SerializeToString())
+  next_state, outcome, score, _ = searcher.search(state_bytes, depth)
+
+  gs = GameState()
+  gs.ParseFromString(next_state)
+  return deserialize(gs, game.num_pawns), outcome, score
+
+
+def check_move(game: Onoro, next_game: Onoro) -> bool:
+  for move in game.Moves():
+    g = copy.deepcopy(game)
+    g.MakeMove(move)
+    if g == next_game:
+      return True
+
+  print(game)
+  print('Search returned a move which is not legal:')
+  print(next_game.__repr__(diff=game))
+  return False
+
+
+def test_concurrent_searches(positions: List[Onoro], depth: int) -> bool:
+  '''
+  Searches every position on its own handle, first one at a time and then from
+  a thread pool, and checks that the results are the same. Searches on
+  different handles share nothing, so running them concurrently can't change
+  their results.
+  '''
+  expected = [search(onoro_search.Searcher(), game, depth)
+              for game in positions]
+  for game, (next_game, _, _) in zip(positions, expected):
+    if not check_move(game, next_game):
+      return False
+
+  with ThreadPoolExecutor(max_workers=4) as executor:
+    results = list(executor.map(
+        lambda game: search(onoro_search.Searcher(), game, depth), positions))
+
+  for game, res, exp in zip(positions, results, expected):
+    if res[1:] != exp[1:]:
+      print(game)
+      print('Concurrent search found %s, but found %s alone' % (res[2], exp[2]))
+      return False
+  return True
+
+
+def test_persistent_table(positions: List[Onoro], depth: int) -> bool:
+  '''
+  Searches every position twice on one handle, checking that its table keeps
+  the positions of previous searches and doesn't change their outcomes.
+  '''
+  searcher = onoro_search.Searcher()
+  for game in positions:
+    _, outcome, _ = search(searcher, game, depth)
+    size = searcher.table_size()
+    if size == 0:
+      print('Table is empty after a search')
+      return False
+
+    _, outcome2, _ = search(searcher, game, depth)
+    if outcome2 != outcome:
+      print(game)
+      print('Searching again changed the outcome from %d to %d' %
+            (outcome, outcome2))
+      return False
+
+  searcher.clear()
+  return searcher.table_size() == 0
+
+
+def test_zero_depth(game: Onoro) -> bool:
+  '''
+  Checks that searches zero moves deep are rejected rather than reporting a
+  loss.
+  '''
+  state_bytes = bytes(game.serialize().SerializeToString())
+  try:
+    onoro_search.Searcher().search(state_bytes, 0)
+  except ValueError:
+    return True
+
+  print('Search with depth 0 was not rejected')
+  return False
+
+
+def main():
+  random.seed(3)
+  positions = gen_positions(24)
+
+  res = (test_concurrent_searches(positions, 5) and
+         test_persistent_table(positions, 4) and
+         test_zero_depth(positions[0]))
+  print(res)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,52 @@
+
+#include <cstdint>
+#include <vector>
+
+#include "bench_util.h"
+#include "onoro.h"
+
+static constexpr uint32_t n_positions = 4096;
+
+template <uint32_t NPawns>
+static void benchMoveGen() {
+  const onoro::bench::Corpus<NPawns> corpus =
+      onoro::bench::genCorpus<NPawns>(n_positions);
+
+  onoro::bench::run("forEachMove", NPawns, corpus.phase1.size(), [&corpus]() {
+    uint64_t n_moves = 0;
+    for (const onoro::Game<NPawns>& g : corpus.phase1) {
+      g.forEachMove([&n_moves](onoro::P1Move) {
+        n_moves++;
+        return true;
+      });
+    }
+    return n_moves;
+  });
+
+  onoro::bench::run("forEachMoveP2", NPawns, corpus.phase2.size(),
+                    [&corpus]() {
+                      uint64_t n_moves = 0;
+                      for (const onoro::Game<NPawns>& g : corpus.phase2) {
+                        g.forEachMoveP2([&n_moves](onoro::P2Move) {
+                          n_moves++;
+                          return true;
+                        });
+                      }
+                      return n_moves;
+                    });
+
+  onoro::bench::run("checkWin", NPawns, corpus.last_moves.size(), [&corpus]() {
+    uint64_t n_wins = 0;
+    for (const auto& [g, last_move] : corpus.last_moves) {
+      n_wins += g.checkWin(last_move);
+    }
+    return n_wins;
+  });
+}
+
+int main(int argc, char* argv[]) {
+  benchMoveGen<8>();
+  benchMoveGen<12>();
+  benchMoveGen<16>();
+  return 0;
+}
@@ -0,0 +1,101 @@
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "game_eq.h"
+#include "game_hash.h"
+#include "onoro.h"
+
+static constexpr uint32_t n_positions = 4096;
+
+/*
+ * Benchmarks comparing each of `views` with the equal game of `copy_views`,
+ * and with the game after that one.
+ */
+template <uint32_t NPawns>
+static void benchEq(const std::string& name,
+                    const std::vector<onoro::GameView<NPawns>>& views,
+                    const std::vector<onoro::GameView<NPawns>>& copy_views) {
+  onoro::bench::run(name + "/equal", NPawns, views.size(),
+                    [&views, &copy_views]() {
+                      uint64_t n_eq = 0;
+                      for (uint32_t i = 0; i < views.size(); i++) {
+                        n_eq += onoro::GameEq<NPawns>()(views[i],
+                                                        copy_views[i]);
+                      }
+                      return n_eq;
+                    });
+
+  onoro::bench::run(name + "/different", NPawns, views.size(),
+                    [&views, &copy_views]() {
+                      uint64_t n_eq = 0;
+                      for (uint32_t i = 0; i < views.size(); i++) {
+                        n_eq += onoro::GameEq<NPawns>()(
+                            views[i], copy_views[(i + 1) % views.size()]);
+                      }
+                      return n_eq;
+                    });
+}
+
+template <uint32_t NPawns>
+static void benchSymmetries() {
+  const onoro::bench::Corpus<NPawns> corpus =
+      onoro::bench::genCorpus<NPawns>(n_positions);
+
+  std::vector<onoro::Game<NPawns>> games = corpus.phase1;
+  games.insert(games.end(), corpus.phase2.begin(), corpus.phase2.end());
+  // Copies of every game, so equal games can be compared without comparing a
+  // game with itself.
+  const std::vector<onoro::Game<NPawns>> copies = games;
+
+  onoro::bench::run("GameHash::calcHash", NPawns, games.size(), [&games]() {
+    uint64_t sum = 0;
+    for (const onoro::Game<NPawns>& g : games) {
+      sum += onoro::GameHash<NPawns>::calcHash(g);
+    }
+    return sum;
+  });
+
+  onoro::bench::run("calcSymmetryState", NPawns, games.size(), [&games]() {
+    uint64_t sum = 0;
+    for (const onoro::Game<NPawns>& g : games) {
+      typename onoro::Game<NPawns>::BoardSymmetryState s =
+          g.calcSymmetryState();
+      sum += s.op.ordinal() + static_cast<uint64_t>(s.symm_class);
+    }
+    return sum;
+  });
+
+  // Compare the canonical views of games, which is how tables compare games.
+  std::vector<onoro::GameView<NPawns>> views;
+  std::vector<onoro::GameView<NPawns>> copy_views;
+  for (uint32_t i = 0; i < games.size(); i++) {
+    views.emplace_back(&games[i], games[i].canonicalKey());
+    copy_views.emplace_back(&copies[i], copies[i].canonicalKey());
+  }
+
+  benchEq<NPawns>("GameEq::operator()", views, copy_views);
+
+  // Games in the trivial symmetry class make up most table probes, and take
+  // their own path through GameEq.
+  std::vector<onoro::GameView<NPawns>> trivial_views;
+  std::vector<onoro::GameView<NPawns>> trivial_copy_views;
+  for (uint32_t i = 0; i < games.size(); i++) {
+    if (games[i].calcSymmetryState().symm_class ==
+        onoro::SymmetryClass::TRIVIAL) {
+      trivial_views.push_back(views[i]);
+      trivial_copy_views.push_back(copy_views[i]);
+    }
+  }
+  benchEq<NPawns>("GameEq::operator()/trivial", trivial_views,
+                  trivial_copy_views);
+}
+
+int main(int argc, char* argv[]) {
+  benchSymmetries<8>();
+  benchSymmetries<12>();
+  benchSymmetries<16>();
+  return 0;
+}
@@ -0,0 +1,51 @@
+
+#include <cstdint>
+#include <vector>
+
+#include "bench_util.h"
+#include "onoro.h"
+#include "transposition_table.h"
+
+static constexpr uint32_t n_positions = 4096;
+
+template <uint32_t NPawns>
+static void benchTranspositionTable() {
+  const onoro::bench::Corpus<NPawns> corpus =
+      onoro::bench::genCorpus<NPawns>(n_positions);
+
+  std::vector<onoro::Game<NPawns>> games = corpus.phase1;
+  games.insert(games.end(), corpus.phase2.begin(), corpus.phase2.end());
+
+  // Each pass starts from an empty table, so this includes the cost of growing
+  // the table.
+  onoro::TranspositionTable<NPawns> table;
+  onoro::bench::run("TranspositionTable::insert_or_assign", NPawns,
+                    games.size(), [&games, &table]() {
+                      table.clear();
+                      for (const onoro::Game<NPawns>& g : games) {
+                        table.insert_or_assign(g);
+                      }
+                      return table.size();
+                    });
+
+  // Fill the table with every other game, so lookups both hit and miss.
+  table.clear();
+  for (uint32_t i = 0; i < games.size(); i += 2) {
+    table.insert_or_assign(games[i]);
+  }
+  onoro::bench::run("TranspositionTable::find", NPawns, games.size(),
+                    [&games, &table]() {
+                      uint64_t n_found = 0;
+                      for (const onoro::Game<NPawns>& g : games) {
+                        n_found += table.find(g).has_value();
+                      }
+                      return n_found;
+                    });
+}
+
+int main(int argc, char* argv[]) {
+  benchTranspositionTable<8>();
+  benchTranspositionTable<12>();
+  benchTranspositionTable<16>();
+  return 0;
+}
@@ -1,19 +1,128 @@
 
+#include <absl/container/flat_hash_set.h>
+#include <absl/strings/str_format.h>
+#include <absl/strings/string_view.h>
 #include <absl/types/optional.h>
+#include <fcntl.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
 #include <unistd.h>
 #include <utils/fun/print_csi.h>
 
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "concurrent_transposition_table.h"
+#include "fixed_transposition_table.h"
 #include "game.h"
 #include "game_eq.h"
 #include "game_hash.h"
+#include "game_key.h"
 #include "game_view.h"
+#include "mcts.h"
+#include "move_order.h"
+#include "opening_book.h"
+#include "perft.h"
+#include "search.h"
+#include "search_stats.h"
+#include "tablebase.h"
+#include "timing.h"
 #include "transposition_table.h"
 
 ABSL_FLAG(uint32_t, depth, 8, "Search depth to test to");
 ABSL_FLAG(bool, from_stdin, false,
-          "If set, reads a game state proto from stdin.");
+          "If set, reads positions from stdin instead of playing out a game. "
+          "With --perft, --split_depth or --merge_books, reads a single "
+          "GameState proto. Otherwise, reads a stream of length-delimited "
+          "GameStates protos and solves every position to --depth on "
+          "--threads threads sharing one table, printing a line of JSON for "
+          "each position as soon as it is solved.");
+ABSL_FLAG(uint32_t, threads, 1,
+          "Number of search threads to use. If greater than 1, all threads "
+          "search the root position and share one transposition table.");
+ABSL_FLAG(uint32_t, tt_mb, 0,
+          "If nonzero, uses a fixed-size transposition table with this many "
+          "megabytes of memory, instead of a table which grows without bound.");
+ABSL_FLAG(uint32_t, movetime_ms, 0,
+          "If nonzero, searches each move with iterative deepening, going "
+          "one move deeper at a time until --depth or until this many "
+          "milliseconds have passed.");
+ABSL_FLAG(bool, move_ordering, true,
+          "If set, orders moves by threats, killer moves and history. "
+          "Otherwise, only the best move stored in the table is moved first.");
+ABSL_FLAG(uint32_t, perft, 0,
+          "If nonzero, counts the games reached after this many moves from the "
+          "start position, or the position read with --from_stdin, instead of "
+          "playing out a game. Root moves are split between --threads "
+          "threads.");
+ABSL_FLAG(std::string, book, "",
+          "If set, the path of an opening book of searched positions, which "
+          "is probed for each searched position before the table.");
+ABSL_FLAG(std::string, write_book, "",
+          "If set, writes every position in the table to an opening book at "
+          "this path at the end of the playout or --from_stdin batch, along "
+          "with the positions of --book. Not supported with --tt_mb. With "
+          "--merge_books, the path of the merged book.");
+ABSL_FLAG(uint32_t, split_depth, 0,
+          "If nonzero, splits the start position, or the position read with "
+          "--from_stdin, into the distinct positions reached after this many "
+          "moves, for solving on separate machines. The positions are dealt "
+          "out to --split_workers files named --split_out.<i>, which each "
+          "worker solves to --depth with --from_stdin, writing its table with "
+          "--write_book. With --merge_books, the depth the merged books were "
+          "split at, which backs up the score of the split position from "
+          "them.");
+ABSL_FLAG(uint32_t, split_workers, 1,
+          "The number of workers to split positions between with "
+          "--split_depth.");
+ABSL_FLAG(std::string, split_out, "split",
+          "The path prefix of the position files written by --split_depth.");
+ABSL_FLAG(std::vector<std::string>, merge_books, {},
+          "If set, a comma separated list of opening books, such as the "
+          "books written by the workers of a --split_depth solve, to merge "
+          "into the book at --write_book. Fails if two books have "
+          "conflicting exact scores for a position. With --split_depth, also "
+          "backs up the score and best move of the split position, the start "
+          "position or the position read with --from_stdin, by searching it "
+          "to --split_depth plus --depth moves on top of the merged book, and "
+          "adds the positions searched to the merged book.");
+ABSL_FLAG(std::string, tt_huge_pages, "none",
+          "How to back the table of --tt_mb with huge pages, one of "
+          "\"none\", \"transparent\" (madvise) or \"explicit\" (MAP_HUGETLB, "
+          "falling back to transparent).");
+ABSL_FLAG(bool, tt_numa_interleave, false,
+          "If set, interleaves the table of --tt_mb across all NUMA nodes. "
+          "Otherwise, the table is split into an equal slice for each of "
+          "the --threads threads, and each slice is first touched from a "
+          "thread pinned to one of the nodes in turn, placing it there.");
+ABSL_FLAG(uint64_t, mcts_playouts, 0,
+          "If nonzero, plays out the game with Monte-Carlo tree search, "
+          "running this many random playouts for each move on --threads "
+          "threads, instead of searching to --depth.");
+ABSL_FLAG(uint32_t, mcts_nodes, 1u << 20,
+          "The maximum number of nodes in the tree of each --mcts_playouts "
+          "search.");
+ABSL_FLAG(std::string, tablebase, "",
+          "If set, the path of a tablebase of solved phase 2 positions, which "
+          "is probed for each searched position before --book and the table.");
+ABSL_FLAG(std::string, build_tablebase, "",
+          "If set, solves every phase 2 position of games with "
+          "--tablebase_pawns pawns on --threads threads, writing the "
+          "tablebase to this path instead of playing out a game.");
+ABSL_FLAG(uint32_t, tablebase_pawns, 8,
+          "The number of pawns of the games solved by --build_tablebase, "
+          "either 8 or the number of pawns of played out games.");
 
 template <uint32_t NPawns, typename Hash>
 bool onoro::Game<NPawns, Hash>::operator==(
@@ -23,20 +132,17 @@ bool onoro::Game<NPawns, Hash>::operator==(
 }
 
 static constexpr uint32_t n_pawns = 12;
-static uint64_t g_n_moves = 0;
-static uint64_t g_n_misses = 0;
-static uint64_t g_n_hits = 0;
+
+// The opening book given by --book, if there is one.
+static const onoro::OpeningBook<n_pawns>* g_book = nullptr;
+// The tablebase given by --tablebase, if there is one.
+static const onoro::Tablebase<n_pawns>* g_tablebase = nullptr;
 
 using namespace onoro;
 using namespace onoro::hash_group;
 
 void TestUnionFind();
 
-static double timespec_diff(struct timespec* start, struct timespec* end) {
-  return (end->tv_sec - start->tv_sec) +
-         (((double) (end->tv_nsec - start->tv_nsec)) / 1000000000.);
-}
-
 template <uint32_t NPawns>
 bool verifySerializesToSelf(const onoro::Game<n_pawns>& g) {
   auto s = g.SerializeState();
@@ -57,34 +163,19 @@ bool verifySerializesToSelf(const onoro::Game<n_pawns>& g) {
 }
 
 static int benchmark() {
-  srand(0);
+  onoro::SplitMix64 rng(0);
   onoro::Game<n_pawns> g;
 
   static constexpr uint32_t n_moves = 600000;
 
   for (uint32_t i = 0; i < n_pawns - 3; i++) {
-    uint32_t move_cnt = 0;
-    g.forEachMove([&move_cnt](onoro::P1Move move) {
-      move_cnt++;
-      return true;
-    });
-
-    if (move_cnt == 0) {
+    absl::optional<onoro::P1Move> move =
+        onoro::randomMove<onoro::P1Move>(g, rng);
+    if (!move.has_value()) {
       printf("no legal moves!\n");
       return -1;
     }
-
-    int which = rand() % move_cnt;
-    g.forEachMove([&g, &which](onoro::P1Move move) {
-      if (which == 0) {
-        onoro::Game<n_pawns> g2(g, move);
-        g = std::move(g2);
-        return false;
-      } else {
-        which--;
-        return true;
-      }
-    });
+    g.makeMove(*move);
 
     if (g.isFinished()) {
       printf("%s\n", g.Print().c_str());
@@ -98,286 +189,658 @@ static int benchmark() {
 
   uint32_t i;
   for (i = 0; i < n_moves; i++) {
-    int move_cnt = 0;
-    g.forEachMoveP2([&move_cnt](onoro::P2Move move) {
-      move_cnt++;
-      return true;
-    });
-
-    if (move_cnt == 0) {
+    absl::optional<onoro::P2Move> move =
+        onoro::randomMove<onoro::P2Move>(g, rng);
+    if (!move.has_value()) {
       printf("Player won by no legal moves\n");
       printf("%s\n", g.Print().c_str());
       break;
     }
-
-    int which = rand() % move_cnt;
-    g.forEachMoveP2([&g, &which](onoro::P2Move move) {
-      if (which == 0) {
-        onoro::Game<n_pawns> g2(g, move);
-        g = std::move(g2);
-
-        /*
-        std::ostringstream ostr;
-        if (i != 0) {
-          ostr << CSI_CHA(0);
-          for (uint32_t j = 0; j < n_pawns; j++) {
-            ostr << CSI_CUU(1) CSI_EL(CSI_CURSOR_ALL);
-          }
-        }
-        printf("%s%s\n", ostr.str().c_str(), g.Print().c_str());
-        usleep(1000);
-        */
-        return false;
-      } else {
-        which--;
-        return true;
-      }
-    });
+    g.makeMove(*move);
   }
   clock_gettime(CLOCK_MONOTONIC, &end);
 
-  printf("Did %u moves in %f s\n", i, timespec_diff(&start, &end));
-  printf("%f moves/sec\n", i / timespec_diff(&start, &end));
+  printf("Did %u moves in %f s\n", i, elapsedSeconds(start, end));
+  printf("%f moves/sec\n", i / elapsedSeconds(start, end));
 
   return 0;
 }
 
+static std::string moveString(const onoro::Game<n_pawns>& g,
+                              onoro::P1Move move) {
+  return absl::StrFormat("(%d, %d)", move.loc.x(), move.loc.y());
+}
+
+static std::string moveString(const onoro::Game<n_pawns>& g,
+                              onoro::P2Move move) {
+  onoro::idx_t from = g.idxAt(move.from_idx);
+  return absl::StrFormat("(%d, %d) from (%d, %d)", move.to.x(), move.to.y(),
+                         from.x(), from.y());
+}
+
 /*
- * Returns a chosen move along with the expected outcome, in terms of the
- * player to go. I.e., +1 = current player wins, 0 = tie, -1 = current player
- * loses.
+ * A subtree of a perft run, counting the games reached after `depth` more
+ * moves from `game`, which was reached through the root move `root_move`.
  */
-template <uint32_t NPawns, class MoveClass>
-static std::pair<int32_t, MoveClass> findMoveAB(const onoro::Game<NPawns>& g,
-                                                int depth, int32_t alpha = -3,
-                                                int32_t beta = 3) {
-  int32_t best_score = -2;
-  MoveClass best_move;
-
-  if (!MoveClass::forEachMoveFn(g,
-                                [&g, &best_move, &best_score](MoveClass move) {
-                                  onoro::Game<NPawns> g2(g, move);
-                                  if (g2.isFinished()) {
-                                    best_score = 1;
-                                    best_move = move;
-                                    return false;
-                                  }
-                                  return true;
-                                })) {
-    return { best_score, best_move };
-  }
-
-  MoveClass::forEachMoveFn(g, [&g, &best_move, &best_score, depth, &alpha,
-                               beta](MoveClass move) {
-    onoro::Game<NPawns> g2(g, move);
-    g_n_moves++;
-    int32_t score;
-
-    // If this move finished the game, it means playing it made us win.
-    if (g2.isFinished()) {
-      score = 1;
-    } else {
-      if (depth > 0) {
-        int32_t _score;
-        if (std::is_same<MoveClass, onoro::P2Move>::value || g2.inPhase2()) {
-          _score =
-              findMoveAB<NPawns, onoro::P2Move>(g2, depth - 1, -beta, -alpha)
-                  .first;
-        } else {
-          _score =
-              findMoveAB<NPawns, onoro::P1Move>(g2, depth - 1, -beta, -alpha)
-                  .first;
-        }
-        score = std::min(-_score, 1);
-      } else {
-        score = 0;
+struct PerftTask {
+  uint32_t root_move;
+  onoro::Game<n_pawns> game;
+  uint32_t depth;
+};
+
+// Perft keeps splitting subtrees until there are at least this many per
+// thread, so threads stay busy even when some subtrees are much larger than
+// others.
+static constexpr uint32_t perft_tasks_per_thread = 8;
+
+/*
+ * Splits each task of `tasks` into a task for each of its moves, leaving
+ * tasks which are only one move deep as they are.
+ */
+static std::vector<PerftTask> splitPerftTasks(
+    const std::vector<PerftTask>& tasks) {
+  std::vector<PerftTask> split;
+  for (const PerftTask& task : tasks) {
+    if (task.depth <= 1) {
+      split.push_back(task);
+      continue;
+    }
+
+    auto add_child = [&task, &split](auto move) {
+      onoro::Game<n_pawns> child(task.game, move);
+      // Finished games have no moves, so reach no games after `depth` moves.
+      if (!child.isFinished()) {
+        split.push_back({ task.root_move, child, task.depth - 1 });
       }
+      return true;
+    };
+    if (task.game.inPhase2()) {
+      task.game.forEachMoveP2(add_child);
+    } else {
+      task.game.forEachMove(add_child);
     }
+  }
+  return split;
+}
 
-    if (score > best_score) {
-      best_move = move;
-      best_score = score;
+/*
+ * Runs perft from `g` to `depth`, printing the number of games reached after
+ * each root move. The tree is split into subtrees which are handed out to
+ * `n_threads` threads one at a time.
+ */
+template <class MoveClass>
+static int runPerft(const onoro::Game<n_pawns>& g, uint32_t depth,
+                    uint32_t n_threads) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-      if (best_score == 1 || best_score >= beta) {
-        return false;
+  typename onoro::Game<n_pawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+
+  std::vector<uint64_t> n_leaves(moves.size(), 0);
+  std::vector<PerftTask> tasks;
+  if (depth != 0) {
+    for (uint32_t i = 0; i < moves.size(); i++) {
+      onoro::Game<n_pawns> child(g, moves[i]);
+      if (depth == 1) {
+        n_leaves[i] = 1;
+      } else if (!child.isFinished()) {
+        tasks.push_back({ i, child, depth - 1 });
       }
+    }
+  }
 
-      alpha = std::max(alpha, best_score);
+  while (tasks.size() < perft_tasks_per_thread * n_threads) {
+    std::vector<PerftTask> split = splitPerftTasks(tasks);
+    if (split.size() == tasks.size()) {
+      break;
     }
-    return true;
-  });
+    tasks = std::move(split);
+  }
 
-  return { best_score, best_move };
+  std::vector<uint64_t> task_leaves(tasks.size(), 0);
+  std::atomic<uint32_t> next_task = 0;
+  auto run_thread = [&tasks, &task_leaves, &next_task]() {
+    for (uint32_t i = next_task++; i < tasks.size(); i = next_task++) {
+      onoro::Game<n_pawns>& game = tasks[i].game;
+      task_leaves[i] =
+          game.inPhase2()
+              ? onoro::perft<n_pawns, onoro::P2Move>(game, tasks[i].depth)
+              : onoro::perft<n_pawns, onoro::P1Move>(game, tasks[i].depth);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 1; t < n_threads; t++) {
+    threads.emplace_back(run_thread);
+  }
+  run_thread();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (uint32_t i = 0; i < tasks.size(); i++) {
+    n_leaves[tasks[i].root_move] += task_leaves[i];
+  }
+
+  uint64_t total = depth == 0 ? 1 : 0;
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    printf("%s: %llu\n", moveString(g, moves[i]).c_str(), n_leaves[i]);
+    total += n_leaves[i];
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double time = elapsedSeconds(start, end);
+  printf("Perft %u: %llu games in %lf s (%f games/sec)\n", depth, total, time,
+         total / time);
+  return 0;
 }
 
-template <uint32_t NPawns, class MoveClass>
-static std::pair<absl::optional<onoro::Score>, MoveClass> findMove(
-    const onoro::Game<NPawns>& g, onoro::TranspositionTable<NPawns>& m,
-    uint32_t depth) {
-  absl::optional<onoro::Score> best_score;
-  MoveClass best_move;
+/*
+ * Returns the position read with --from_stdin as a single GameState proto, or
+ * the start position without --from_stdin.
+ */
+static absl::StatusOr<onoro::Game<n_pawns>> readRootGame() {
+  if (!absl::GetFlag(FLAGS_from_stdin)) {
+    return onoro::Game<n_pawns>();
+  }
+  onoro::proto::GameState state;
+  if (!state.ParseFromIstream(&std::cin)) {
+    return absl::InvalidArgumentError(
+        "Failed to parse a game state from stdin");
+  }
+  return onoro::Game<n_pawns>::LoadState(state);
+}
 
+/*
+ * Collects the positions reached after exactly `depth` moves from `g` into
+ * `positions`, skipping finished games. Positions equivalent under symmetries
+ * to a position in `seen` are skipped, so each subtree is only solved once.
+ */
+template <class MoveClass>
+static void collectSplitPositions(
+    onoro::Game<n_pawns>& g, uint32_t depth, TranspositionTable<n_pawns>& seen,
+    std::vector<onoro::Game<n_pawns>>& positions) {
   if (depth == 0) {
-    return { onoro::Score::tie(0), MoveClass() };
-  }
-
-  if (!MoveClass::forEachMoveFn(g,
-                                [&g, &best_move, &best_score](MoveClass move) {
-                                  onoro::Game<NPawns> g2(g, move);
-                                  if (g2.isFinished()) {
-                                    best_score = onoro::Score::win(1);
-                                    best_move = move;
-                                    return false;
-                                  }
-                                  return true;
-                                })) {
-    return { best_score, best_move };
-  }
-
-  MoveClass::forEachMoveFn(g, [&g, &m, &best_move, &best_score,
-                               depth](MoveClass move) {
-    onoro::Game<NPawns> g2(g, move);
-    g_n_moves++;
-    onoro::Score score;
-
-    // If this move finished the game, it means playing it made us win.
-    if (g2.isFinished()) {
-      score = onoro::Score::win(1);
+    if (!seen.find(g).has_value()) {
+      seen.insert(g);
+      positions.push_back(g);
+    }
+    return;
+  }
+
+  typename onoro::Game<n_pawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  for (MoveClass move : moves) {
+    auto undo = g.makeMove(move);
+    if (g.isFinished()) {
+      // Finished games are already solved.
+    } else if (std::is_same<MoveClass, onoro::P2Move>::value ||
+               g.inPhase2()) {
+      collectSplitPositions<onoro::P2Move>(g, depth - 1, seen, positions);
     } else {
-      auto cached_score = m.find(g2);
+      collectSplitPositions<onoro::P1Move>(g, depth - 1, seen, positions);
+    }
+    g.unmakeMove(move, undo);
+  }
+}
 
-      if (cached_score.has_value() && cached_score->determined(depth)) {
-        score = *cached_score;
-        g_n_hits++;
-      } else {
-        g_n_misses++;
+/*
+ * Splits `g` into the distinct positions reached after `depth` moves, dealing
+ * them out round-robin to `n_workers` files named `prefix`.<i>. Each file is a
+ * stream of length-delimited GameStates protos, as read by --from_stdin, so
+ * position j of file i is position i + j * n_workers of the split.
+ */
+static int runSplit(onoro::Game<n_pawns> g, uint32_t depth, uint32_t n_workers,
+                    const std::string& prefix) {
+  TranspositionTable<n_pawns> seen;
+  std::vector<onoro::Game<n_pawns>> positions;
+  if (!g.isFinished()) {
+    if (g.inPhase2()) {
+      collectSplitPositions<onoro::P2Move>(g, depth, seen, positions);
+    } else {
+      collectSplitPositions<onoro::P1Move>(g, depth, seen, positions);
+    }
+  }
+  printf("Split into %zu positions at depth %u\n", positions.size(), depth);
+
+  for (uint32_t w = 0; w < n_workers; w++) {
+    const std::string path = absl::StrFormat("%s.%u", prefix, w);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      fprintf(stderr, "Failed to create %s: %s\n", path.c_str(),
+              strerror(errno));
+      return -1;
+    }
 
-        absl::optional<onoro::Score> _score;
-        if (std::is_same<MoveClass, onoro::P2Move>::value || g2.inPhase2()) {
-          _score = findMove<NPawns, onoro::P2Move>(g2, m, depth - 1).first;
-        } else {
-          _score = findMove<NPawns, onoro::P1Move>(g2, m, depth - 1).first;
-        }
-        if (!_score.has_value()) {
-          // Consider winning by no legal moves as not winning until after the
-          // other player's attempt at making a move, since all game states
-          // that don't have 4 in a row of a pawn are considered a tie.
-          score = onoro::Score::win(2);
-        } else {
-          score = _score->backstep();
-        }
+    google::protobuf::io::FileOutputStream output(fd);
+    uint64_t n_written = 0;
+    bool ok = true;
+    for (std::size_t i = w; ok && i < positions.size(); i += n_workers) {
+      onoro::proto::GameStates states;
+      *states.add_state() = positions[i].SerializeState();
+      ok = google::protobuf::util::SerializeDelimitedToZeroCopyStream(states,
+                                                                      &output);
+      n_written++;
+    }
+    ok = output.Close() && ok;
+    if (!ok) {
+      fprintf(stderr, "Failed to write positions to %s\n", path.c_str());
+      return -1;
+    }
+    printf("Wrote %llu positions to %s\n", n_written, path.c_str());
+  }
+  return 0;
+}
 
-        // Update the cached score in case it changed.
-        cached_score = m.find(g2);
+/*
+ * Backs up the score of `g`, the root of a split solve whose positions are in
+ * the book at `path`, by searching `g` to `depth` with the book, and adds the
+ * positions of the search to the book. Positions at the split depth are
+ * answered by the book wherever their workers solved them deep enough, so
+ * only the tree above them is searched.
+ */
+template <class MoveClass>
+static int backUpSplitRoot(onoro::Game<n_pawns> g, uint32_t depth,
+                           const std::string& path) {
+  auto book = onoro::OpeningBook<n_pawns>::open(path);
+  if (!book.ok()) {
+    fprintf(stderr, "%s\n", book.status().ToString().c_str());
+    return -1;
+  }
 
-        onoro::Score merged_score =
-            cached_score.has_value() ? cached_score->merge(score) : score;
-        g2.setScore(merged_score);
-        m.insert_or_assign(std::move(g2));
-      }
-    }
+  TranspositionTable<n_pawns> m;
+  onoro::Searcher<n_pawns, TranspositionTable<n_pawns>> searcher(
+      m, &*book, absl::GetFlag(FLAGS_move_ordering));
+  auto [score, move] = searcher.template findMove<MoveClass>(g, depth);
+  if (!score.has_value()) {
+    printf("No moves available from the split position\n");
+    return 0;
+  }
+  printf("Split position: score %s, move %s (%llu playouts)\n",
+         score->Print().c_str(), moveString(g, move).c_str(),
+         searcher.nMoves());
 
-    if (!best_score.has_value()) {
-      best_score = score;
-      best_move = move;
-    } else if (score.better(*best_score)) {
-      best_move = move;
-      best_score = score;
+  absl::Status status = onoro::OpeningBook<n_pawns>::write(path, m, &*book);
+  if (!status.ok()) {
+    fprintf(stderr, "%s\n", status.ToString().c_str());
+    return -1;
+  }
+  printf("Added %zu positions above the split to %s\n", m.size(),
+         path.c_str());
+  return 0;
+}
 
-      if (score.score(depth) == 1) {
-        // We can stop the search early if we already have a winning move.
-        return false;
-      }
+/*
+ * Merges the opening books of --merge_books, such as the tables of the workers
+ * of a split solve, into the book at `path`. If `split_depth` is nonzero, the
+ * books are the workers' tables of a split of `g` at that depth, each solved
+ * to `depth`, and the score of `g` is backed up from them.
+ */
+static int runMergeBooks(const std::vector<std::string>& paths,
+                         const std::string& path, const onoro::Game<n_pawns>& g,
+                         uint32_t split_depth, uint32_t depth) {
+  std::vector<onoro::OpeningBook<n_pawns>> books;
+  books.reserve(paths.size());
+  for (const std::string& book_path : paths) {
+    auto res = onoro::OpeningBook<n_pawns>::open(book_path);
+    if (!res.ok()) {
+      fprintf(stderr, "%s\n", res.status().ToString().c_str());
+      return -1;
     }
+    books.push_back(std::move(*res));
+  }
 
-    return true;
-  });
+  std::vector<const onoro::OpeningBook<n_pawns>*> shards;
+  for (const onoro::OpeningBook<n_pawns>& book : books) {
+    shards.push_back(&book);
+  }
 
-  return { best_score, best_move };
+  absl::Status status = onoro::OpeningBook<n_pawns>::merge(path, shards);
+  if (!status.ok()) {
+    fprintf(stderr, "%s\n", status.ToString().c_str());
+    return -1;
+  }
+  printf("Merged %zu books into %s\n", books.size(), path.c_str());
+
+  if (split_depth == 0 || g.isFinished()) {
+    return 0;
+  }
+  return g.inPhase2()
+             ? backUpSplitRoot<onoro::P2Move>(g, split_depth + depth, path)
+             : backUpSplitRoot<onoro::P1Move>(g, split_depth + depth, path);
+}
+
+/*
+ * Solves every phase 2 position of games with NPawns pawns, writing the
+ * tablebase to `path`.
+ */
+template <uint32_t NPawns>
+static int runBuildTablebase(const std::string& path, uint32_t n_threads) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  absl::StatusOr<onoro::TablebaseStats> stats =
+      onoro::Tablebase<NPawns>::build(path, n_threads);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (!stats.ok()) {
+    fprintf(stderr, "%s\n", stats.status().ToString().c_str());
+    return -1;
+  }
+  printf(
+      "Solved %llu positions of %u pawns in %f s: %llu wins, %llu losses, "
+      "%llu draws, all decided within %u moves\n",
+      stats->n_positions, NPawns, elapsedSeconds(start, end), stats->n_wins,
+      stats->n_losses, stats->n_draws, stats->max_distance);
+  printf("Wrote tablebase to %s\n", path.c_str());
+  return 0;
 }
 
 static void allCompatible(const TranspositionTable<n_pawns>& t1,
                           const TranspositionTable<n_pawns>& t2) {
-  for (auto it = t1.table().cbegin(); it != t1.table().cend(); it++) {
-    const auto s1 = it->getScore();
+  t1.forEachGame([&t2](const onoro::Game<n_pawns>& game) {
+    const auto s1 = game.getScore();
 
-    const auto s2 = t2.find(*it);
+    const auto s2 = t2.find(game);
     if (s2.has_value()) {
       if (!s1.compatible(*s2)) {
-        printf("%s\n", it->Print().c_str());
+        printf("%s\n", game.Print().c_str());
         printf("Incompatible scores: t1 has %s, t2 has %s\n", s1, *s2);
         abort();
       }
     }
+    return true;
+  });
+}
+
+/*
+ * Called before each move search of a playout, giving fixed-size tables a
+ * chance to age out the entries of previous searches.
+ */
+template <class Table>
+static void newSearch(Table& m) {}
+
+template <uint32_t NPawns>
+static void newSearch(FixedTranspositionTable<NPawns>& m) {
+  m.newSearch();
+}
+
+/*
+ * Writes the positions of the table `m` to an opening book at `path`, merged
+ * with the positions of the opening book given by --book.
+ */
+template <class Table>
+static absl::Status writeBook(const Table& m, const std::string& path) {
+  return onoro::OpeningBook<n_pawns>::write(path, m, g_book);
+}
+
+static absl::Status writeBook(const FixedTranspositionTable<n_pawns>& m,
+                              const std::string& path) {
+  return absl::UnimplementedError(
+      "Opening books can't be written from fixed tables, which don't store "
+      "games");
+}
+
+/*
+ * Returns the page options for the table of --tt_mb given by the flags.
+ */
+static absl::StatusOr<onoro::PageBufferOptions> tablePageOptions() {
+  onoro::PageBufferOptions opts;
+  const std::string huge_pages = absl::GetFlag(FLAGS_tt_huge_pages);
+  if (huge_pages == "none") {
+    opts.huge_pages = onoro::HugePages::NONE;
+  } else if (huge_pages == "transparent") {
+    opts.huge_pages = onoro::HugePages::TRANSPARENT;
+  } else if (huge_pages == "explicit") {
+    opts.huge_pages = onoro::HugePages::EXPLICIT;
+  } else {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Unknown --tt_huge_pages value \"%s\"", huge_pages));
   }
+  opts.numa_interleave = absl::GetFlag(FLAGS_tt_numa_interleave);
+  return opts;
 }
 
-static int playout() {
+/*
+ * Prints the size of the fixed table `m` to `f`, and how much of it huge pages
+ * and NUMA interleaving were actually obtained for.
+ */
+static void printTableMemory(FILE* f,
+                             const FixedTranspositionTable<n_pawns>& m) {
+  fprintf(f, "Fixed table capacity: %zu entries\n", m.capacity());
+  fprintf(f, "Fixed table memory: %zu MiB, %zu MiB in huge pages%s\n",
+          m.bytes() >> 20, m.hugePageBytes() >> 20,
+          m.interleaved() ? ", interleaved across NUMA nodes" : "");
+}
+
+/*
+ * Formats the percentage of table probes in `stats` which cut the search off.
+ */
+static std::string hitRate(const onoro::SearchStats& stats) {
+  if constexpr (!onoro::SearchStats::enabled) {
+    return "no search stats";
+  }
+  return absl::StrFormat(
+      "%f%% hits",
+      100. * stats.totalProbeCutoffs() / (double) stats.totalProbes());
+}
+
+/*
+ * Escapes `str` for use in a JSON string: quotes and backslashes are escaped
+ * with a backslash, and control characters as \uXXXX. Everything else,
+ * including UTF-8 sequences, is copied as is.
+ */
+static std::string jsonEscape(absl::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(&escaped, "\\u%04x",
+                            static_cast<unsigned char>(c));
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+/*
+ * Formats the stats of the search for move number `move_num` of a playout as
+ * one line of JSON, with the moves and search time of each thread and the
+ * search stats of all threads merged.
+ */
+static std::string statsJson(uint32_t move_num, uint32_t depth,
+                             const std::vector<SearchThreadStats>& stats,
+                             const onoro::SearchStats& total_stats) {
+  std::string threads = "[";
+  for (uint32_t t = 0; t < stats.size(); t++) {
+    absl::StrAppendFormat(&threads,
+                          "%s{\"moves\": %u, \"search_time\": %.6f}",
+                          t == 0 ? "" : ", ", stats[t].n_moves,
+                          stats[t].search_time);
+  }
+  threads += "]";
+
+  return absl::StrFormat(
+      "{\"move_num\": %u, \"depth\": %u, \"threads\": %s, \"stats\": %s}",
+      move_num, depth, threads, total_stats.toJson());
+}
+
+/*
+ * Finds the move to play from `g` with Monte-Carlo tree search, writing it to
+ * the move out-parameter matching the phase of `g`. Returns false if there
+ * are no legal moves.
+ */
+static bool mctsMove(const onoro::Game<n_pawns>& g, onoro::Mcts<n_pawns>& mcts,
+                     P1Move& p1_move, P2Move& p2_move) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  double win_rate;
+  uint64_t n_playouts;
+  uint32_t n_nodes;
+  if (g.inPhase2()) {
+    auto res = mcts.search<onoro::P2Move>(g);
+    if (!res.move.has_value()) {
+      return false;
+    }
+    p2_move = *res.move;
+    win_rate = res.win_rate;
+    n_playouts = res.n_playouts;
+    n_nodes = res.n_nodes;
+  } else {
+    auto res = mcts.search<onoro::P1Move>(g);
+    if (!res.move.has_value()) {
+      return false;
+    }
+    p1_move = *res.move;
+    win_rate = res.win_rate;
+    n_playouts = res.n_playouts;
+    n_nodes = res.n_nodes;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double search_time = elapsedSeconds(start, end);
+  std::string move_str =
+      g.inPhase2() ? moveString(g, p2_move) : moveString(g, p1_move);
+  printf(
+      "Move %s, %.1f%% wins (%llu playouts, %u nodes, %f playouts/sec, "
+      "%lf s)\n",
+      move_str.c_str(), 100 * win_rate, n_playouts, n_nodes,
+      (double) n_playouts / search_time, search_time);
+  return true;
+}
+
+template <class Table>
+static int playout(Table& m) {
   struct timespec start, end;
   onoro::Game<n_pawns> g;
   onoro::Game<n_pawns> prev;
 
+  printf("score size: %zu\n", sizeof(onoro::Score));
+  printf("score align: %zu\n", alignof(onoro::Score));
   printf("Game size: %zu bytes\n", sizeof(onoro::Game<n_pawns>));
   printf("Game view size: %zu bytes\n", sizeof(onoro::GameView<n_pawns>));
+  printf("Game key size: %zu bytes\n", sizeof(onoro::GameKey<n_pawns>));
 
   printf("%s\n", g.Print().c_str());
   prev = g;
 
-  TranspositionTable<n_pawns> m;
   uint32_t max_depth = absl::GetFlag(FLAGS_depth);
-  std::vector<onoro::Game<n_pawns>> history;
+  uint32_t movetime_ms = absl::GetFlag(FLAGS_movetime_ms);
+  uint32_t n_threads = std::max(absl::GetFlag(FLAGS_threads), 1u);
+  // The keys of every position reached so far, which are equal for all
+  // positions equivalent under symmetries.
+  absl::flat_hash_set<GameKey<n_pawns>> history;
+  std::vector<SearchThreadStats> stats;
+
+  onoro::SearchOptions<n_pawns> options;
+  options.n_threads = n_threads;
+  options.move_ordering = absl::GetFlag(FLAGS_move_ordering);
+  options.book = g_book;
+  options.tablebase = g_tablebase;
+
+  onoro::MctsOptions mcts_options;
+  mcts_options.n_threads = n_threads;
+  mcts_options.n_playouts = absl::GetFlag(FLAGS_mcts_playouts);
+  mcts_options.max_nodes = absl::GetFlag(FLAGS_mcts_nodes);
+  // One tree is reused for every move, so its nodes are only mapped once.
+  absl::optional<onoro::Mcts<n_pawns>> mcts;
+  if (mcts_options.n_playouts != 0) {
+    mcts.emplace(mcts_options);
+  }
 
   for (uint32_t i = 0; i < -1u; i++) {
-    if (std::find(history.cbegin(), history.cend(), prev) != history.cend()) {
+    if (!history.insert(GameKey<n_pawns>(prev)).second) {
       printf("State has been repeated!\n");
       break;
     }
-    history.push_back(prev);
 
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    absl::optional<onoro::Score> score;
     P1Move p1_move;
     P2Move p2_move;
 
-    // m.clear();
-
-    if (g.inPhase2()) {
-      auto [_score, move] = findMove<n_pawns, onoro::P2Move>(g, m, max_depth);
-      score = _score;
-      p2_move = move;
+    if (mcts.has_value()) {
+      if (!mctsMove(g, *mcts, p1_move, p2_move)) {
+        printf("No moves available\n");
+        break;
+      }
     } else {
-      auto [_score, move] = findMove<n_pawns, onoro::P1Move>(g, m, max_depth);
-      score = _score;
-      p1_move = move;
-    }
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      absl::optional<onoro::Score> score;
+
+      // m.clear();
+      newSearch(m);
+
+      uint32_t search_depth = max_depth;
+      if (g.inPhase2()) {
+        auto [_score, move] =
+            movetime_ms != 0
+                ? findMoveIterative<n_pawns, onoro::P2Move>(
+                      g, m, max_depth, movetime_ms, options, stats,
+                      search_depth)
+                : findMoveParallel<n_pawns, onoro::P2Move>(g, m, max_depth,
+                                                           options, stats);
+        score = _score;
+        p2_move = move;
+      } else {
+        auto [_score, move] =
+            movetime_ms != 0
+                ? findMoveIterative<n_pawns, onoro::P1Move>(
+                      g, m, max_depth, movetime_ms, options, stats,
+                      search_depth)
+                : findMoveParallel<n_pawns, onoro::P1Move>(g, m, max_depth,
+                                                           options, stats);
+        score = _score;
+        p1_move = move;
+      }
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    printf("Move search time at depth %u: %lf s (table size: %zu)\n",
-           timespec_diff(&start, &end), max_depth, m.table().size());
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      printf("Move search time at depth %u: %lf s (table size: %zu)\n",
+             search_depth, elapsedSeconds(start, end), m.size());
 
-    if (!score.has_value()) {
-      printf("No moves available\n");
-      break;
-    }
+      if (!score.has_value()) {
+        printf("No moves available\n");
+        break;
+      }
 
-    if (g.inPhase2()) {
-      onoro::idx_t from = g.idxAt(p2_move.from_idx);
-      printf(
-          "Move (%d, %d) from (%d, %d), %s (%llu playouts, %f%% hits, %f "
-          "playouts/sec)\n",
-          p2_move.to.x(), p2_move.to.y(), from.x(), from.y(),
-          score->Print().c_str(), g_n_moves,
-          100. * g_n_hits / (double) (g_n_misses + g_n_hits),
-          (double) g_n_moves / timespec_diff(&start, &end));
-    } else {
-      printf("Move (%d, %d), %s (%llu playouts, %f%% hits, %f playouts/sec)\n",
-             p1_move.loc.x(), p1_move.loc.y(), score->Print().c_str(),
-             g_n_moves, 100. * g_n_hits / (double) (g_n_misses + g_n_hits),
-             (double) g_n_moves / timespec_diff(&start, &end));
+      uint64_t n_moves = 0;
+      onoro::SearchStats total_stats;
+      for (const SearchThreadStats& s : stats) {
+        n_moves += s.n_moves;
+        total_stats.merge(s.stats);
+      }
+
+      if (g.inPhase2()) {
+        onoro::idx_t from = g.idxAt(p2_move.from_idx);
+        printf(
+            "Move (%d, %d) from (%d, %d), %s (%llu playouts, %s, %f "
+            "playouts/sec)\n",
+            p2_move.to.x(), p2_move.to.y(), from.x(), from.y(),
+            score->Print().c_str(), n_moves, hitRate(total_stats).c_str(),
+            (double) n_moves / elapsedSeconds(start, end));
+      } else {
+        printf("Move (%d, %d), %s (%llu playouts, %s, %f playouts/sec)\n",
+               p1_move.loc.x(), p1_move.loc.y(), score->Print().c_str(),
+               n_moves, hitRate(total_stats).c_str(),
+               (double) n_moves / elapsedSeconds(start, end));
+      }
+
+      if (n_threads > 1) {
+        for (uint32_t t = 0; t < n_threads; t++) {
+          const SearchThreadStats& s = stats[t];
+          printf("  thread %u: %llu playouts, %s, %f playouts/sec\n", t,
+                 s.n_moves, hitRate(s.stats).c_str(),
+                 (double) s.n_moves / s.search_time);
+        }
+      }
+
+      if constexpr (onoro::SearchStats::enabled) {
+        printf("%s\n", statsJson(i, search_depth, stats, total_stats).c_str());
+      }
     }
-    g_n_moves = 0;
-    g_n_misses = 0;
-    g_n_hits = 0;
 
     if (g.inPhase2()) {
       g = onoro::Game<n_pawns>(g, p2_move);
@@ -394,8 +857,209 @@ static int playout() {
     prev = g;
   }
 
-  printf("Table size: %zu\n", m.table().size());
+  printf("Table size: %zu\n", m.size());
+
+  const std::string book_path = absl::GetFlag(FLAGS_write_book);
+  if (!book_path.empty()) {
+    absl::Status status = writeBook(m, book_path);
+    if (!status.ok()) {
+      fprintf(stderr, "%s\n", status.ToString().c_str());
+      return -1;
+    }
+    printf("Wrote opening book to %s\n", book_path.c_str());
+  }
+
+  return 0;
+}
+
+/*
+ * A position read by a batch run, along with its index in the input stream.
+ * Holds an error if the position couldn't be loaded.
+ */
+struct BatchPosition {
+  uint64_t idx;
+  absl::StatusOr<onoro::Game<n_pawns>> game;
+};
+
+// The batch queue holds at most this many positions per thread, so reading
+// the input stays only a little ahead of the threads solving positions.
+static constexpr uint32_t batch_positions_per_thread = 16;
+
+/*
+ * A bounded queue handing positions from the thread reading the input to the
+ * threads solving them.
+ */
+class BatchQueue {
+ public:
+  explicit BatchQueue(std::size_t capacity) : capacity_(capacity) {}
+
+  // Adds a position to the queue, waiting for room if the queue is full.
+  void push(BatchPosition pos) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() { return queue_.size() < capacity_; });
+    queue_.push_back(std::move(pos));
+    not_empty_.notify_one();
+  }
+
+  // Takes the next position from the queue, waiting for one if the queue is
+  // empty. Returns nothing once the queue is empty and closed.
+  absl::optional<BatchPosition> pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+    if (queue_.empty()) {
+      return {};
+    }
+    BatchPosition pos = std::move(queue_.front());
+    queue_.pop_front();
+    not_full_.notify_one();
+    return pos;
+  }
+
+  // Tells the threads waiting on the queue that no more positions are coming.
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+ private:
+  const std::size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<BatchPosition> queue_;
+  bool closed_ = false;
+};
+
+/*
+ * Solves `g` to `depth` with `searcher`, returning the result as one line of
+ * JSON. Positions without legal moves have no score or move.
+ */
+template <class MoveClass, class Table>
+static std::string solveBatchPosition(
+    uint64_t idx, onoro::Game<n_pawns>& g,
+    onoro::Searcher<n_pawns, Table>& searcher, uint32_t depth) {
+  struct timespec start, end;
+  searcher.resetCounters();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  auto [score, move] =
+      g.isFinished() ? std::make_pair(absl::optional<onoro::Score>(),
+                                      MoveClass())
+                     : searcher.template findMove<MoveClass>(g, depth);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  std::string result =
+      score.has_value()
+          ? absl::StrFormat("\"score\": \"%s\", \"move\": \"%s\"",
+                            score->Print(), moveString(g, move))
+          : "\"score\": null, \"move\": null";
+  return absl::StrFormat(
+      "{\"index\": %u, %s, \"moves\": %u, \"search_time\": %.6f}", idx,
+      result, searcher.nMoves(), elapsedSeconds(start, end));
+}
+
+/*
+ * Solves the positions of `queue` until it is closed, printing the result of
+ * each position as soon as it is solved.
+ */
+template <class Table>
+static void runBatchThread(BatchQueue& queue, Table& m, uint32_t depth,
+                           std::mutex& output_mutex,
+                           std::atomic<uint64_t>& n_solved) {
+  onoro::Searcher<n_pawns, Table> searcher(
+      m, g_book, absl::GetFlag(FLAGS_move_ordering), /*stop=*/nullptr,
+      g_tablebase);
+
+  for (absl::optional<BatchPosition> pos = queue.pop(); pos.has_value();
+       pos = queue.pop()) {
+    std::string result;
+    if (!pos->game.ok()) {
+      result = absl::StrFormat(
+          "{\"index\": %u, \"error\": \"%s\"}", pos->idx,
+          jsonEscape(pos->game.status().ToString()));
+    } else if (pos->game->inPhase2()) {
+      result = solveBatchPosition<onoro::P2Move>(pos->idx, *pos->game,
+                                                 searcher, depth);
+    } else {
+      result = solveBatchPosition<onoro::P1Move>(pos->idx, *pos->game,
+                                                 searcher, depth);
+    }
+
+    std::lock_guard<std::mutex> lock(output_mutex);
+    printf("%s\n", result.c_str());
+    fflush(stdout);
+    n_solved++;
+  }
+}
+
+/*
+ * Reads length-delimited GameStates protos from stdin, solving every position
+ * in them to `depth` on `n_threads` threads sharing the table `m`. Positions
+ * are solved in the order they are read, but results are printed as they
+ * finish, so they are tagged with the index of their position in the input.
+ * The number of positions solved per second is printed to stderr at the end.
+ */
+template <class Table>
+static int runBatch(Table& m, uint32_t depth, uint32_t n_threads) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  BatchQueue queue(batch_positions_per_thread * n_threads);
+  std::mutex output_mutex;
+  std::atomic<uint64_t> n_solved = 0;
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([&queue, &m, depth, &output_mutex, &n_solved]() {
+      runBatchThread(queue, m, depth, output_mutex, n_solved);
+    });
+  }
+
+  google::protobuf::io::FileInputStream input(STDIN_FILENO);
+  uint64_t idx = 0;
+  bool clean_eof = false;
+  onoro::proto::GameStates states;
+  while (true) {
+    // Parsing a delimited message merges it into `states`, so clear the
+    // positions of the previous message first.
+    states.Clear();
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &states, &input, &clean_eof)) {
+      break;
+    }
+    for (const onoro::proto::GameState& state : states.state()) {
+      queue.push({ idx++, onoro::Game<n_pawns>::LoadState(state) });
+    }
+  }
+  queue.close();
 
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double time = elapsedSeconds(start, end);
+  fprintf(stderr, "Solved %llu positions in %lf s (%f positions/sec)\n",
+          n_solved.load(), time, n_solved.load() / time);
+
+  if (!clean_eof) {
+    fprintf(stderr,
+            "Failed to parse a GameStates proto from stdin after %llu "
+            "positions\n",
+            idx);
+    return -1;
+  }
+
+  const std::string book_path = absl::GetFlag(FLAGS_write_book);
+  if (!book_path.empty()) {
+    absl::Status status = writeBook(m, book_path);
+    if (!status.ok()) {
+      fprintf(stderr, "%s\n", status.ToString().c_str());
+      return -1;
+    }
+    fprintf(stderr, "Wrote opening book to %s\n", book_path.c_str());
+  }
   return 0;
 }
 
@@ -404,11 +1068,126 @@ int main(int argc, char* argv[]) {
 
   absl::ParseCommandLine(argc, argv);
 
-  printf("score size: %zu\n", sizeof(onoro::Score));
-  printf("score align: %zu\n", alignof(onoro::Score));
+  if (!absl::GetFlag(FLAGS_merge_books).empty()) {
+    if (absl::GetFlag(FLAGS_write_book).empty()) {
+      fprintf(stderr, "--merge_books requires --write_book\n");
+      return -1;
+    }
+    absl::StatusOr<onoro::Game<n_pawns>> root = readRootGame();
+    if (!root.ok()) {
+      fprintf(stderr, "%s\n", root.status().ToString().c_str());
+      return -1;
+    }
+    return runMergeBooks(absl::GetFlag(FLAGS_merge_books),
+                         absl::GetFlag(FLAGS_write_book), *root,
+                         absl::GetFlag(FLAGS_split_depth),
+                         absl::GetFlag(FLAGS_depth));
+  }
+
+  if (!absl::GetFlag(FLAGS_build_tablebase).empty()) {
+    const std::string& path = absl::GetFlag(FLAGS_build_tablebase);
+    uint32_t n_threads = std::max(absl::GetFlag(FLAGS_threads), 1u);
+    switch (absl::GetFlag(FLAGS_tablebase_pawns)) {
+      case 8:
+        return runBuildTablebase<8>(path, n_threads);
+      case n_pawns:
+        return runBuildTablebase<n_pawns>(path, n_threads);
+      default:
+        fprintf(stderr, "--tablebase_pawns must be 8 or %u\n", n_pawns);
+        return -1;
+    }
+  }
+
+  if (absl::GetFlag(FLAGS_perft) != 0 ||
+      absl::GetFlag(FLAGS_split_depth) != 0) {
+    absl::StatusOr<onoro::Game<n_pawns>> res = readRootGame();
+    if (!res.ok()) {
+      fprintf(stderr, "%s\n", res.status().ToString().c_str());
+      return -1;
+    }
+    onoro::Game<n_pawns> g = *res;
+    printf("%s\n", g.Print().c_str());
+
+    if (absl::GetFlag(FLAGS_split_depth) != 0) {
+      return runSplit(g, absl::GetFlag(FLAGS_split_depth),
+                      std::max(absl::GetFlag(FLAGS_split_workers), 1u),
+                      absl::GetFlag(FLAGS_split_out));
+    }
+
+    uint32_t depth = absl::GetFlag(FLAGS_perft);
+    uint32_t n_threads = std::max(absl::GetFlag(FLAGS_threads), 1u);
+    return g.inPhase2() ? runPerft<onoro::P2Move>(g, depth, n_threads)
+                        : runPerft<onoro::P1Move>(g, depth, n_threads);
+  }
+
+  absl::optional<onoro::OpeningBook<n_pawns>> book;
+  if (!absl::GetFlag(FLAGS_book).empty()) {
+    auto res = onoro::OpeningBook<n_pawns>::open(absl::GetFlag(FLAGS_book));
+    if (!res.ok()) {
+      fprintf(stderr, "%s\n", res.status().ToString().c_str());
+      return -1;
+    }
+    book.emplace(std::move(*res));
+    g_book = &*book;
+    printf("Opening book size: %zu\n", g_book->size());
+  }
+
+  absl::optional<onoro::Tablebase<n_pawns>> tablebase;
+  if (!absl::GetFlag(FLAGS_tablebase).empty()) {
+    auto res = onoro::Tablebase<n_pawns>::open(absl::GetFlag(FLAGS_tablebase));
+    if (!res.ok()) {
+      fprintf(stderr, "%s\n", res.status().ToString().c_str());
+      return -1;
+    }
+    tablebase.emplace(std::move(*res));
+    g_tablebase = &*tablebase;
+    printf("Tablebase size: %zu\n", g_tablebase->size());
+  }
+
+  if (!absl::GetFlag(FLAGS_write_book).empty() &&
+      absl::GetFlag(FLAGS_tt_mb) > 0) {
+    fprintf(stderr, "--write_book is not supported with --tt_mb\n");
+    return -1;
+  }
+
+  onoro::PageBufferOptions page_opts;
+  if (absl::GetFlag(FLAGS_tt_mb) > 0) {
+    absl::StatusOr<onoro::PageBufferOptions> res = tablePageOptions();
+    if (!res.ok()) {
+      fprintf(stderr, "%s\n", res.status().ToString().c_str());
+      return -1;
+    }
+    page_opts = *res;
+  }
+  uint32_t n_threads = std::max(absl::GetFlag(FLAGS_threads), 1u);
+
+  if (absl::GetFlag(FLAGS_from_stdin)) {
+    uint32_t depth = absl::GetFlag(FLAGS_depth);
+    if (absl::GetFlag(FLAGS_tt_mb) > 0) {
+      FixedTranspositionTable<n_pawns> m(absl::GetFlag(FLAGS_tt_mb), page_opts,
+                                         n_threads);
+      // Batch results are printed to stdout, so keep it to JSON.
+      printTableMemory(stderr, m);
+      return runBatch(m, depth, n_threads);
+    } else {
+      ConcurrentTranspositionTable<n_pawns> m;
+      return runBatch(m, depth, n_threads);
+    }
+  }
 
   // return benchmark();
-  return playout();
+  if (absl::GetFlag(FLAGS_tt_mb) > 0) {
+    FixedTranspositionTable<n_pawns> m(absl::GetFlag(FLAGS_tt_mb), page_opts,
+                                       n_threads);
+    printTableMemory(stdout, m);
+    return playout(m);
+  } else if (absl::GetFlag(FLAGS_threads) > 1) {
+    ConcurrentTranspositionTable<n_pawns> m;
+    return playout(m);
+  } else {
+    TranspositionTable<n_pawns> m;
+    return playout(m);
+  }
   onoro::GameHash<N> h;
 
   /*
@@ -0,0 +1,260 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <absl/status/statusor.h>
+#include <absl/types/optional.h>
+
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "game_state.pb.h"
+#include "onoro.h"
+#include "search.h"
+#include "transposition_table.h"
+
+static constexpr uint32_t NPawns = 16;
+
+using Table = onoro::TranspositionTable<NPawns>;
+
+/*
+ * A search handle, which owns the table all of its searches share. Tables
+ * aren't thread safe, so searches on one handle run one at a time, but
+ * searches on different handles run in parallel.
+ */
+struct SearchHandle {
+  std::mutex mutex;
+  Table table;
+};
+
+typedef struct {
+  PyObject_HEAD
+  SearchHandle* handle;
+} SearcherObject;
+
+/*
+ * The result of a search: the position after the chosen move, the score of
+ * the position searched, and the depth it was searched to. Positions without
+ * legal moves have no next position or score.
+ */
+struct SearchResult {
+  absl::optional<onoro::Game<NPawns>> next;
+  absl::optional<onoro::Score> score;
+  uint32_t depth;
+};
+
+template <class MoveClass>
+static SearchResult search(const onoro::Game<NPawns>& game, Table& table,
+                           uint32_t depth, uint32_t movetime_ms) {
+  onoro::SearchOptions<NPawns> options;
+  std::vector<onoro::SearchThreadStats> stats;
+  SearchResult res;
+  res.depth = depth;
+
+  auto [score, move] =
+      movetime_ms != 0
+          ? onoro::findMoveIterative<NPawns, MoveClass>(
+                game, table, depth, movetime_ms, options, stats, res.depth)
+          : onoro::findMoveParallel<NPawns, MoveClass>(game, table, depth,
+                                                       options, stats);
+  if (score.has_value()) {
+    res.next.emplace(game, move);
+    res.score = score;
+  }
+  return res;
+}
+
+static PyObject* Searcher_new(PyTypeObject* type, PyObject* args,
+                              PyObject* kwds) {
+  SearcherObject* self =
+      reinterpret_cast<SearcherObject*>(type->tp_alloc(type, 0));
+  if (self == NULL) {
+    return NULL;
+  }
+
+  self->handle = new (std::nothrow) SearchHandle();
+  if (self->handle == NULL) {
+    Py_DECREF(self);
+    return PyErr_NoMemory();
+  }
+  return reinterpret_cast<PyObject*>(self);
+}
+
+static void Searcher_dealloc(SearcherObject* self) {
+  // Instances of heap types hold a reference to their type.
+  PyTypeObject* type = Py_TYPE(self);
+  delete self->handle;
+  type->tp_free(reinterpret_cast<PyObject*>(self));
+  Py_DECREF(type);
+}
+
+/*
+ * Reads <onoro::proto::GameState proto msg> from game_state_proto_in, and
+ * searches for the best move from it up to `depth` moves ahead, where `depth`
+ * must be at least 1. If movetime_ms is nonzero, searches with iterative
+ * deepening until `depth` or until movetime_ms milliseconds have passed.
+ *
+ * Returns a tuple of the <onoro::proto::GameState proto msg> of the game after
+ * the chosen move, the outcome for the player to move (+1 = win, 0 = tie,
+ * -1 = loss), the printed Score, and the depth searched to. Positions without
+ * legal moves are losses for the player to move, with no next game or Score.
+ *
+ * The GIL is released while searching.
+ */
+static PyObject* Searcher_search(SearcherObject* self, PyObject* args,
+                                 PyObject* kwds) {
+  static const char* kwlist[] = { "game_state", "depth", "movetime_ms", NULL };
+
+  Py_buffer game_state_proto_in;
+  unsigned int depth;
+  unsigned int movetime_ms = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*I|I",
+                                   const_cast<char**>(kwlist),
+                                   &game_state_proto_in, &depth,
+                                   &movetime_ms)) {
+    return NULL;
+  }
+  if (depth == 0) {
+    PyBuffer_Release(&game_state_proto_in);
+    PyErr_SetString(PyExc_ValueError, "Search depth must be at least 1");
+    return NULL;
+  }
+
+  onoro::proto::GameState state;
+  bool parsed =
+      state.ParseFromArray(game_state_proto_in.buf, game_state_proto_in.len);
+  PyBuffer_Release(&game_state_proto_in);
+  if (!parsed) {
+    PyErr_SetString(PyExc_ValueError, "Failed to parse GameState protobuf");
+    return NULL;
+  }
+
+  absl::StatusOr<onoro::Game<NPawns>> game =
+      onoro::Game<NPawns>::LoadState(state);
+  if (!game.ok()) {
+    PyErr_SetString(PyExc_ValueError, game.status().ToString().c_str());
+    return NULL;
+  }
+  if (game->isFinished()) {
+    PyErr_SetString(PyExc_ValueError, "Can't search a finished game");
+    return NULL;
+  }
+
+  SearchResult res;
+  Py_BEGIN_ALLOW_THREADS;
+  {
+    std::lock_guard<std::mutex> lock(self->handle->mutex);
+    res = game->inPhase2()
+              ? search<onoro::P2Move>(*game, self->handle->table, depth,
+                                      movetime_ms)
+              : search<onoro::P1Move>(*game, self->handle->table, depth,
+                                      movetime_ms);
+  }
+  Py_END_ALLOW_THREADS;
+
+  if (!res.score.has_value()) {
+    return Py_BuildValue("(OiOI)", Py_None, -1, Py_None, res.depth);
+  }
+
+  std::string next_state;
+  if (!res.next->SerializeState().SerializeToString(&next_state)) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Failed to serialize GameState object");
+    return NULL;
+  }
+  const onoro::Score& score = *res.score;
+  int outcome =
+      score.turn_count_win() == 0 ? 0 : (score.curPlayerWins() ? 1 : -1);
+  return Py_BuildValue("(y#isI)", next_state.c_str(),
+                       static_cast<Py_ssize_t>(next_state.size()), outcome,
+                       score.Print().c_str(), res.depth);
+}
+
+/*
+ * Removes every game from the table of this handle.
+ */
+static PyObject* Searcher_clear(SearcherObject* self, PyObject* args) {
+  Py_BEGIN_ALLOW_THREADS;
+  {
+    std::lock_guard<std::mutex> lock(self->handle->mutex);
+    self->handle->table.clear();
+  }
+  Py_END_ALLOW_THREADS;
+  Py_RETURN_NONE;
+}
+
+/*
+ * Returns the number of games in the table of this handle.
+ */
+static PyObject* Searcher_table_size(SearcherObject* self, PyObject* args) {
+  std::size_t size;
+  Py_BEGIN_ALLOW_THREADS;
+  {
+    std::lock_guard<std::mutex> lock(self->handle->mutex);
+    size = self->handle->table.size();
+  }
+  Py_END_ALLOW_THREADS;
+  return PyLong_FromSize_t(size);
+}
+
+static PyMethodDef Searcher_methods[] = {
+  { "search",
+    reinterpret_cast<PyCFunction>(
+        reinterpret_cast<void (*)(void)>(Searcher_search)),
+    METH_VARARGS | METH_KEYWORDS,
+    "Searches a serialized GameState for its best move." },
+  { "clear", reinterpret_cast<PyCFunction>(Searcher_clear), METH_NOARGS,
+    "Removes every game from the transposition table." },
+  { "table_size", reinterpret_cast<PyCFunction>(Searcher_table_size),
+    METH_NOARGS, "Returns the number of games in the transposition table." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot Searcher_slots[] = {
+  { Py_tp_doc,
+    const_cast<char*>("A search handle, with a transposition table shared by "
+                      "its searches.") },
+  { Py_tp_new, reinterpret_cast<void*>(Searcher_new) },
+  { Py_tp_dealloc, reinterpret_cast<void*>(Searcher_dealloc) },
+  { Py_tp_methods, Searcher_methods },
+  { 0, NULL },
+};
+
+static PyType_Spec Searcher_spec = {
+  "onoro_search.Searcher", sizeof(SearcherObject), 0, Py_TPFLAGS_DEFAULT,
+  Searcher_slots,
+};
+
+static struct PyModuleDef onoro_search_module = {
+  PyModuleDef_HEAD_INIT,
+  "onoro_search",
+  "Python interface for the alpha-beta search.",
+  -1,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+PyMODINIT_FUNC PyInit_onoro_search(void) {
+  PyObject* searcher_type = PyType_FromSpec(&Searcher_spec);
+  if (searcher_type == NULL) {
+    return NULL;
+  }
+
+  PyObject* module = PyModule_Create(&onoro_search_module);
+  if (module == NULL) {
+    Py_DECREF(searcher_type);
+    return NULL;
+  }
+
+  if (PyModule_AddObject(module, "Searcher", searcher_type) < 0) {
+    Py_DECREF(searcher_type);
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
@@ -0,0 +1,140 @@
+
+#include <absl/container/flat_hash_map.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "concurrent_transposition_table.h"
+#include "game_key.h"
+#include "onoro.h"
+#include "test_util.h"
+#include "transposition_table.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_threads = 4;
+static constexpr uint32_t n_games = 2000;
+
+/*
+ * Returns the key of the game reached by the best move of the table entry of
+ * `g`, if the move is found from `g`.
+ */
+template <class MoveClass>
+static absl::optional<onoro::GameKey<n_pawns>> bestChildKey(
+    const onoro::Game<n_pawns>& g) {
+  absl::optional<MoveClass> move =
+      MoveClass::findTableMoveFn(g, g.getTableEntry().best_move);
+  if (!move.has_value()) {
+    return {};
+  }
+  return onoro::GameKey<n_pawns>(onoro::Game<n_pawns>(g, *move));
+}
+
+/*
+ * Gives every game its last move as the best move, inserts them all into a
+ * Table, and checks that the best move of each game visited by forEachGame
+ * leads to the same game as it did from the inserted game, even though the
+ * visited games are rebuilt from their keys in a different orientation.
+ */
+template <class Table>
+static bool testForEachGameMoves(
+    const std::vector<onoro::Game<n_pawns>>& games) {
+  Table table;
+  absl::flat_hash_map<onoro::GameKey<n_pawns>, onoro::GameKey<n_pawns>>
+      best_children;
+
+  for (onoro::Game<n_pawns> game : games) {
+    onoro::TableEntry entry = game.getTableEntry();
+    auto last_move = [&game, &entry](auto move) {
+      entry.best_move = game.tableMove(move);
+      return true;
+    };
+    if (game.inPhase2()) {
+      game.forEachMoveP2(last_move);
+    } else {
+      game.forEachMove(last_move);
+    }
+    game.setTableEntry(entry);
+    table.insert_or_assign(game);
+
+    absl::optional<onoro::GameKey<n_pawns>> child =
+        game.inPhase2() ? bestChildKey<onoro::P2Move>(game)
+                        : bestChildKey<onoro::P1Move>(game);
+    if (child.has_value()) {
+      best_children.emplace(onoro::GameKey<n_pawns>(game), *child);
+    }
+  }
+
+  return table.forEachGame([&best_children](const onoro::Game<n_pawns>& g) {
+    auto it = best_children.find(onoro::GameKey<n_pawns>(g));
+    if (it == best_children.end()) {
+      return true;
+    }
+    absl::optional<onoro::GameKey<n_pawns>> child =
+        g.inPhase2() ? bestChildKey<onoro::P2Move>(g)
+                     : bestChildKey<onoro::P1Move>(g);
+    if (!child.has_value() || *child != it->second) {
+      fprintf(stderr,
+              "The best move of a game visited by forEachGame is a different "
+              "move than it was from the inserted game:\n%s\n",
+              g.Print().c_str());
+      return false;
+    }
+    return true;
+  });
+}
+
+int main(int argc, char* argv[]) {
+  const std::vector<onoro::Game<n_pawns>> games =
+      onoro::test::genGames<n_pawns>(n_games);
+
+  if (!testForEachGameMoves<onoro::TranspositionTable<n_pawns>>(games) ||
+      !testForEachGameMoves<onoro::ConcurrentTranspositionTable<n_pawns>>(
+          games)) {
+    return -1;
+  }
+
+  onoro::ConcurrentTranspositionTable<n_pawns> table;
+
+  // Every thread inserts all games, interleaving finds of the games inserted
+  // by the other threads.
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([&games, &table, t]() {
+      for (uint32_t i = 0; i < games.size(); i++) {
+        const onoro::Game<n_pawns>& game = games[(i + t * 97) % games.size()];
+        table.insert_or_assign(game);
+        (void) table.find(games[(i * 31) % games.size()]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  if (table.size() != games.size()) {
+    fprintf(stderr, "Expected %zu entries in the table, but found %zu\n",
+            games.size(), table.size());
+    return -1;
+  }
+
+  for (const onoro::Game<n_pawns>& game : games) {
+    absl::optional<onoro::Score> score = table.find(game);
+
+    if (!score.has_value()) {
+      fprintf(stderr, "Failed to find game in table:\n%s\n",
+              game.Print().c_str());
+      return -1;
+    }
+    if (!(*score == game.getScore())) {
+      fprintf(stderr, "Expected score %s, but found %s for game:\n%s\n",
+              game.getScore().Print().c_str(), score->Print().c_str(),
+              game.Print().c_str());
+      return -1;
+    }
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
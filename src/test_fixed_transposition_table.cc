@@ -0,0 +1,263 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "fixed_transposition_table.h"
+#include "onoro.h"
+#include "test_util.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_threads = 4;
+static constexpr uint32_t n_games = 2000;
+
+template <uint32_t NPawns>
+static bool checkScore(const onoro::FixedTranspositionTable<NPawns>& table,
+                       const onoro::Game<NPawns>& game) {
+  absl::optional<onoro::Score> score = table.find(game);
+
+  if (!score.has_value()) {
+    fprintf(stderr, "Failed to find game in table:\n%s\n",
+            game.Print().c_str());
+    return false;
+  }
+  if (!(*score == game.getScore())) {
+    fprintf(stderr, "Expected score %s, but found %s for game:\n%s\n",
+            game.getScore().Print().c_str(), score->Print().c_str(),
+            game.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+static bool testScorePacking() {
+  for (onoro::Score score :
+       { onoro::Score::nil(), onoro::Score::win(4095), onoro::Score::lose(3),
+         onoro::Score::tie(2047), onoro::Score::ancestor(),
+         onoro::Score::win(7).backstep().merge(onoro::Score::tie(5)) }) {
+    if (!(onoro::Score::fromPacked(score.packed()) == score)) {
+      fprintf(stderr, "Score %s did not survive packing, unpacked to %s\n",
+              score.Print().c_str(),
+              onoro::Score::fromPacked(score.packed()).Print().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool testFindAll(const std::vector<onoro::Game<n_pawns>>& games) {
+  onoro::FixedTranspositionTable<n_pawns> table(4);
+
+  for (const onoro::Game<n_pawns>& game : games) {
+    table.insert_or_assign(game);
+  }
+
+  if (table.size() != games.size()) {
+    fprintf(stderr, "Expected %zu entries in the table, but found %zu\n",
+            games.size(), table.size());
+    return false;
+  }
+
+  for (const onoro::Game<n_pawns>& game : games) {
+    if (!checkScore(table, game)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Overfills a table with only a handful of entries, checking that it never
+ * grows, never reports the wrong score for a game, and keeps the most valuable
+ * entries.
+ */
+static bool testReplacement(const std::vector<onoro::Game<n_pawns>>& games) {
+  onoro::FixedTranspositionTable<n_pawns> table(0);
+
+  onoro::Game<n_pawns> won_game = games[0];
+  won_game.setScore(onoro::Score::win(3));
+  table.insert_or_assign(won_game);
+
+  for (uint32_t i = 1; i < games.size(); i++) {
+    table.insert_or_assign(games[i]);
+  }
+
+  if (table.size() > table.capacity()) {
+    fprintf(stderr, "Table has %zu entries, but a capacity of %zu\n",
+            table.size(), table.capacity());
+    return false;
+  }
+
+  for (uint32_t i = 1; i < games.size(); i++) {
+    absl::optional<onoro::Score> score = table.find(games[i]);
+    if (score.has_value() && !(*score == games[i].getScore())) {
+      fprintf(stderr, "Expected score %s, but found %s for game:\n%s\n",
+              games[i].getScore().Print().c_str(), score->Print().c_str(),
+              games[i].Print().c_str());
+      return false;
+    }
+  }
+
+  return checkScore(table, won_game);
+}
+
+/*
+ * Checks that the bound and best move stored alongside each score are found
+ * again, and that the best move can be recovered from the game.
+ */
+template <class MoveClass>
+static bool checkEntry(onoro::FixedTranspositionTable<n_pawns>& table,
+                       const onoro::Game<n_pawns>& game,
+                       onoro::ScoreBound bound) {
+  absl::optional<MoveClass> first_move;
+  MoveClass::forEachMoveFn(game, [&first_move](MoveClass move) {
+    first_move = move;
+    return false;
+  });
+  if (!first_move.has_value()) {
+    return true;
+  }
+
+  onoro::TableEntry entry = { game.getScore(), bound,
+                              game.tableMove(*first_move) };
+  game.setTableEntry(entry);
+  table.insert_or_assign(game);
+
+  absl::optional<onoro::TableEntry> found = table.findEntry(game);
+  if (!found.has_value() || !(found->score == entry.score) ||
+      found->bound != entry.bound || !(found->best_move == entry.best_move)) {
+    fprintf(stderr, "Entry did not survive the table for game:\n%s\n",
+            game.Print().c_str());
+    return false;
+  }
+
+  absl::optional<MoveClass> move =
+      MoveClass::findTableMoveFn(game, found->best_move);
+  if (!move.has_value() || !(*move == *first_move)) {
+    fprintf(stderr, "Failed to recover the best move for game:\n%s\n",
+            game.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+static bool testEntries(const std::vector<onoro::Game<n_pawns>>& games) {
+  onoro::FixedTranspositionTable<n_pawns> table(4);
+
+  for (uint32_t i = 0; i < games.size(); i++) {
+    onoro::Game<n_pawns> game = games[i];
+    onoro::ScoreBound bound = static_cast<onoro::ScoreBound>(i % 3);
+
+    bool ok = game.inPhase2()
+                  ? checkEntry<onoro::P2Move>(table, game, bound)
+                  : checkEntry<onoro::P1Move>(table, game, bound);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Checks that two inequivalent games with the same canonical hash and the same
+ * player to move in their canonical views don't share an entry.
+ */
+static bool testCollidingHashes() {
+  static constexpr uint32_t NPawns = 12;
+
+  absl::optional<std::pair<onoro::Game<NPawns>, onoro::Game<NPawns>>> pair =
+      onoro::test::findCanonicalHashCollision<NPawns>();
+  if (!pair.has_value()) {
+    fprintf(stderr, "Failed to find games with colliding canonical hashes\n");
+    return false;
+  }
+
+  onoro::FixedTranspositionTable<NPawns> table(4);
+  auto& [game1, game2] = *pair;
+  game1.setScore(onoro::Score::tie(1));
+  game2.setScore(onoro::Score::tie(2));
+  table.insert_or_assign(game1);
+  table.insert_or_assign(game2);
+
+  if (table.size() != 2) {
+    fprintf(stderr,
+            "Expected games with colliding canonical hashes to take 2 entries, "
+            "but found %zu\n",
+            table.size());
+    return false;
+  }
+  return checkScore(table, game1) && checkScore(table, game2);
+}
+
+static bool testConcurrent(const std::vector<onoro::Game<n_pawns>>& games) {
+  onoro::FixedTranspositionTable<n_pawns> table(4);
+
+  // Every thread inserts all games, interleaving finds of the games inserted
+  // by the other threads.
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([&games, &table, t]() {
+      for (uint32_t i = 0; i < games.size(); i++) {
+        const onoro::Game<n_pawns>& game = games[(i + t * 97) % games.size()];
+        table.insert_or_assign(game);
+        (void) table.find(games[(i * 31) % games.size()]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const onoro::Game<n_pawns>& game : games) {
+    if (!checkScore(table, game)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Checks that a table backed by huge pages, interleaved across NUMA nodes and
+ * first touched from several threads finds every game. Whether the kernel
+ * grants the requests depends on the machine, so only the reported sizes are
+ * checked against each other.
+ */
+static bool testPageOptions(const std::vector<onoro::Game<n_pawns>>& games) {
+  for (onoro::HugePages huge_pages :
+       { onoro::HugePages::TRANSPARENT, onoro::HugePages::EXPLICIT }) {
+    onoro::FixedTranspositionTable<n_pawns> table(
+        4, { huge_pages, /*numa_interleave=*/true }, n_threads);
+
+    for (const onoro::Game<n_pawns>& game : games) {
+      table.insert_or_assign(game);
+    }
+    for (const onoro::Game<n_pawns>& game : games) {
+      if (!checkScore(table, game)) {
+        return false;
+      }
+    }
+
+    if (table.hugePageBytes() > table.bytes()) {
+      fprintf(stderr, "Table reports %zu bytes in huge pages, but has %zu\n",
+              table.hugePageBytes(), table.bytes());
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const std::vector<onoro::Game<n_pawns>> games =
+      onoro::test::genGames<n_pawns>(n_games);
+
+  if (!testScorePacking() || !testFindAll(games) || !testReplacement(games) ||
+      !testEntries(games) || !testCollidingHashes() ||
+      !testConcurrent(games) || !testPageOptions(games)) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
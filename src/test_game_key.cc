@@ -0,0 +1,165 @@
+
+#include <cstdio>
+#include <vector>
+
+#include "game_eq.h"
+#include "game_key.h"
+#include "onoro.h"
+#include "playout.h"
+
+static constexpr uint32_t n_playouts = 200;
+static constexpr uint32_t max_playout_len = 60;
+
+static_assert(sizeof(onoro::GameKey<16>) == 16);
+static_assert(sizeof(onoro::GameKey<12>) == 16);
+static_assert(sizeof(onoro::GameKey<8>) == 8);
+
+template <class SymmetryClassOp, uint32_t NPawns>
+static bool equivalentUnder(const onoro::Game<NPawns>& g1,
+                            const onoro::Game<NPawns>& g2) {
+  typedef typename SymmetryClassOp::Group Group;
+
+  for (uint32_t op_ord = 0; op_ord < Group::order(); op_ord++) {
+    for (bool color_invert : { false, true }) {
+      if (onoro::GameEq<NPawns>()(
+              onoro::GameView<NPawns>(&g1),
+              onoro::GameView<NPawns>(&g2, Group(op_ord), color_invert))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Returns true if `g2` is equivalent to `g1`, by comparing `g1` with every view
+ * of `g2`. This doesn't rely on canonical views, so it can check them.
+ */
+template <uint32_t NPawns>
+static bool equivalent(const onoro::Game<NPawns>& g1,
+                       const onoro::Game<NPawns>& g2) {
+  SymmetryClassOpApplyAndReturn(g2.calcSymmetryState().symm_class,
+                                equivalentUnder, g1, g2);
+}
+
+/*
+ * Checks that the game constructed from the key of `g` is equivalent to `g`
+ * and has the same key.
+ */
+template <uint32_t NPawns>
+static bool checkRoundTrip(const onoro::Game<NPawns>& g) {
+  onoro::GameKey<NPawns> key(g);
+  onoro::Game<NPawns> g2 = key.toGame();
+
+  if (onoro::GameKey<NPawns>(g2) != key) {
+    fprintf(stderr, "Game from key:\n%s\nhas a different key than:\n%s\n",
+            g2.Print().c_str(), g.Print().c_str());
+    return false;
+  }
+  if (!equivalent(g, g2) || !onoro::CanonicalGameEq<NPawns>()(g, g2) ||
+      g.nPawnsInPlay() != g2.nPawnsInPlay()) {
+    fprintf(stderr, "Game from key:\n%s\nis not equivalent to:\n%s\n",
+            g2.Print().c_str(), g.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Checks that every move from `g`, converted to a TableMove, is found again
+ * from the game constructed from the key of `g`, which is `g` moved by some
+ * symmetry, as a move leading to a game equivalent to the one the move leads
+ * to from `g`.
+ */
+template <uint32_t NPawns>
+static bool checkTableMoves(const onoro::Game<NPawns>& g) {
+  onoro::Game<NPawns> g2 = onoro::GameKey<NPawns>(g).toGame();
+
+  bool ok = true;
+  auto check_move = [&g, &g2, &ok](auto move) {
+    using MoveClass = decltype(move);
+    absl::optional<MoveClass> found =
+        MoveClass::findTableMoveFn(g2, g.tableMove(move));
+    if (!found.has_value() ||
+        onoro::GameKey<NPawns>(onoro::Game<NPawns>(g, move)) !=
+            onoro::GameKey<NPawns>(onoro::Game<NPawns>(g2, *found))) {
+      fprintf(stderr,
+              "Move from:\n%s\nwas not found in the same place from:\n%s\n",
+              g.Print().c_str(), g2.Print().c_str());
+      ok = false;
+    }
+    return ok;
+  };
+  if (g.inPhase2()) {
+    g.forEachMoveP2(check_move);
+  } else {
+    g.forEachMove(check_move);
+  }
+  return ok;
+}
+
+/*
+ * Checks that every pair of games has the same key, and is equal under
+ * CanonicalGameEq, exactly when they are equivalent.
+ */
+template <uint32_t NPawns>
+static bool checkPairs(const std::vector<onoro::Game<NPawns>>& games) {
+  for (const onoro::Game<NPawns>& g1 : games) {
+    for (const onoro::Game<NPawns>& g2 : games) {
+      bool same_key = onoro::GameKey<NPawns>(g1) == onoro::GameKey<NPawns>(g2);
+      bool equiv = equivalent(g1, g2);
+      if (onoro::CanonicalGameEq<NPawns>()(g1, g2) != equiv) {
+        fprintf(stderr,
+                "Games:\n%s\nand:\n%s\nare %s equal under CanonicalGameEq, "
+                "but are %s equivalent\n",
+                g1.Print().c_str(), g2.Print().c_str(), equiv ? "not" : "",
+                equiv ? "" : "not");
+        return false;
+      }
+      if (same_key != equiv) {
+        fprintf(stderr,
+                "Games:\n%s\nand:\n%s\n%s the same key, but are %s "
+                "equivalent\n",
+                g1.Print().c_str(), g2.Print().c_str(),
+                same_key ? "have" : "don't have", same_key ? "not" : "");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <uint32_t NPawns>
+static bool testKeys() {
+  return onoro::forEachPlayoutPosition<NPawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [](const onoro::Game<NPawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        if (!checkRoundTrip(g) || !checkTableMoves(g)) {
+          return false;
+        }
+
+        std::vector<onoro::Game<NPawns>> children;
+        auto add_child = [&g, &children](auto move) {
+          children.emplace_back(g, move);
+          return true;
+        };
+        if (g.inPhase2()) {
+          g.forEachMoveP2(add_child);
+        } else {
+          g.forEachMove(add_child);
+        }
+        return checkPairs(children);
+      });
+}
+
+int main(int argc, char* argv[]) {
+  if (!testKeys<8>() || !testKeys<12>() || !testKeys<16>()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "onoro.h"
+
+// The largest coordinate of the points transforms are checked on.
+static constexpr int32_t max_coord = 20;
+
+/*
+ * Checks that the transform of every op of the group of SymmetryClassOp moves
+ * points the same way as SymmetryClassOp::apply_fn, that its inverse moves them
+ * back, and that composing it with every other op of the group moves points
+ * the same way as applying both ops.
+ */
+template <class SymmetryClassOp>
+static bool testSymmetryClassTransforms() {
+  typedef typename SymmetryClassOp::Group Group;
+
+  for (uint32_t op_ord = 0; op_ord < Group::order(); op_ord++) {
+    Group op(op_ord);
+    onoro::HexTransform t = onoro::symmetryClassTransform<SymmetryClassOp>(op);
+
+    for (uint32_t op2_ord = 0; op2_ord < Group::order(); op2_ord++) {
+      Group op2(op2_ord);
+      onoro::HexTransform composed =
+          onoro::symmetryClassTransform<SymmetryClassOp>(op2).after(t);
+
+      for (int32_t y = -max_coord; y <= max_coord; y++) {
+        for (int32_t x = -max_coord; x <= max_coord; x++) {
+          onoro::HexPos p{ x, y };
+          onoro::HexPos expected = SymmetryClassOp::apply_fn(p, op);
+          if (t.apply(p) != expected) {
+            fprintf(stderr,
+                    "Transform of op %u moved (%d, %d) to (%d, %d), "
+                    "expected (%d, %d)\n",
+                    op_ord, x, y, t.apply(p).x, t.apply(p).y,
+                    expected.x, expected.y);
+            return false;
+          }
+          if (t.inverse().apply(expected) != p) {
+            fprintf(stderr,
+                    "Inverse of the transform of op %u moved (%d, %d) to "
+                    "(%d, %d), expected (%d, %d)\n",
+                    op_ord, expected.x, expected.y,
+                    t.inverse().apply(expected).x,
+                    t.inverse().apply(expected).y, x, y);
+            return false;
+          }
+
+          expected = SymmetryClassOp::apply_fn(expected, op2);
+          if (composed.apply(p) != expected) {
+            fprintf(stderr,
+                    "Transform of op %u after op %u moved (%d, %d) to "
+                    "(%d, %d), expected (%d, %d)\n",
+                    op2_ord, op_ord, x, y,
+                    composed.apply(p).x, composed.apply(p).y, expected.x,
+                    expected.y);
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Checks that the offset table of Game<NPawns> agrees with apply_d6_c for
+ * every offset it covers.
+ */
+template <uint32_t NPawns>
+static bool testOffsetTable() {
+  constexpr int32_t R = NPawns + 1;
+
+  for (uint32_t op_ord = 0; op_ord < onoro::D6::order(); op_ord++) {
+    onoro::D6 op(op_ord);
+    for (int32_t y = -R; y <= R; y++) {
+      for (int32_t x = -R; x <= R; x++) {
+        onoro::HexPos p{ x, y };
+        onoro::HexPos res = onoro::Game<NPawns>::transformOffset(p, op);
+        if (res != p.apply_d6_c(op)) {
+          fprintf(stderr,
+                  "Offset table for %u pawns moved (%d, %d) to (%d, %d) with "
+                  "%s, expected (%d, %d)\n",
+                  NPawns, x, y, res.x, res.y, op.toString().c_str(),
+                  p.apply_d6_c(op).x, p.apply_d6_c(op).y);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (!testSymmetryClassTransforms<onoro::D6COp>() ||
+      !testSymmetryClassTransforms<onoro::D3VOp>() ||
+      !testSymmetryClassTransforms<onoro::K4EOp>() ||
+      !testSymmetryClassTransforms<onoro::C2CVOp>() ||
+      !testSymmetryClassTransforms<onoro::C2CEOp>() ||
+      !testSymmetryClassTransforms<onoro::C2EVOp>() ||
+      !testSymmetryClassTransforms<onoro::TrivialOp>()) {
+    return -1;
+  }
+
+  if (!testOffsetTable<8>() || !testOffsetTable<12>() ||
+      !testOffsetTable<16>()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
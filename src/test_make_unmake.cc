@@ -0,0 +1,126 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "onoro.h"
+#include "playout.h"
+
+static constexpr uint32_t n_pawns = 12;
+static constexpr uint32_t n_playouts = 200;
+static constexpr uint32_t max_playout_len = 100;
+
+/*
+ * Returns true if the two games have the same pawns on the same tiles, the
+ * same hash, and the same turn and finished state.
+ */
+static bool sameGame(const onoro::Game<n_pawns>& g1,
+                     const onoro::Game<n_pawns>& g2) {
+  if (g1.nPawnsInPlay() != g2.nPawnsInPlay() ||
+      g1.blackTurn() != g2.blackTurn() ||
+      g1.isFinished() != g2.isFinished() || g1.hash() != g2.hash()) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < g1.nPawnsInPlay(); i++) {
+    if (g1.idxAt(i) != g2.idxAt(i)) {
+      return false;
+    }
+  }
+
+  for (uint32_t y = 0; y < n_pawns; y++) {
+    for (uint32_t x = 0; x < n_pawns; x++) {
+      if (g1.getTile(onoro::idx_t(x, y)) != g2.getTile(onoro::idx_t(x, y))) {
+        return false;
+      }
+    }
+  }
+
+  return g1.calcSymmetryState().symm_class ==
+             g2.calcSymmetryState().symm_class &&
+         g1.calcSymmetryState().op.ordinal() ==
+             g2.calcSymmetryState().op.ordinal() &&
+         g1.originTile(g1.calcSymmetryState()) ==
+             g2.originTile(g2.calcSymmetryState());
+}
+
+/*
+ * Returns true if the two games carry the same table entry.
+ */
+static bool sameEntry(const onoro::Game<n_pawns>& g1,
+                      const onoro::Game<n_pawns>& g2) {
+  onoro::TableEntry e1 = g1.getTableEntry();
+  onoro::TableEntry e2 = g2.getTableEntry();
+  return e1.score == e2.score && e1.bound == e2.bound &&
+         e1.best_move == e2.best_move;
+}
+
+/*
+ * Checks that making each move in place produces the same game as
+ * constructing the child game, and that undoing it restores the original game,
+ * including a table entry overwritten on the child.
+ */
+template <class MoveClass>
+static bool checkMoves(const onoro::Game<n_pawns>& parent) {
+  onoro::Game<n_pawns> g = parent;
+  g.setTableEntry({ onoro::Score::tie(g.nPawnsInPlay()),
+                    onoro::ScoreBound::BOUND_LOWER, onoro::TableMove::none() });
+  const onoro::Game<n_pawns> orig = g;
+
+  return MoveClass::forEachMoveFn(orig, [&g, &orig](MoveClass move) {
+    onoro::Game<n_pawns> child(orig, move);
+    auto undo = g.makeMove(move);
+
+    // Games loaded from a packed state have nothing cached, so they check the
+    // symmetry state cached in games made in place.
+    uint8_t buf[onoro::Game<n_pawns>::packed_size];
+    g.PackState(buf);
+    if (!sameGame(g, onoro::Game<n_pawns>::UnpackState(buf).value())) {
+      fprintf(stderr, "Game made in place:\n%s\nhas a stale symmetry state\n",
+              g.Print().c_str());
+      return false;
+    }
+
+    if (!sameGame(g, child)) {
+      fprintf(stderr, "Game made in place:\n%s\ndiffers from child:\n%s\n",
+              g.Print().c_str(), child.Print().c_str());
+      return false;
+    }
+
+    // Check that the unmake restores the hash of the parent, with and without
+    // the hash of the child having been calculated.
+    if (rand() % 2 == 0) {
+      (void) g.hash();
+    }
+    g.setTableEntry({ onoro::Score::win(1), onoro::ScoreBound::BOUND_EXACT,
+                      orig.tableMove(move) });
+    g.unmakeMove(move, undo);
+
+    if (!sameGame(g, orig) || !sameEntry(g, orig)) {
+      fprintf(stderr, "Undoing a move gave:\n%s\nexpected:\n%s\n",
+              g.Print().c_str(), orig.Print().c_str());
+      return false;
+    }
+    return true;
+  });
+}
+
+int main(int argc, char* argv[]) {
+  srand(0);
+
+  bool ok = onoro::forEachPlayoutPosition<n_pawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [](const onoro::Game<n_pawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        return g.inPhase2() ? checkMoves<onoro::P2Move>(g)
+                            : checkMoves<onoro::P1Move>(g);
+      });
+  if (!ok) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,192 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mcts.h"
+#include "onoro.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_random_games = 100;
+static constexpr uint32_t max_playout_len = 100;
+static constexpr uint32_t n_winning_positions = 10;
+
+/*
+ * Checks that randomMove only returns moves generated for `g`.
+ */
+template <class MoveClass>
+static bool checkRandomMove(const onoro::Game<n_pawns>& g,
+                            onoro::SplitMix64& rng) {
+  typename onoro::Game<n_pawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+
+  absl::optional<MoveClass> move = onoro::randomMove<MoveClass>(g, rng);
+  if (moves.empty()) {
+    if (move.has_value()) {
+      fprintf(stderr, "Found a random move with no legal moves:\n%s\n",
+              g.Print().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  if (!move.has_value()) {
+    fprintf(stderr, "Found no random move out of %u moves:\n%s\n",
+            moves.size(), g.Print().c_str());
+    return false;
+  }
+  for (const MoveClass& legal_move : moves) {
+    if (std::memcmp(&legal_move, &*move, sizeof(MoveClass)) == 0) {
+      return true;
+    }
+  }
+  fprintf(stderr, "Random move is not a legal move of:\n%s\n",
+          g.Print().c_str());
+  return false;
+}
+
+/*
+ * Checks that `res`, the result of searching `g` with `options`, is a winning
+ * move of `g`, which must have one.
+ */
+template <class MoveClass>
+static bool checkFindsWin(const onoro::Game<n_pawns>& g,
+                          const onoro::MctsOptions& options,
+                          const onoro::MctsResult<MoveClass>& res) {
+  if (!res.move.has_value()) {
+    fprintf(stderr, "MCTS found no move for:\n%s\n", g.Print().c_str());
+    return false;
+  }
+  if (!onoro::Game<n_pawns>(g, *res.move).isFinished()) {
+    fprintf(stderr,
+            "MCTS with %u threads and %u nodes missed the win (win rate "
+            "%f) in:\n%s\n",
+            options.n_threads, options.max_nodes, res.win_rate,
+            g.Print().c_str());
+    return false;
+  }
+  if (res.n_playouts != options.n_playouts) {
+    fprintf(stderr, "Expected %llu playouts, found %llu\n",
+            options.n_playouts, res.n_playouts);
+    return false;
+  }
+  return true;
+}
+
+static bool testRandomMoves() {
+  onoro::SplitMix64 rng(0);
+
+  for (uint32_t i = 0; i < n_random_games; i++) {
+    onoro::Game<n_pawns> g;
+
+    for (uint32_t j = 0; j < max_playout_len && !g.isFinished(); j++) {
+      if (g.inPhase2()) {
+        if (!checkRandomMove<onoro::P2Move>(g, rng)) {
+          return false;
+        }
+        absl::optional<onoro::P2Move> move =
+            onoro::randomMove<onoro::P2Move>(g, rng);
+        if (!move.has_value()) {
+          break;
+        }
+        g.makeMove(*move);
+      } else {
+        if (!checkRandomMove<onoro::P1Move>(g, rng)) {
+          return false;
+        }
+        absl::optional<onoro::P1Move> move =
+            onoro::randomMove<onoro::P1Move>(g, rng);
+        if (!move.has_value()) {
+          break;
+        }
+        g.makeMove(*move);
+      }
+    }
+  }
+  return true;
+}
+
+template <class MoveClass>
+static bool checkFindsWin(const onoro::Game<n_pawns>& g,
+                          const onoro::MctsOptions& options) {
+  return checkFindsWin(g, options,
+                       onoro::findMoveMCTS<n_pawns, MoveClass>(g, options));
+}
+
+/*
+ * Plays random games, checking that MCTS finds the win in every position
+ * with a winning move, from one thread, several threads, a tree too small to
+ * hold more than the root's children, and a tree reused between positions.
+ */
+static bool testFindsWins() {
+  onoro::SplitMix64 rng(1);
+
+  onoro::MctsOptions options;
+  options.n_playouts = 2000;
+  options.max_nodes = 1u << 16;
+
+  onoro::MctsOptions parallel_options = options;
+  parallel_options.n_threads = 4;
+
+  onoro::MctsOptions tiny_options = options;
+  tiny_options.max_nodes = 64;
+
+  onoro::Mcts<n_pawns> reused(options);
+
+  uint32_t n_found = 0;
+  while (n_found < n_winning_positions) {
+    onoro::Game<n_pawns> g;
+
+    for (uint32_t j = 0; j < max_playout_len && !g.isFinished(); j++) {
+      bool has_win = g.inPhase2() ? g.findWinningMoveP2().has_value()
+                                  : g.findWinningMove().has_value();
+      if (has_win) {
+        for (const onoro::MctsOptions& opts :
+             { options, parallel_options, tiny_options }) {
+          bool found = g.inPhase2() ? checkFindsWin<onoro::P2Move>(g, opts)
+                                    : checkFindsWin<onoro::P1Move>(g, opts);
+          if (!found) {
+            return false;
+          }
+        }
+
+        bool found =
+            g.inPhase2()
+                ? checkFindsWin(g, options, reused.search<onoro::P2Move>(g))
+                : checkFindsWin(g, options, reused.search<onoro::P1Move>(g));
+        if (!found) {
+          return false;
+        }
+        n_found++;
+        break;
+      }
+
+      if (g.inPhase2()) {
+        absl::optional<onoro::P2Move> move =
+            onoro::randomMove<onoro::P2Move>(g, rng);
+        if (!move.has_value()) {
+          break;
+        }
+        g.makeMove(*move);
+      } else {
+        absl::optional<onoro::P1Move> move =
+            onoro::randomMove<onoro::P1Move>(g, rng);
+        if (!move.has_value()) {
+          break;
+        }
+        g.makeMove(*move);
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (!testRandomMoves() || !testFindsWins()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
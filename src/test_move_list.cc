@@ -0,0 +1,59 @@
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "onoro.h"
+#include "playout.h"
+
+static constexpr uint32_t n_playouts = 100;
+static constexpr uint32_t max_playout_len = 100;
+
+/*
+ * Checks that generateMoves produces exactly the moves visited by the
+ * callback move generation, in the same order.
+ */
+template <uint32_t NPawns, class MoveClass>
+static bool checkMoveList(const onoro::Game<NPawns>& g) {
+  typename onoro::Game<NPawns>::template move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+
+  uint32_t i = 0;
+  bool matches = MoveClass::forEachMoveFn(g, [&moves, &i](MoveClass move) {
+    if (i >= moves.size() ||
+        std::memcmp(&moves[i], &move, sizeof(MoveClass)) != 0) {
+      return false;
+    }
+    i++;
+    return true;
+  });
+
+  if (!matches || i != moves.size()) {
+    fprintf(stderr, "Move list of %u moves does not match moves of game:\n%s\n",
+            moves.size(), g.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+template <uint32_t NPawns>
+static bool testPlayouts() {
+  return onoro::forEachPlayoutPosition<NPawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [](const onoro::Game<NPawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        return g.inPhase2() ? checkMoveList<NPawns, onoro::P2Move>(g)
+                            : checkMoveList<NPawns, onoro::P1Move>(g);
+      });
+}
+
+int main(int argc, char* argv[]) {
+  if (!testPlayouts<8>() || !testPlayouts<12>() || !testPlayouts<16>()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,144 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "move_order.h"
+#include "onoro.h"
+#include "playout.h"
+
+static constexpr uint32_t n_pawns = 12;
+static constexpr uint32_t n_playouts = 100;
+static constexpr uint32_t max_playout_len = 60;
+
+template <class MoveClass>
+using move_list_t =
+    typename onoro::Game<n_pawns>::template move_list_t<MoveClass>;
+
+static onoro::idx_t moveTo(onoro::P1Move move) {
+  return move.loc;
+}
+
+static onoro::idx_t moveTo(onoro::P2Move move) {
+  return move.to;
+}
+
+/*
+ * Checks that ordering the moves of `g` only permutes them, puts the table
+ * move first, and puts moves creating threats before all other moves.
+ */
+template <class MoveClass>
+static bool checkOrder(const onoro::Game<n_pawns>& g,
+                       onoro::MoveOrder<n_pawns>& order, uint32_t ply) {
+  move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  if (moves.empty()) {
+    return true;
+  }
+
+  move_list_t<MoveClass> ordered;
+  g.generateMoves(ordered);
+  MoveClass table_move = moves[rand() % moves.size()];
+  order.orderMoves(g, ply, absl::optional<MoveClass>(table_move), ordered);
+
+  if (ordered.size() != moves.size()) {
+    fprintf(stderr, "Ordering changed the number of moves from %u to %u\n",
+            moves.size(), ordered.size());
+    return false;
+  }
+  for (const MoveClass& move : moves) {
+    if (std::count_if(ordered.begin(), ordered.end(), [&move](MoveClass m) {
+          return m == move;
+        }) != 1) {
+      fprintf(stderr, "Ordered moves are not a permutation of the moves\n");
+      return false;
+    }
+  }
+
+  if (!(ordered[0] == table_move)) {
+    fprintf(stderr, "Table move was not ordered first for game:\n%s\n",
+            g.Print().c_str());
+    return false;
+  }
+
+  const auto threats = g.calcThreatTiles();
+  bool seen_non_threat = false;
+  for (uint32_t i = 1; i < ordered.size(); i++) {
+    bool threat =
+        threats.test(onoro::Game<n_pawns>::idxOrd(moveTo(ordered[i])));
+    if (threat && seen_non_threat) {
+      fprintf(stderr, "Threat ordered after a non-threat for game:\n%s\n",
+              g.Print().c_str());
+      return false;
+    }
+    seen_non_threat = seen_non_threat || !threat;
+  }
+
+  // Tell the ordering about a cutoff, so later orderings also exercise
+  // killers and history.
+  order.recordCutoff(g, ply, 1 + rand() % 8, ordered[ordered.size() - 1]);
+  return true;
+}
+
+/*
+ * Checks that with heuristics disabled, only the table move is moved, with all
+ * other moves left in generation order.
+ */
+template <class MoveClass>
+static bool checkNoHeuristics(const onoro::Game<n_pawns>& g) {
+  onoro::MoveOrder<n_pawns> order(false);
+
+  move_list_t<MoveClass> moves;
+  g.generateMoves(moves);
+  if (moves.empty()) {
+    return true;
+  }
+
+  move_list_t<MoveClass> ordered;
+  g.generateMoves(ordered);
+  uint32_t table_idx = rand() % moves.size();
+  order.orderMoves(g, 0, absl::optional<MoveClass>(moves[table_idx]),
+                   ordered);
+
+  std::vector<MoveClass> expected(moves.begin(), moves.end());
+  std::rotate(expected.begin(), expected.begin() + table_idx,
+              expected.begin() + table_idx + 1);
+  if (memcmp(expected.data(), ordered.begin(),
+             expected.size() * sizeof(MoveClass)) != 0) {
+    fprintf(stderr, "Ordering without heuristics reordered other moves\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  srand(0);
+
+  // Each playout gets a fresh move order, as a new game would.
+  absl::optional<onoro::MoveOrder<n_pawns>> order;
+  bool ok = onoro::forEachPlayoutPosition<n_pawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [&order](const onoro::Game<n_pawns>& g, uint32_t ply) {
+        if (ply == 0) {
+          order.emplace();
+        }
+        if (g.isFinished()) {
+          return true;
+        }
+        if (g.inPhase2()) {
+          return checkOrder<onoro::P2Move>(g, *order, ply) &&
+                 checkNoHeuristics<onoro::P2Move>(g);
+        } else {
+          return checkOrder<onoro::P1Move>(g, *order, ply) &&
+                 checkNoHeuristics<onoro::P1Move>(g);
+        }
+      });
+  if (!ok) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -2,16 +2,45 @@
 #include <Python.h>
 #include <absl/status/statusor.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "game_state.pb.h"
 #include "onoro.h"
 
 static constexpr uint32_t NPawns = 16;
 
+static constexpr std::size_t packed_size = onoro::Game<NPawns>::packed_size;
+
+// Each move of gen_next_moves_packed is the byte of the idx_t of the tile a
+// pawn is moved to, followed by the index of the pawn moved in phase 2, or
+// no_from_idx in phase 1.
+static constexpr std::size_t packed_move_size = 2;
+static constexpr uint8_t no_from_idx = 0xff;
+
+/*
+ * Releases the buffers parsed from the arguments of a call when it returns.
+ */
+class BufferReleaser {
+ public:
+  template <class... Buffers>
+  explicit BufferReleaser(Buffers*... buffers) : buffers_{ buffers... } {}
+
+  ~BufferReleaser() {
+    for (Py_buffer* buffer : buffers_) {
+      PyBuffer_Release(buffer);
+    }
+  }
+
+ private:
+  std::vector<Py_buffer*> buffers_;
+};
+
 /*
  * Reads <onoro::proto::GameState proto msg> from game_state_proto_in.
  * Returns <onoro::proto::GameStates proto msg>.
@@ -68,16 +97,241 @@ static PyObject* gen_next_moves(PyObject* self, PyObject* args) {
                                    serialized_msg.size());
 }
 
+/*
+ * Reads <onoro::proto::GameStates proto msg> from game_states_proto_in.
+ * Returns the packed states of all of its games, concatenated.
+ */
+static PyObject* pack_states(PyObject* self, PyObject* args) {
+  (void) self;
+
+  Py_buffer game_states_proto_in;
+  if (!PyArg_ParseTuple(args, "y*", &game_states_proto_in)) {
+    return NULL;
+  }
+  BufferReleaser releaser(&game_states_proto_in);
+
+  onoro::proto::GameStates states;
+  if (!states.ParseFromArray(game_states_proto_in.buf,
+                             game_states_proto_in.len)) {
+    PyErr_SetString(PyExc_ValueError, "Failed to parse GameStates protobuf");
+    return NULL;
+  }
+
+  PyObject* res =
+      PyBytes_FromStringAndSize(NULL, states.state_size() * packed_size);
+  if (res == NULL) {
+    return NULL;
+  }
+  uint8_t* buf = reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(res));
+
+  for (int i = 0; i < states.state_size(); i++) {
+    absl::StatusOr<onoro::Game<NPawns>> game =
+        onoro::Game<NPawns>::LoadState(states.state(i));
+    if (!game.ok()) {
+      Py_DECREF(res);
+      PyErr_Format(PyExc_ValueError, "Failed to load game %d: %s", i,
+                   game.status().ToString().c_str());
+      return NULL;
+    }
+    game->PackState(buf + i * packed_size);
+  }
+  return res;
+}
+
+/*
+ * Reads packed states from packed_states_in.
+ * Returns <onoro::proto::GameStates proto msg>.
+ */
+static PyObject* unpack_states(PyObject* self, PyObject* args) {
+  (void) self;
+
+  Py_buffer packed_states_in;
+  if (!PyArg_ParseTuple(args, "y*", &packed_states_in)) {
+    return NULL;
+  }
+  BufferReleaser releaser(&packed_states_in);
+
+  if (packed_states_in.len % packed_size != 0) {
+    PyErr_Format(PyExc_ValueError,
+                 "Packed states are %zd bytes, which is not a multiple of "
+                 "%zu",
+                 packed_states_in.len, packed_size);
+    return NULL;
+  }
+
+  const uint8_t* buf = static_cast<const uint8_t*>(packed_states_in.buf);
+  onoro::proto::GameStates states;
+  const std::size_t n_states = packed_states_in.len / packed_size;
+  for (std::size_t i = 0; i < n_states; i++) {
+    absl::StatusOr<onoro::Game<NPawns>> game =
+        onoro::Game<NPawns>::UnpackState(buf + i * packed_size);
+    if (!game.ok()) {
+      PyErr_Format(PyExc_ValueError, "Failed to unpack game %zu: %s", i,
+                   game.status().ToString().c_str());
+      return NULL;
+    }
+    *states.add_state() = game->SerializeState();
+  }
+
+  std::string serialized_msg;
+  if (!states.SerializeToString(&serialized_msg)) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Failed to serialize GameStates object");
+    return NULL;
+  }
+  return PyBytes_FromStringAndSize(serialized_msg.c_str(),
+                                   serialized_msg.size());
+}
+
+static uint8_t packedFromIdx(onoro::P1Move move) {
+  return no_from_idx;
+}
+
+static uint8_t packedFromIdx(onoro::P2Move move) {
+  return move.from_idx;
+}
+
+static onoro::idx_t moveTo(onoro::P1Move move) {
+  return move.loc;
+}
+
+static onoro::idx_t moveTo(onoro::P2Move move) {
+  return move.to;
+}
+
+/*
+ * Writes the children of `game` and the moves reaching them to `children` and
+ * `moves`, and `parent` as the parent of each of them, if all of them fit in
+ * the `capacity` children left. Returns the number of children written, or
+ * -1 if they didn't fit.
+ */
+template <class MoveClass>
+static int64_t packChildren(const onoro::Game<NPawns>& game, uint32_t parent,
+                            std::size_t capacity, uint8_t* children,
+                            uint8_t* parents, uint8_t* moves) {
+  typename onoro::Game<NPawns>::template move_list_t<MoveClass> move_list;
+  game.generateMoves(move_list);
+  if (move_list.size() > capacity) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < move_list.size(); i++) {
+    const MoveClass& move = move_list[i];
+    onoro::Game<NPawns> child(game, move);
+    child.PackState(children + i * packed_size);
+    memcpy(parents + i * sizeof(uint32_t), &parent, sizeof(uint32_t));
+    moves[i * packed_move_size] = moveTo(move).get_bytes();
+    moves[i * packed_move_size + 1] = packedFromIdx(move);
+  }
+  return move_list.size();
+}
+
+/*
+ * Reads packed states from packed_states_in, and writes the packed states of
+ * their children to the writable buffer children_out. For each child, writes
+ * the index of its parent in packed_states_in as a native uint32 to
+ * parents_out, and the move reaching it to moves_out.
+ *
+ * Positions are expanded in order until the children of the next position
+ * don't fit in the output buffers. Returns a tuple of the number of positions
+ * expanded and the number of children written, so callers can continue from
+ * the first position which wasn't expanded. Finished games have no children.
+ *
+ * The GIL is released while generating moves, so calls from several threads
+ * run in parallel.
+ */
+static PyObject* gen_next_moves_packed(PyObject* self, PyObject* args) {
+  (void) self;
+
+  Py_buffer packed_states_in;
+  Py_buffer children_out;
+  Py_buffer parents_out;
+  Py_buffer moves_out;
+  if (!PyArg_ParseTuple(args, "y*w*w*w*", &packed_states_in, &children_out,
+                        &parents_out, &moves_out)) {
+    return NULL;
+  }
+  BufferReleaser releaser(&packed_states_in, &children_out, &parents_out,
+                          &moves_out);
+
+  if (packed_states_in.len % packed_size != 0) {
+    PyErr_Format(PyExc_ValueError,
+                 "Packed states are %zd bytes, which is not a multiple of "
+                 "%zu",
+                 packed_states_in.len, packed_size);
+    return NULL;
+  }
+
+  const std::size_t n_states = packed_states_in.len / packed_size;
+  const std::size_t capacity =
+      std::min({ children_out.len / packed_size,
+                 parents_out.len / sizeof(uint32_t),
+                 moves_out.len / packed_move_size });
+
+  const uint8_t* states = static_cast<const uint8_t*>(packed_states_in.buf);
+  uint8_t* children = static_cast<uint8_t*>(children_out.buf);
+  uint8_t* parents = static_cast<uint8_t*>(parents_out.buf);
+  uint8_t* moves = static_cast<uint8_t*>(moves_out.buf);
+
+  std::size_t n_expanded = 0;
+  std::size_t n_children = 0;
+  absl::Status status;
+
+  Py_BEGIN_ALLOW_THREADS;
+  for (; n_expanded < n_states; n_expanded++) {
+    absl::StatusOr<onoro::Game<NPawns>> game =
+        onoro::Game<NPawns>::UnpackState(states + n_expanded * packed_size);
+    if (!game.ok()) {
+      status = game.status();
+      break;
+    }
+    if (game->isFinished()) {
+      continue;
+    }
+
+    int64_t n = game->inPhase2()
+                    ? packChildren<onoro::P2Move>(
+                          *game, n_expanded, capacity - n_children,
+                          children + n_children * packed_size,
+                          parents + n_children * sizeof(uint32_t),
+                          moves + n_children * packed_move_size)
+                    : packChildren<onoro::P1Move>(
+                          *game, n_expanded, capacity - n_children,
+                          children + n_children * packed_size,
+                          parents + n_children * sizeof(uint32_t),
+                          moves + n_children * packed_move_size);
+    if (n < 0) {
+      break;
+    }
+    n_children += n;
+  }
+  Py_END_ALLOW_THREADS;
+
+  if (!status.ok()) {
+    PyErr_Format(PyExc_ValueError, "Failed to unpack game %zu: %s", n_expanded,
+                 status.ToString().c_str());
+    return NULL;
+  }
+  return Py_BuildValue("(nn)", static_cast<Py_ssize_t>(n_expanded),
+                       static_cast<Py_ssize_t>(n_children));
+}
+
 static PyMethodDef gen_next_moves_def[] = {
   { "gen_next_moves", gen_next_moves, METH_VARARGS,
     "Python interface for gen_next_moves." },
+  { "pack_states", pack_states, METH_VARARGS,
+    "Packs the games of a serialized GameStates proto." },
+  { "unpack_states", unpack_states, METH_VARARGS,
+    "Serializes packed games to a GameStates proto." },
+  { "gen_next_moves_packed", gen_next_moves_packed, METH_VARARGS,
+    "Writes the children of packed games to preallocated buffers." },
   { NULL, NULL, 0, NULL }
 };
 
 static struct PyModuleDef test_next_moves_cc_module = {
   PyModuleDef_HEAD_INIT,
   "test_next_moves_cc",
-  "Python interface for the gen_next_moves function.",
+  "Python interface for the gen_next_moves functions.",
   -1,
   gen_next_moves_def,
   NULL,
@@ -0,0 +1,403 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "onoro.h"
+#include "opening_book.h"
+#include "test_util.h"
+#include "transposition_table.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_games = 2000;
+
+static const std::string book_path = "test_opening_book.book";
+static const std::string base_path = "test_opening_book_base.book";
+
+/*
+ * Gives each game a table entry with a varying score and bound, and its first
+ * move as the best move.
+ */
+static void setEntries(std::vector<onoro::Game<n_pawns>>& games) {
+  for (uint32_t i = 0; i < games.size(); i++) {
+    onoro::Game<n_pawns>& g = games[i];
+
+    onoro::TableMove best_move = onoro::TableMove::none();
+    auto first_move = [&g, &best_move](auto move) {
+      best_move = g.tableMove(move);
+      return false;
+    };
+    if (g.inPhase2()) {
+      g.forEachMoveP2(first_move);
+    } else {
+      g.forEachMove(first_move);
+    }
+
+    onoro::Score score = i % 3 == 0   ? onoro::Score::tie(i % 16)
+                         : i % 3 == 1 ? onoro::Score::win(1 + i % 15)
+                                      : onoro::Score::lose(1 + i % 15);
+    g.setTableEntry(
+        { score, static_cast<onoro::ScoreBound>(i % 3), best_move });
+  }
+}
+
+static bool sameEntry(const onoro::TableEntry& e1,
+                      const onoro::TableEntry& e2) {
+  return e1.score == e2.score && e1.bound == e2.bound &&
+         e1.best_move == e2.best_move;
+}
+
+template <uint32_t NPawns>
+static bool checkEntry(const onoro::OpeningBook<NPawns>& book,
+                       const onoro::Game<NPawns>& game,
+                       const onoro::TableEntry& expected) {
+  absl::optional<onoro::TableEntry> entry = book.findEntry(game);
+  if (!entry.has_value()) {
+    fprintf(stderr, "Failed to find game in book:\n%s\n", game.Print().c_str());
+    return false;
+  }
+  if (!sameEntry(*entry, expected)) {
+    fprintf(stderr, "Expected score %s, but found %s for game:\n%s\n",
+            expected.score.Print().c_str(), entry->score.Print().c_str(),
+            game.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Writes the games in [begin, end) to a book at `path`, by way of a table.
+ */
+template <uint32_t NPawns, class GameIt>
+static bool writeBook(const std::string& path, GameIt begin, GameIt end,
+                      const onoro::OpeningBook<NPawns>* base = nullptr) {
+  onoro::TranspositionTable<NPawns> table;
+  for (GameIt it = begin; it != end; it++) {
+    table.insert(*it);
+  }
+
+  absl::Status status = onoro::OpeningBook<NPawns>::write(path, table, base);
+  if (!status.ok()) {
+    fprintf(stderr, "Failed to write book: %s\n", status.ToString().c_str());
+    return false;
+  }
+  return true;
+}
+
+template <uint32_t NPawns = n_pawns>
+static absl::optional<onoro::OpeningBook<NPawns>> openBook(
+    const std::string& path) {
+  auto book = onoro::OpeningBook<NPawns>::open(path);
+  if (!book.ok()) {
+    fprintf(stderr, "Failed to open book: %s\n",
+            book.status().ToString().c_str());
+    return {};
+  }
+  return std::move(*book);
+}
+
+/*
+ * Checks that every game written to a book is found with its entry, and that
+ * games which weren't written are not found.
+ */
+static bool testRoundTrip(const std::vector<onoro::Game<n_pawns>>& games) {
+  const uint32_t n_written = games.size() / 2;
+  if (!writeBook<n_pawns>(book_path, games.begin(),
+                         games.begin() + n_written)) {
+    return false;
+  }
+
+  absl::optional<onoro::OpeningBook<n_pawns>> book = openBook(book_path);
+  if (!book.has_value()) {
+    return false;
+  }
+  if (book->size() != n_written) {
+    fprintf(stderr, "Expected %u entries in the book, found %zu\n", n_written,
+            book->size());
+    return false;
+  }
+
+  for (uint32_t i = 0; i < games.size(); i++) {
+    const onoro::Game<n_pawns>& game = games[i];
+    if (i < n_written) {
+      if (!checkEntry(*book, game, game.getTableEntry())) {
+        return false;
+      }
+    } else if (book->find(game).has_value()) {
+      fprintf(stderr, "Found game which was never written:\n%s\n",
+              game.Print().c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Checks that writing a book with a base book keeps the deeper entry of games
+ * in both, and the entries of games in only one of them.
+ */
+static bool testMerge(const std::vector<onoro::Game<n_pawns>>& games) {
+  const uint32_t n_base = 2 * games.size() / 3;
+  const uint32_t overlap_start = games.size() / 3;
+
+  if (!writeBook<n_pawns>(base_path, games.begin(), games.begin() + n_base)) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<n_pawns>> base = openBook(base_path);
+  if (!base.has_value()) {
+    return false;
+  }
+
+  // Rescore the games in both books, making half of them wins, which are at
+  // least as deep as any score, and half of them the shallowest possible tie.
+  std::vector<onoro::Game<n_pawns>> rescored(games.begin() + overlap_start,
+                                             games.end());
+  for (uint32_t i = 0; i < rescored.size(); i++) {
+    onoro::TableEntry entry = rescored[i].getTableEntry();
+    entry.score = i % 2 == 0 ? onoro::Score::win(1) : onoro::Score::tie(0);
+    rescored[i].setTableEntry(entry);
+  }
+
+  if (!writeBook(book_path, rescored.begin(), rescored.end(), &*base)) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<n_pawns>> book = openBook(book_path);
+  if (!book.has_value()) {
+    return false;
+  }
+  if (book->size() != games.size()) {
+    fprintf(stderr, "Expected %zu entries in the merged book, found %zu\n",
+            games.size(), book->size());
+    return false;
+  }
+
+  for (uint32_t i = 0; i < games.size(); i++) {
+    onoro::TableEntry expected = games[i].getTableEntry();
+    if (i >= overlap_start) {
+      // Rescored ties only replace games of the base book which are as
+      // shallow.
+      const onoro::Score& base_score = expected.score;
+      if (i >= n_base || (i - overlap_start) % 2 == 0 ||
+          base_score == onoro::Score::tie(0)) {
+        expected = rescored[i - overlap_start].getTableEntry();
+      }
+    }
+    if (!checkEntry(*book, games[i], expected)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Checks that merging shards keeps the games of every shard, merges the exact
+ * scores of games found in several shards, and refuses to merge shards with
+ * conflicting scores.
+ */
+static bool testMergeShards(const std::vector<onoro::Game<n_pawns>>& games) {
+  const uint32_t n_shard = 2 * games.size() / 3;
+  const uint32_t overlap_start = games.size() / 3;
+
+  // Game 3 has an exact tie(3) score, which is consistent with a win in 5.
+  std::vector<onoro::Game<n_pawns>> shard2(games.begin() + overlap_start,
+                                           games.end());
+  shard2.push_back(games[3]);
+  onoro::TableEntry win_entry = games[3].getTableEntry();
+  win_entry.score = onoro::Score::win(5);
+  shard2.back().setTableEntry(win_entry);
+
+  if (!writeBook<n_pawns>(book_path, games.begin(), games.begin() + n_shard) ||
+      !writeBook<n_pawns>(base_path, shard2.begin(), shard2.end())) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<n_pawns>> book1 = openBook(book_path);
+  absl::optional<onoro::OpeningBook<n_pawns>> book2 = openBook(base_path);
+  if (!book1.has_value() || !book2.has_value()) {
+    return false;
+  }
+
+  const std::string merged_path = "test_opening_book_merged.book";
+  absl::Status status =
+      onoro::OpeningBook<n_pawns>::merge(merged_path, { &*book1, &*book2 });
+  if (!status.ok()) {
+    fprintf(stderr, "Failed to merge shards: %s\n", status.ToString().c_str());
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<n_pawns>> merged = openBook(merged_path);
+  unlink(merged_path.c_str());
+  if (!merged.has_value()) {
+    return false;
+  }
+  if (merged->size() != games.size()) {
+    fprintf(stderr, "Expected %zu entries in the merged book, found %zu\n",
+            games.size(), merged->size());
+    return false;
+  }
+
+  for (uint32_t i = 0; i < games.size(); i++) {
+    onoro::TableEntry expected = games[i].getTableEntry();
+    if (i == 3) {
+      expected = win_entry;
+      expected.score = games[3].getScore().merge(win_entry.score);
+    }
+    if (!checkEntry(*merged, games[i], expected)) {
+      return false;
+    }
+  }
+
+  // A tie in 3 moves can't be a win in 1 move.
+  win_entry.score = onoro::Score::win(1);
+  shard2.back().setTableEntry(win_entry);
+  if (!writeBook<n_pawns>(base_path, shard2.begin(), shard2.end())) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<n_pawns>> conflicting =
+      openBook(base_path);
+  if (!conflicting.has_value()) {
+    return false;
+  }
+  if (onoro::OpeningBook<n_pawns>::merge(merged_path,
+                                         { &*book1, &*conflicting })
+          .ok()) {
+    unlink(merged_path.c_str());
+    fprintf(stderr, "Merged shards with incompatible scores\n");
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Checks that two inequivalent games with the same canonical hash get their own
+ * records, both when written to one book and when merged from separate shards,
+ * where scores which conflict for one game are fine for different games.
+ */
+static bool testCollidingHashes() {
+  static constexpr uint32_t NPawns = 12;
+
+  absl::optional<std::pair<onoro::Game<NPawns>, onoro::Game<NPawns>>> pair =
+      onoro::test::findCanonicalHashCollision<NPawns>();
+  if (!pair.has_value()) {
+    fprintf(stderr, "Failed to find games with colliding canonical hashes\n");
+    return false;
+  }
+
+  // A tie in 3 moves and a win in 1 move can't both be exact scores of one
+  // game.
+  std::vector<onoro::Game<NPawns>> games = { pair->first, pair->second };
+  games[0].setTableEntry({ onoro::Score::tie(3), onoro::ScoreBound::BOUND_EXACT,
+                           onoro::TableMove::none() });
+  games[1].setTableEntry({ onoro::Score::win(1), onoro::ScoreBound::BOUND_EXACT,
+                           onoro::TableMove::none() });
+
+  if (!writeBook<NPawns>(book_path, games.begin(), games.end())) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<NPawns>> book = openBook<NPawns>(book_path);
+  if (!book.has_value()) {
+    return false;
+  }
+  if (book->size() != 2) {
+    fprintf(stderr,
+            "Expected games with colliding canonical hashes to take 2 "
+            "records, found %zu\n",
+            book->size());
+    return false;
+  }
+
+  if (!writeBook<NPawns>(book_path, games.begin(), games.begin() + 1) ||
+      !writeBook<NPawns>(base_path, games.begin() + 1, games.end())) {
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<NPawns>> book1 =
+      openBook<NPawns>(book_path);
+  absl::optional<onoro::OpeningBook<NPawns>> book2 =
+      openBook<NPawns>(base_path);
+  if (!book1.has_value() || !book2.has_value()) {
+    return false;
+  }
+
+  const std::string merged_path = "test_opening_book_merged.book";
+  absl::Status status =
+      onoro::OpeningBook<NPawns>::merge(merged_path, { &*book1, &*book2 });
+  if (!status.ok()) {
+    fprintf(stderr, "Failed to merge shards of different games: %s\n",
+            status.ToString().c_str());
+    return false;
+  }
+  absl::optional<onoro::OpeningBook<NPawns>> merged =
+      openBook<NPawns>(merged_path);
+  unlink(merged_path.c_str());
+  if (!merged.has_value()) {
+    return false;
+  }
+
+  for (const onoro::OpeningBook<NPawns>* b : { &*book, &*merged }) {
+    for (const onoro::Game<NPawns>& game : games) {
+      if (!checkEntry(*b, game, game.getTableEntry())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Checks that files which aren't books for games with n_pawns pawns are
+ * rejected.
+ */
+static bool testBadFiles() {
+  if (onoro::OpeningBook<n_pawns>::open("does_not_exist.book").ok()) {
+    fprintf(stderr, "Opened a book which doesn't exist\n");
+    return false;
+  }
+
+  FILE* file = fopen(book_path.c_str(), "wb");
+  fprintf(file, "This is not an opening book, but is long enough to be one\n");
+  fclose(file);
+  if (onoro::OpeningBook<n_pawns>::open(book_path).ok()) {
+    fprintf(stderr, "Opened a file which isn't a book\n");
+    return false;
+  }
+
+  std::vector<onoro::Game<n_pawns + 1>> other_games(1);
+  if (!writeBook<n_pawns + 1>(book_path, other_games.begin(),
+                              other_games.end())) {
+    return false;
+  }
+  if (onoro::OpeningBook<n_pawns>::open(book_path).ok()) {
+    fprintf(stderr, "Opened a book for a different number of pawns\n");
+    return false;
+  }
+
+  if (truncate(base_path.c_str(), 100) != 0 ||
+      onoro::OpeningBook<n_pawns>::open(base_path).ok()) {
+    fprintf(stderr, "Opened a truncated book\n");
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<onoro::Game<n_pawns>> games =
+      onoro::test::genGames<n_pawns>(n_games);
+  setEntries(games);
+
+  bool ok = testRoundTrip(games) && testMerge(games) &&
+            testMergeShards(games) && testCollidingHashes() &&
+            testBadFiles();
+  unlink(book_path.c_str());
+  unlink(base_path.c_str());
+  if (!ok) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
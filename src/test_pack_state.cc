@@ -0,0 +1,108 @@
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "onoro.h"
+#include "playout.h"
+
+static constexpr uint32_t n_playouts = 200;
+static constexpr uint32_t max_playout_len = 60;
+
+/*
+ * Checks that unpacking the packed state of `g` gives back the same game.
+ */
+template <uint32_t NPawns>
+static bool checkRoundTrip(const onoro::Game<NPawns>& g) {
+  uint8_t buf[onoro::Game<NPawns>::packed_size];
+  g.PackState(buf);
+
+  absl::StatusOr<onoro::Game<NPawns>> res =
+      onoro::Game<NPawns>::UnpackState(buf);
+  if (!res.ok()) {
+    fprintf(stderr, "Failed to unpack game:\n%s\n%s\n", g.Print().c_str(),
+            res.status().ToString().c_str());
+    return false;
+  }
+
+  const onoro::Game<NPawns>& g2 = *res;
+  // validate() expects white to have one fewer pawn on black's turn, which
+  // only holds in the first phase.
+  if ((!g.inPhase2() && !g2.validate()) || !onoro::GameEq<NPawns>()(g, g2) ||
+      g.blackTurn() != g2.blackTurn() || g.isFinished() != g2.isFinished() ||
+      g.nPawnsInPlay() != g2.nPawnsInPlay() || g.hash() != g2.hash()) {
+    fprintf(stderr, "Unpacked game:\n%s\nis not the same as:\n%s\n",
+            g2.Print().c_str(), g.Print().c_str());
+    return false;
+  }
+
+  uint8_t buf2[onoro::Game<NPawns>::packed_size];
+  g2.PackState(buf2);
+  if (memcmp(buf, buf2, sizeof(buf)) != 0) {
+    fprintf(stderr, "Repacking game changed its packed state:\n%s\n",
+            g.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Checks that packed states which don't describe a game are rejected.
+ */
+template <uint32_t NPawns>
+static bool checkBadStates(const onoro::Game<NPawns>& g) {
+  uint8_t buf[onoro::Game<NPawns>::packed_size];
+
+  // Two pawns on the same tile.
+  g.PackState(buf);
+  buf[1] = buf[0];
+  if (onoro::Game<NPawns>::UnpackState(buf).ok()) {
+    fprintf(stderr, "Unpacked a game with two pawns on the same tile\n");
+    return false;
+  }
+
+  // A pawn in play with the null idx.
+  g.PackState(buf);
+  buf[0] = 0;
+  if (onoro::Game<NPawns>::UnpackState(buf).ok()) {
+    fprintf(stderr, "Unpacked a game with a pawn off the board\n");
+    return false;
+  }
+
+  if (g.nPawnsInPlay() < NPawns) {
+    // The wrong player to move in phase 1.
+    g.PackState(buf);
+    buf[NPawns] ^= 0x10u;
+    if (onoro::Game<NPawns>::UnpackState(buf).ok()) {
+      fprintf(stderr, "Unpacked a game with the wrong player to move\n");
+      return false;
+    }
+
+    // A pawn placed past the pawns in play.
+    g.PackState(buf);
+    buf[NPawns - 1] = buf[0];
+    if (onoro::Game<NPawns>::UnpackState(buf).ok()) {
+      fprintf(stderr, "Unpacked a game with too many pawns placed\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+template <uint32_t NPawns>
+static bool testPackState() {
+  return onoro::forEachPlayoutPosition<NPawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [](const onoro::Game<NPawns>& g, uint32_t ply) {
+        return checkRoundTrip(g) && checkBadStates(g);
+      });
+}
+
+int main(int argc, char* argv[]) {
+  if (!testPackState<8>() || !testPackState<12>() || !testPackState<16>()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
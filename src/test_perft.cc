@@ -0,0 +1,81 @@
+
+#include <cstdio>
+#include <vector>
+
+#include "onoro.h"
+#include "perft.h"
+#include "playout.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_playouts = 20;
+static constexpr uint32_t max_playout_len = 40;
+static constexpr uint32_t max_depth = 4;
+
+/*
+ * Counts the games reached after `depth` moves from `g` by constructing every
+ * child game, independently of the in place moves used by perft.
+ */
+static uint64_t countGames(const onoro::Game<n_pawns>& g, uint32_t depth) {
+  if (depth == 0) {
+    return 1;
+  }
+
+  uint64_t n_games = 0;
+  auto count_child = [&g, &n_games, depth](auto move) {
+    onoro::Game<n_pawns> child(g, move);
+    if (depth == 1) {
+      n_games++;
+    } else if (!child.isFinished()) {
+      n_games += countGames(child, depth - 1);
+    }
+    return true;
+  };
+  if (g.inPhase2()) {
+    g.forEachMoveP2(count_child);
+  } else {
+    g.forEachMove(count_child);
+  }
+  return n_games;
+}
+
+static bool checkPerft(const onoro::Game<n_pawns>& g, uint32_t depth) {
+  onoro::Game<n_pawns> game = g;
+  uint64_t n_games = game.inPhase2()
+                         ? onoro::perft<n_pawns, onoro::P2Move>(game, depth)
+                         : onoro::perft<n_pawns, onoro::P1Move>(game, depth);
+
+  uint64_t expected = countGames(g, depth);
+  if (n_games != expected) {
+    fprintf(stderr, "Perft %u found %llu games, expected %llu from:\n%s\n",
+            depth, n_games, expected, g.Print().c_str());
+    return false;
+  }
+  if (game.hash() != g.hash() || game.Print() != g.Print()) {
+    fprintf(stderr, "Perft didn't restore the game:\n%s\n",
+            g.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  bool ok = onoro::forEachPlayoutPosition<n_pawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [](const onoro::Game<n_pawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        for (uint32_t depth = 0; depth <= max_depth; depth++) {
+          if (!checkPerft(g, depth)) {
+            return false;
+          }
+        }
+        return true;
+      });
+  if (!ok) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "onoro.h"
+#include "playout.h"
+#include "search.h"
+#include "tablebase.h"
+#include "transposition_table.h"
+
+static constexpr uint32_t n_pawns = 8;
+static constexpr uint32_t n_threads = 4;
+static constexpr uint32_t n_playouts = 50;
+static constexpr uint32_t max_playout_len = 100;
+
+// Positions decided within this many moves are checked against a search.
+static constexpr uint32_t max_search_depth = 4;
+static constexpr uint32_t max_searches = 200;
+
+static const std::string tablebase_path = "test_tablebase.tb";
+
+using Tablebase = onoro::Tablebase<n_pawns>;
+
+/*
+ * The outcome of `score` for a search `depth` moves deep: +1 if the player to
+ * move wins, -1 if they lose, and 0 if the outcome isn't decided within
+ * `depth` moves.
+ */
+static int32_t outcome(onoro::Score score, uint32_t depth) {
+  if (score.turn_count_win() == 0 || depth < score.turn_count_win()) {
+    return 0;
+  }
+  return score.curPlayerWins() ? 1 : -1;
+}
+
+/*
+ * Checks that the outcome of `g` in the tablebase follows from the outcomes of
+ * its children.
+ */
+static bool checkConsistent(const Tablebase& tb, const onoro::Game<n_pawns>& g,
+                            onoro::Score score) {
+  absl::optional<onoro::Score> expected;
+  if (g.findWinningMoveP2().has_value()) {
+    expected = onoro::Score::win(1);
+  } else {
+    onoro::Game<n_pawns>::move_list_t<onoro::P2Move> moves;
+    g.generateMoves(moves);
+    if (moves.empty()) {
+      expected = onoro::Score::lose(1);
+    }
+
+    uint32_t min_loss = UINT32_MAX;
+    uint32_t max_win = 0;
+    bool all_won = true;
+    for (onoro::P2Move move : moves) {
+      absl::optional<onoro::Score> child =
+          tb.find(onoro::Game<n_pawns>(g, move));
+      if (!child.has_value()) {
+        fprintf(stderr, "Child of a position is missing from the tablebase\n");
+        return false;
+      }
+      if (child->turn_count_win() == 0) {
+        all_won = false;
+      } else if (child->curPlayerWins()) {
+        max_win = std::max(max_win, child->turn_count_win());
+      } else {
+        min_loss = std::min(min_loss, child->turn_count_win());
+        all_won = false;
+      }
+    }
+
+    if (min_loss != UINT32_MAX) {
+      expected = onoro::Score::win(min_loss + 1);
+    } else if (all_won && !moves.empty()) {
+      expected = onoro::Score::lose(max_win + 1);
+    }
+  }
+
+  bool consistent = expected.has_value()
+                        ? score == *expected
+                        : score.turn_count_win() == 0;
+  if (!consistent) {
+    fprintf(stderr, "Expected score %s, found %s for:\n%s\n",
+            expected.has_value() ? expected->Print().c_str() : "draw",
+            score.Print().c_str(), g.Print().c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Checks that a search `depth` moves deep agrees with the tablebase score
+ * `score` of `g`, with and without probing the tablebase.
+ */
+static bool checkSearch(const Tablebase& tb, const onoro::Game<n_pawns>& g,
+                        onoro::Score score, uint32_t depth) {
+  for (const Tablebase* probe : { (const Tablebase*) nullptr, &tb }) {
+    onoro::SearchOptions<n_pawns> options;
+    options.tablebase = probe;
+    std::vector<onoro::SearchThreadStats> stats;
+    onoro::TranspositionTable<n_pawns> table;
+
+    auto [search_score, move] = onoro::findMoveParallel<n_pawns, onoro::P2Move>(
+        g, table, depth, options, stats);
+    int32_t expected = outcome(score, depth);
+    // Without moves, the search has no score, and the player to move loses.
+    int32_t found =
+        search_score.has_value() ? outcome(*search_score, depth) : -1;
+    if (found != expected) {
+      fprintf(stderr,
+              "Search %u moves deep %s the tablebase found %d, expected %d "
+              "from %s for:\n%s\n",
+              depth, probe != nullptr ? "probing" : "without", found,
+              expected, score.Print().c_str(), g.Print().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool testTablebase() {
+  absl::StatusOr<onoro::TablebaseStats> stats =
+      Tablebase::build(tablebase_path, n_threads);
+  if (!stats.ok()) {
+    fprintf(stderr, "%s\n", stats.status().ToString().c_str());
+    return false;
+  }
+  if (stats->n_wins + stats->n_losses + stats->n_draws !=
+      stats->n_positions) {
+    fprintf(stderr,
+            "%llu wins, %llu losses and %llu draws don't add up to %llu "
+            "positions\n",
+            stats->n_wins, stats->n_losses, stats->n_draws,
+            stats->n_positions);
+    return false;
+  }
+  if (access((tablebase_path + ".positions").c_str(), F_OK) == 0 ||
+      access((tablebase_path + ".children").c_str(), F_OK) == 0) {
+    fprintf(stderr, "Work files of the tablebase were not removed\n");
+    return false;
+  }
+
+  absl::StatusOr<Tablebase> tb = Tablebase::open(tablebase_path);
+  unlink(tablebase_path.c_str());
+  if (!tb.ok()) {
+    fprintf(stderr, "%s\n", tb.status().ToString().c_str());
+    return false;
+  }
+  if (tb->size() != stats->n_positions) {
+    fprintf(stderr, "Tablebase has %zu positions, expected %llu\n",
+            tb->size(), stats->n_positions);
+    return false;
+  }
+
+  uint32_t n_searches = 0;
+  return onoro::forEachPlayoutPosition<n_pawns>(
+      /*seed=*/0, n_playouts, max_playout_len,
+      [&tb, &n_searches](const onoro::Game<n_pawns>& g, uint32_t ply) {
+        if (g.isFinished()) {
+          return true;
+        }
+        if (!g.inPhase2()) {
+          if (tb->find(g).has_value()) {
+            fprintf(stderr, "Found a phase 1 position in the tablebase\n");
+            return false;
+          }
+          return true;
+        }
+
+        absl::optional<onoro::Score> score = tb->find(g);
+        if (!score.has_value()) {
+          fprintf(stderr, "Position is missing from the tablebase:\n%s\n",
+                  g.Print().c_str());
+          return false;
+        }
+        if (!checkConsistent(*tb, g, *score)) {
+          return false;
+        }
+
+        uint32_t depth = score->turn_count_win() != 0
+                             ? score->turn_count_win()
+                             : max_search_depth;
+        if (depth <= max_search_depth && n_searches < max_searches) {
+          n_searches++;
+          if (!checkSearch(*tb, g, *score, depth) ||
+              (depth > 1 && !checkSearch(*tb, g, *score, depth - 1))) {
+            return false;
+          }
+        }
+        return true;
+      });
+}
+
+int main(int argc, char* argv[]) {
+  if (!testTablebase()) {
+    return -1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -64,17 +64,9 @@ static std::pair<absl::optional<onoro::Score>, MoveClass> findMove(
     return { onoro::Score::tie(0), MoveClass() };
   }
 
-  if (!MoveClass::forEachMoveFn(g,
-                                [&g, &best_move, &best_score](MoveClass move) {
-                                  onoro::Game<NPawns> g2(g, move);
-                                  if (g2.isFinished()) {
-                                    best_score = onoro::Score::win(1);
-                                    best_move = move;
-                                    return false;
-                                  }
-                                  return true;
-                                })) {
-    return { best_score, best_move };
+  absl::optional<MoveClass> winning_move = MoveClass::findWinningMoveFn(g);
+  if (winning_move.has_value()) {
+    return { onoro::Score::win(1), *winning_move };
   }
 
   MoveClass::forEachMoveFn(
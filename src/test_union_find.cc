@@ -125,6 +125,27 @@ int main(int argc, char* argv[]) {
     assert(uf.GetNumGroups() == 7);
   }
 
+  {
+    StaticUnionFind<uint8_t, 256> uf;
+
+    uf.Union(1, 3);
+    uf.Union(255, 3);
+    assert(uf.Find(255) == uf.Find(1));
+    assert(uf.Find(0) == 0);
+    assert(uf.GetNumGroups() == 254);
+
+    // A reset union find is the same as a newly constructed one.
+    uf.Reset();
+    for (uint32_t i = 0; i < 256; i++) {
+      assert(uf.Find(i) == i);
+    }
+    assert(uf.GetNumGroups() == 256);
+
+    uf.Union(4, 5);
+    assert(uf.Find(4) == uf.Find(5));
+    assert(uf.GetNumGroups() == 255);
+  }
+
 #define NUM_TRIALS 10
   uint32_t widths[NUM_TRIALS] = { 1000, 1000, 1500, 2000, 2000,
                                   2000, 2500, 2500, 3000, 2500 };